@@ -0,0 +1,208 @@
+// Counts the heap allocations made while encoding and signing order entry requests and while
+// building the scheduler requests that carry them. Any operator new on those paths is a failure
+// (exit code 1). OpenSSL's own allocations are counted separately and only reported: on
+// OpenSSL 3.0 every EVP_MD_CTX_copy_ex duplicates the provider's digest context, which costs two
+// allocations per signature that no caller can avoid.
+
+#include <openssl/crypto.h>
+#include <openssl/opensslv.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+
+#include "ClockSync.h"
+#include "RequestEncoder.h"
+#include "RequestScheduler.h"
+
+namespace
+{
+
+static constexpr const uint64_t ITERATIONS = 10'000;
+
+static uint64_t cxx_allocations = 0;
+static uint64_t openssl_allocations = 0;
+
+static void* CountedMalloc(const size_t size, const char* /*file*/, const int /*line*/)
+{
+    ++openssl_allocations;
+    return std::malloc(size);
+}
+
+static void* CountedRealloc(void* ptr, const size_t size, const char* /*file*/, const int /*line*/)
+{
+    ++openssl_allocations;
+    return std::realloc(ptr, size);
+}
+
+static void CountedFree(void* ptr, const char* /*file*/, const int /*line*/)
+{
+    std::free(ptr);
+}
+
+static void* Allocate(const size_t size)
+{
+    ++cxx_allocations;
+
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+
+    return ptr;
+}
+
+struct Result
+{
+    double cxx_per_call;
+    double openssl_per_call;
+};
+
+// Runs `call` ITERATIONS times after one warm-up call (thread local buffers, digest contexts)
+template <typename F>
+static Result Measure(F&& call)
+{
+    call(0);
+
+    const uint64_t cxx_start = cxx_allocations;
+    const uint64_t openssl_start = openssl_allocations;
+
+    for (uint64_t i = 1; i <= ITERATIONS; ++i)
+    {
+        call(i);
+    }
+
+    return Result{static_cast<double>(cxx_allocations - cxx_start) / ITERATIONS
+            , static_cast<double>(openssl_allocations - openssl_start) / ITERATIONS};
+}
+
+}
+
+void* operator new(const size_t size)
+{
+    return Allocate(size);
+}
+
+void* operator new[](const size_t size)
+{
+    return Allocate(size);
+}
+
+void* operator new(const size_t size, const std::nothrow_t&) noexcept
+{
+    ++cxx_allocations;
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](const size_t size, const std::nothrow_t&) noexcept
+{
+    ++cxx_allocations;
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, const size_t /*size*/) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, const size_t /*size*/) noexcept
+{
+    std::free(ptr);
+}
+
+int main()
+{
+    // Before OpenSSL allocates anything
+    CRYPTO_set_mem_functions(&CountedMalloc, &CountedRealloc, &CountedFree);
+
+    ftx::RequestEncoder encoder("https://ftx.us/api", "BTC/USD", "secret", std::make_shared<ftx::ClockSync>());
+    encoder.SetPriceIncrement(0.5);
+    encoder.SetSizeIncrement(0.0001);
+
+    uint64_t sink = 0;
+
+    const std::pair<const char*, Result> results[] =
+    {
+        {"EncodeNewOrder", Measure([&](const uint64_t i)
+        {
+            sink += encoder.EncodeNewOrder(ftx::ws::Side::BUY, 20000.5, 0.0125, i).signature.size;
+        })},
+        {"EncodeIocOrder", Measure([&](const uint64_t i)
+        {
+            sink += encoder.EncodeIocOrder(ftx::ws::Side::SELL, 19999.5, 0.0125, i).signature.size;
+        })},
+        {"EncodeCancelByClientId", Measure([&](const uint64_t i)
+        {
+            sink += encoder.EncodeCancelByClientId(i).signature.size;
+        })},
+        {"EncodeOrderStatus", Measure([&](const uint64_t i)
+        {
+            sink += encoder.EncodeOrderStatus(i).signature.size;
+        })},
+        {"EncodeCancelSide", Measure([&](const uint64_t /*i*/)
+        {
+            sink += encoder.EncodeCancelSide(ftx::ws::Side::BUY).signature.size;
+        })},
+        {"EncodeCancelAll", Measure([&](const uint64_t /*i*/)
+        {
+            sink += encoder.EncodeCancelAll().signature.size;
+        })},
+
+        // Built the way Gateway builds a new order, moved the way the scheduler queues it
+        {"RequestScheduler::Request", Measure([&](const uint64_t i)
+        {
+            const ftx::ws::Side side = ftx::ws::Side::BUY;
+            const double price = 20000.5;
+            const double size = 0.0125;
+
+            ftx::RequestScheduler::Request request;
+            request.priority = ftx::RequestScheduler::Priority::NEW_ORDER;
+            request.encode = [&encoder, side, price, size, i]() -> const ftx::EncodedRequest&
+            {
+                return encoder.EncodeNewOrder(side, price, size, i);
+            };
+            request.is_current = [&sink, side, price]() { return sink != 0 && side == ftx::ws::Side::BUY && price > 0.0; };
+            request.on_dropped = [&sink, side, size, i](const ftx::RequestScheduler::DropReason /*reason*/)
+            {
+                sink += side == ftx::ws::Side::BUY && size > 0.0 ? i : 0;
+            };
+            request.supersede_key = i;
+
+            ftx::RequestScheduler::Request queued(std::move(request));
+            sink += queued.is_current() ? queued.encode().signature.size : 0;
+        })}
+    };
+
+    bool allocated = false;
+
+    std::cout << OPENSSL_VERSION_TEXT << std::endl;
+    for (const auto& result : results)
+    {
+        std::cout << result.first << ": " << result.second.cxx_per_call << " operator new, "
+            << result.second.openssl_per_call << " OpenSSL allocations per call" << std::endl;
+
+        allocated = allocated || result.second.cxx_per_call != 0.0;
+    }
+
+    if (sink == 0)
+    {
+        return 2;
+    }
+
+    return allocated ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,306 @@
+// Round trips of a small signed request through HttpClient to a server on localhost, one at a
+// time from the main thread. Reports the latency distribution and, where the raw_syscalls
+// tracepoint can be opened (root, tracefs mounted), the system calls the main thread made per
+// request. The server runs in a child process so its calls are not counted.
+//
+// Which socket backend is measured is decided at build time by FTX_IO_URING; build with and
+// without it to compare io_uring against the epoll reactor.
+
+#include <linux/perf_event.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "Clock.h"
+#include "ClockSync.h"
+#include "HttpClient.h"
+#include "LatencyHistogram.h"
+#include "RequestEncoder.h"
+#include "TlsContext.h"
+
+namespace
+{
+
+static constexpr const uint64_t DEFAULT_REQUESTS = 100'000;
+static constexpr const uint64_t WARMUP_REQUESTS = 1'000;
+
+static constexpr const char* RESPONSE =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 28\r\n"
+    "\r\n"
+    "{\"success\":true,\"result\":{}}";
+
+static constexpr const char* LENGTH_HEADER = "Content-Length: ";
+
+static constexpr const char* TRACEPOINT_IDS[] =
+{
+    "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+    "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id"
+};
+
+// Answers every request on the connection with RESPONSE until the client goes away
+static void ServeConnection(const int fd)
+{
+    std::string received;
+    char data[16 * 1024];
+
+    while (true)
+    {
+        size_t head_end = received.find("\r\n\r\n");
+        while (head_end == std::string::npos)
+        {
+            const ssize_t count = read(fd, data, sizeof(data));
+            if (count <= 0)
+            {
+                close(fd);
+                return;
+            }
+
+            received.append(data, static_cast<size_t>(count));
+            head_end = received.find("\r\n\r\n");
+        }
+
+        size_t body_size = 0;
+        const size_t length = received.find(LENGTH_HEADER);
+        if (length != std::string::npos && length < head_end)
+        {
+            body_size = std::strtoul(received.c_str() + length + std::strlen(LENGTH_HEADER), nullptr, 10);
+        }
+
+        const size_t request_size = head_end + 4 + body_size;
+        while (received.size() < request_size)
+        {
+            const ssize_t count = read(fd, data, sizeof(data));
+            if (count <= 0)
+            {
+                close(fd);
+                return;
+            }
+
+            received.append(data, static_cast<size_t>(count));
+        }
+
+        received.erase(0, request_size);
+
+        if (write(fd, RESPONSE, std::strlen(RESPONSE)) < 0)
+        {
+            close(fd);
+            return;
+        }
+    }
+}
+
+static void Serve(const int listener)
+{
+    while (true)
+    {
+        const int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+        {
+            return;
+        }
+
+        std::thread([fd](){ ServeConnection(fd); }).detach();
+    }
+}
+
+// Listens on an ephemeral localhost port, returns the socket and sets `port`
+static int Listen(uint16_t& port)
+{
+    const int listener = socket(AF_INET, SOCK_STREAM, 0);
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+
+    socklen_t address_size = sizeof(address);
+    if (listener < 0
+            || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+            || listen(listener, 16) != 0
+            || getsockname(listener, reinterpret_cast<sockaddr*>(&address), &address_size) != 0)
+    {
+        std::perror("listen");
+        std::exit(1);
+    }
+
+    port = ntohs(address.sin_port);
+    return listener;
+}
+
+// Counts the system calls the calling thread enters while started
+class SyscallCounter
+{
+public:
+    SyscallCounter()
+        : _fd(-1)
+    {
+        for (const char* path : TRACEPOINT_IDS)
+        {
+            std::ifstream file(path);
+            uint64_t id = 0;
+            if (!(file >> id))
+            {
+                continue;
+            }
+
+            perf_event_attr attr{};
+            attr.type = PERF_TYPE_TRACEPOINT;
+            attr.size = sizeof(attr);
+            attr.config = id;
+            attr.disabled = 1;
+
+            _fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+            if (_fd >= 0)
+            {
+                return;
+            }
+        }
+    }
+
+    ~SyscallCounter()
+    {
+        if (_fd >= 0)
+        {
+            close(_fd);
+        }
+    }
+
+    bool IsAvailable() const
+    {
+        return _fd >= 0;
+    }
+
+    void Start()
+    {
+        ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    uint64_t Stop()
+    {
+        ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+
+        uint64_t count = 0;
+        if (read(_fd, &count, sizeof(count)) != sizeof(count))
+        {
+            return 0;
+        }
+
+        return count;
+    }
+
+private:
+    int _fd;
+};
+
+}
+
+int main(int argc, char** argv)
+{
+    const uint64_t requests = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : DEFAULT_REQUESTS;
+
+    uint16_t port = 0;
+    const int listener = Listen(port);
+
+    // Before any thread of ours exists
+    const pid_t server = fork();
+    if (server == 0)
+    {
+        Serve(listener);
+        _exit(0);
+    }
+
+    close(listener);
+
+    ftx::clock::Calibrate();
+
+    const std::string endpoint = "http://127.0.0.1:" + std::to_string(port) + "/api";
+
+    ftx::HttpClient client(endpoint, "key", std::make_shared<ftx::TlsContext>());
+    ftx::RequestEncoder encoder(endpoint, "BTC/USD", "secret", std::make_shared<ftx::ClockSync>());
+
+    if (!client.WarmUp())
+    {
+        std::cout << "Could not connect to the local server" << std::endl;
+        kill(server, SIGTERM);
+        return 1;
+    }
+
+    ftx::LatencyHistogram round_trips;
+    SyscallCounter syscalls;
+    uint64_t failures = 0;
+
+    const auto run = [&](const uint64_t count, const bool measure)
+    {
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            const ftx::EncodedRequest& request = encoder.EncodeCancelByClientId(i);
+            const uint64_t start_ns = ftx::clock::MonotonicNs();
+
+            ftx::HttpClient::Lease lease = client.Acquire();
+            ftx::HttpClient::Response response;
+            const bool ok = lease.Send(request, response) && response.status == 200;
+
+            if (measure)
+            {
+                round_trips.Record(ftx::clock::MonotonicNs() - start_ns);
+                failures += ok ? 0 : 1;
+            }
+        }
+    };
+
+    run(WARMUP_REQUESTS, false);
+
+    if (syscalls.IsAvailable())
+    {
+        syscalls.Start();
+    }
+
+    run(requests, true);
+
+    const uint64_t syscall_count = syscalls.IsAvailable() ? syscalls.Stop() : 0;
+
+    kill(server, SIGTERM);
+    waitpid(server, nullptr, 0);
+
+    const ftx::LatencyHistogram::Snapshot snapshot = round_trips.GetSnapshot();
+
+#if FTX_IO_URING
+    std::cout << "Backend: io_uring" << std::endl;
+#else
+    std::cout << "Backend: epoll" << std::endl;
+#endif
+
+    std::cout << "Requests: " << requests << ", failed: " << failures << std::endl
+        << "Round trip us: p50 " << snapshot.p50_ns / 1000.0
+        << ", p90 " << snapshot.p90_ns / 1000.0
+        << ", p99 " << snapshot.p99_ns / 1000.0
+        << ", p99.9 " << snapshot.p999_ns / 1000.0
+        << ", max " << snapshot.max_ns / 1000.0 << std::endl;
+
+    if (syscalls.IsAvailable())
+    {
+        std::cout << "Syscalls per request: " << static_cast<double>(syscall_count) / requests << std::endl;
+    }
+    else
+    {
+        std::cout << "Syscalls per request: unavailable (needs the raw_syscalls tracepoint)" << std::endl;
+    }
+
+    return failures == 0 ? 0 : 1;
+}
\ No newline at end of file
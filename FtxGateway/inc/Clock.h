@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define FTX_HAS_TSC 1
+#else
+#define FTX_HAS_TSC 0
+#endif
+
+namespace ftx
+{
+namespace clock
+{
+
+// Hot path clocks. On x86 with an invariant TSC, MonotonicNs/WallNs are a single rdtsc
+// scaled by an anchor taken against CLOCK_MONOTONIC_RAW and CLOCK_REALTIME, so they never
+// enter the kernel. Otherwise, and until Calibrate() has run, they fall back to clock_gettime.
+//
+// A background thread re-anchors every second. The wall clock is set back onto
+// CLOCK_REALTIME each time, so it follows NTP steps and slewing, and it runs at the rate
+// CLOCK_REALTIME kept over the last second. The monotonic clock carries on from where it
+// was, at a rate measured over the whole run, so it never goes backwards.
+struct Stats
+{
+    bool tsc_enabled;
+    double ns_per_tick;
+
+    // Re-anchors so far, and how far the wall clock was off CLOCK_REALTIME at the last one
+    // and at the worst one
+    uint64_t anchors;
+    int64_t last_wall_error_ns;
+    uint64_t max_wall_error_ns;
+
+    // Average cost of one call, measured on the first call of GetStats()
+    double monotonic_call_ns;
+    double wall_call_ns;
+    double system_clock_call_ns;
+};
+
+// Measures the TSC rate, spinning for about 50 ms, and starts the re-anchoring thread. Call it
+// once at startup, before the hot path runs; later calls return right away.
+void Calibrate();
+
+// Calibrates first if that has not been done yet
+Stats GetStats();
+
+// Re-anchors right away rather than waiting for the clock's thread
+void Recalibrate();
+
+namespace detail
+{
+
+// Maps TSC ticks to both clocks from `tsc_base` on
+struct Anchor
+{
+    double ns_per_tick;
+    double wall_ns_per_tick;
+    uint64_t tsc_base;
+    uint64_t monotonic_base_ns;
+    uint64_t wall_base_ns;
+};
+
+// Copies the current anchor and reads the TSC in one consistent read. Returns false if the
+// TSC is not used.
+bool Read(Anchor& anchor, uint64_t& tsc);
+
+inline uint64_t Extrapolate(const uint64_t base_ns, const uint64_t tsc, const uint64_t tsc_base, const double ns_per_tick)
+{
+    // Signed, as a TSC read on another core may come out a few ticks before the anchor's
+    return base_ns + static_cast<int64_t>(static_cast<int64_t>(tsc - tsc_base) * ns_per_tick);
+}
+
+} // namespace detail
+
+inline uint64_t ReadTsc()
+{
+#if FTX_HAS_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+inline uint64_t MonotonicNs()
+{
+    detail::Anchor anchor;
+    uint64_t tsc = 0;
+
+    if (detail::Read(anchor, tsc))
+    {
+        return detail::Extrapolate(anchor.monotonic_base_ns, tsc, anchor.tsc_base, anchor.ns_per_tick);
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+inline uint64_t WallNs()
+{
+    detail::Anchor anchor;
+    uint64_t tsc = 0;
+
+    if (detail::Read(anchor, tsc))
+    {
+        return detail::Extrapolate(anchor.wall_base_ns, tsc, anchor.tsc_base, anchor.wall_ns_per_tick);
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+// Wall clock milliseconds for request signing, derived from the TSC anchor
+inline int64_t WallMs()
+{
+    return static_cast<int64_t>(WallNs() / 1'000'000);
+}
+
+} // namespace clock
+} // namespace ftx
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace ftx
+{
+
+// Estimates the offset between the exchange clock and ours from request/response samples.
+// Every sample bounds the offset to an interval (the server stamped its time somewhere between
+// our send and receive, truncated to its resolution); the estimate is the intersection of the
+// most recent consistent intervals, each widened for the drift accumulated since it was taken.
+// Coarse samples (a Date header's whole seconds) only narrow an interval that a precise sample
+// is part of; without one the offset stays 0 and the local clock is used as is.
+class ClockSync
+{
+public:
+    struct Stats
+    {
+        int64_t offset_ns;
+
+        // How far off offset_ns can be, as far as the samples tell
+        uint64_t uncertainty_ns;
+        uint64_t last_rtt_ns;
+        uint64_t sample_count;
+    };
+
+    ClockSync();
+
+    // send/receive are local wall clock times around the request, server_ns is the time the
+    // server reported and resolution_ns how coarsely it was reported (1s for a Date header)
+    void AddSample(const uint64_t send_wall_ns
+            , const uint64_t receive_wall_ns
+            , const uint64_t server_ns
+            , const uint64_t resolution_ns);
+
+    // Offset to add to the local wall clock to get server time
+    int64_t GetOffsetNs() const;
+
+    // Server-aligned wall clock time, for request and login signing
+    int64_t NowMs() const;
+    uint64_t NowNs() const;
+
+    Stats GetStats() const;
+
+    // "Sun, 06 Nov 1994 08:49:37 GMT"
+    static bool ParseHttpDate(const std::string& date, uint64_t& time_ns);
+    // "2022-05-13T10:12:15.123456+00:00", UTC offsets only
+    static bool ParseIso8601(const std::string& time, uint64_t& time_ns);
+
+private:
+    static constexpr const int MAX_SAMPLES = 16;
+    static constexpr const int64_t DRIFT_PPM = 50;
+
+    // Samples reported more coarsely than this cannot set the offset on their own
+    static constexpr const uint64_t MAX_PRECISE_RESOLUTION_NS = 1'000'000;
+
+    struct Sample
+    {
+        int64_t lower_ns;
+        int64_t upper_ns;
+        uint64_t taken_ns;
+        bool precise;
+    };
+
+    void UpdateEstimate(const uint64_t now_ns);
+
+    mutable std::mutex _samples_mtx;
+    std::array<Sample, MAX_SAMPLES> _samples;
+    uint64_t _sample_count;
+
+    std::atomic<int64_t> _offset_ns;
+    std::atomic<uint64_t> _uncertainty_ns;
+    std::atomic<uint64_t> _last_rtt_ns;
+};
+
+} // namespace ftx
\ No newline at end of file
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cpr/cpr.h>
+#include <curl/curl.h>
+
+#include "SocketOptions.h"
+
+namespace ftx
+{
+
+// Keeps a set of REST sessions connected to one endpoint. All sessions share a curl share
+// handle, so DNS results and TLS sessions are reused between them. WarmUp() resolves the host
+// up front and opens every connection; after that a background thread sends a cheap request on
+// any connection that has been idle for too long so it stays hot, and resolves the host again
+// periodically and soon after a request failed, so the sessions follow the exchange when its
+// addresses change.
+class ConnectionPool
+{
+private:
+    struct Connection;
+
+public:
+    struct Config
+    {
+        int connection_count = 2;
+
+        // Idle connections get a keep-alive request after this long; 0 disables keep-alive
+        int keep_alive_period_s = 10;
+
+        // Unsigned, cheap path used for warm-up and keep-alive requests
+        std::string ping_path = "/time";
+
+        // The host is resolved again this often, and within a second of a failed request;
+        // 0 only re-resolves after failures
+        int resolve_period_s = 60;
+
+        // Applied to every socket curl opens for the pool
+        SocketOptions socket_options;
+    };
+
+    struct Stats
+    {
+        // Latency of the first request on a fresh connection, DNS, connect and handshake included
+        uint64_t cold_request_ns;
+        // Latency of the first order entry request (anything but a GET) after warm-up, and
+        // whether it still had to connect
+        uint64_t first_request_ns;
+        bool first_request_connected;
+
+        uint64_t warm_up_ns;
+        uint64_t new_connections;
+        uint64_t reused_connections;
+        uint64_t keep_alives;
+        uint64_t overflows;
+
+        // Times the host resolved to a different set of addresses than the pinned one
+        uint64_t re_resolves;
+    };
+
+    // Exclusive use of one session until destruction. When every pooled session is busy the
+    // lease gets an overflow session which still shares DNS and TLS state with the pool.
+    class Lease
+    {
+    public:
+        Lease(Lease&& other) noexcept;
+        ~Lease();
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        Lease& operator=(Lease&&) = delete;
+
+        cpr::Session& GetSession();
+
+    private:
+        friend class ConnectionPool;
+
+        Lease(ConnectionPool* pool, Connection* connection);
+
+        ConnectionPool* _pool;
+        Connection* _connection;
+    };
+
+    explicit ConnectionPool(const std::string& endpoint);
+    ConnectionPool(const std::string& endpoint, const Config& config);
+    virtual ~ConnectionPool();
+
+    // Resolves the endpoint host, connects every pooled session and starts keep-alive.
+    // Returns false if the host could not be resolved or no connection succeeded.
+    bool WarmUp();
+
+    Lease Acquire();
+
+    // Unsigned GET of `path` on a pooled session
+    cpr::Response Get(const std::string& path);
+
+    // Accounts a completed request made through `lease`
+    void RecordRequest(Lease& lease, const uint64_t duration_ns, const bool order_entry);
+
+    // A request got no response; the host is resolved again shortly
+    void RecordFailure();
+
+    Stats GetStats() const;
+
+private:
+    struct Connection
+    {
+        cpr::Session session;
+        uint64_t last_used_ns = 0;
+        bool in_use = false;
+        bool pooled = true;
+
+        // Of the resolve list last given to the session, 0 for none
+        uint64_t resolve_generation = 0;
+    };
+
+    static void LockShare(CURL* handle, curl_lock_data data, curl_lock_access access, void* user);
+    static void UnlockShare(CURL* handle, curl_lock_data data, void* user);
+    static int OnSocketCreated(void* user, curl_socket_t fd, curlsocktype purpose);
+
+    // Counts whether the session's last transfer had to open a connection, returns true if it did
+    bool CountConnection(cpr::Session& session);
+
+    std::unique_ptr<Connection> CreateConnection() const;
+    void Release(Connection* connection);
+
+    // Resolves the host and pins its addresses in the shared DNS cache, replacing the pinned
+    // ones if they changed
+    bool Resolve();
+    cpr::Response Ping(cpr::Session& session) const;
+    void KeepAliveIdle();
+
+    // Resolves again if a request failed since the last time or the period has passed
+    void ResolveIfDue();
+
+    void RunKeepAlive();
+    void StopKeepAlive();
+
+    const std::string _endpoint;
+    const Config _config;
+
+    std::array<std::mutex, CURL_LOCK_DATA_LAST> _share_mtx;
+    CURLSH* _share;
+
+    mutable std::mutex _connections_mtx;
+    std::vector<std::unique_ptr<Connection>> _connections;
+
+    // CURLOPT_RESOLVE entry pinning the host to its pre-resolved addresses, guarded by
+    // _connections_mtx. Replaced lists are kept until destruction, as a session given one may
+    // not have started its transfer yet; they are only replaced when the addresses change.
+    curl_slist* _resolve;
+    std::vector<curl_slist*> _replaced_resolves;
+    std::string _resolve_entry;
+    uint64_t _resolve_generation;
+
+    std::atomic<bool> _resolve_requested;
+    uint64_t _last_resolve_ns;
+
+    std::atomic<uint64_t> _cold_request_ns;
+    std::atomic<uint64_t> _first_request_ns;
+    std::atomic<bool> _first_request_connected;
+    std::atomic<bool> _first_request_done;
+    std::atomic<uint64_t> _warm_up_ns;
+    std::atomic<uint64_t> _new_connections;
+    std::atomic<uint64_t> _reused_connections;
+    std::atomic<uint64_t> _keep_alives;
+    std::atomic<uint64_t> _overflows;
+    std::atomic<uint64_t> _re_resolves;
+
+    std::mutex _keep_alive_mtx;
+    std::condition_variable _keep_alive_cv;
+    bool _keeping_alive;
+    std::unique_ptr<std::thread> _keep_alive_thread;
+};
+
+} // namespace ftx
\ No newline at end of file
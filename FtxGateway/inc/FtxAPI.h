@@ -1,10 +1,22 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <cpr/cpr.h>
 #include <rapidjson/document.h>
 
+#include "ClockSync.h"
+#include "ConnectionPool.h"
+#include "Http2Client.h"
+#include "HttpClient.h"
+#include "RequestEncoder.h"
+#include "RequestHedger.h"
+#include "RestLatencyStats.h"
+
 namespace ftx
 {
 
@@ -13,41 +25,121 @@ class FtxAPI
 public:
     using Response_t = rapidjson::Document;
 
+    using Method = HttpMethod;
+
+    static constexpr const char* DEFAULT_ENDPOINT = "http://ftx.us/api";
+
+    enum class Transport
+        : int
+    {
+        // libcurl through the connection pool
+        CURL,
+        // Built-in HTTP/1.1 client, one request per connection at a time
+        HTTP1,
+        // One HTTP/2 connection multiplexing every request
+        HTTP2
+    };
+
+    struct Config
+    {
+        ConnectionPool::Config connection_pool;
+        RequestHedger::Config hedge;
+
+        // What requests are sent through. Clock sync and connection keep-alive stay on
+        // libcurl either way; HTTP/2 needs an https endpoint and a build with FTX_HTTP2.
+        Transport transport = Transport::CURL;
+        HttpClient::Config http;
+        Http2Client::Config http2;
+    };
+
     explicit FtxAPI(const std::string& key
             , const std::string& secret
-            , const std::string& endpoint = "http://ftx.us/api");
+            , const std::string& endpoint = DEFAULT_ENDPOINT);
+    FtxAPI(const std::string& key
+            , const std::string& secret
+            , const std::string& endpoint
+            , const Config& config);
+
+    // `tls_context` is used by the HTTP/1.1 and HTTP/2 transports, so they resume sessions
+    // along with whatever else shares it (the gateway's websocket)
+    FtxAPI(const std::string& key
+            , const std::string& secret
+            , const std::string& endpoint
+            , const Config& config
+            , const std::shared_ptr<TlsContext>& tls_context);
     
     virtual ~FtxAPI() = default;
 
+    FtxAPI(const FtxAPI&) = delete;
+    FtxAPI& operator=(const FtxAPI&) = delete;
+
     Response_t GetRequest(const std::string& path) const;
     Response_t PostRequest(const std::string& path, const std::string& body) const;
     Response_t DeleteRequest(const std::string& path) const;
 
+    // Sends a request rendered by a RequestEncoder signed with this API's key. With `hedge`
+    // and hedging enabled, a slow request is duplicated over a second connection; only pass
+    // it for requests the exchange deduplicates.
+    Response_t Send(const EncodedRequest& request, const bool hedge = false) const;
+
+    // Sends a burst of requests, e.g. every cancel one market update calls for, writing all of
+    // them before waiting for any response; see HttpClient and Http2Client for how they are
+    // flushed. `responses[i]` answers `requests[i]`. Batches are not hedged. The curl
+    // transport sends the requests one after the other.
+    std::vector<Response_t> SendBatch(const std::vector<const EncodedRequest*>& requests) const;
+
+    // Pre-resolves the endpoint and opens the pooled connections so the first real request
+    // does not pay for DNS, connect and TLS handshake. Returns false if nothing connected.
+    bool WarmUp() const;
+
+    // Samples the exchange clock through the time endpoint to refine the clock offset.
+    // Every other response also contributes a (coarser) sample through its Date header.
+    void SyncClock(const int samples = 4) const;
+
+    const std::string& GetEndpoint() const;
+    std::shared_ptr<ClockSync> GetClockSync() const;
+
+    // Per endpoint, per stage request latency
+    std::shared_ptr<RestLatencyStats> GetLatencyStats() const;
+
+    ConnectionPool::Stats GetConnectionStats() const;
+    RequestHedger::Stats GetHedgeStats() const;
+
+    // All zero unless that client is the transport
+    HttpClient::Stats GetHttpClientStats() const;
+    Http2Client::Stats GetHttp2ClientStats() const;
+
 private:
 
-    enum class Method
-        : int
-    {
-        GET,
-        POST,
-        DELETE
-    };
+    static cpr::Response Perform(cpr::Session& session, const Method method);
 
-    static std::string MethodToString(const Method method);
+    static ConnectionPool::Config PoolConfig(const Config& config);
+    static HttpClient::Config HttpConfig(const Config& config);
 
-    cpr::Header CreateHeader(const std::string& request_path
-            , const int64_t time_ms
-            , const Method method
-            , const std::string& body = "") const;
+    Response_t Send(const Method method, const std::string& path, const std::string& body = "") const;
+    Response_t SendOnce(const EncodedRequest& request) const;
+    Response_t SendNative(const EncodedRequest& request) const;
+    Response_t SendHttp2(const EncodedRequest& request) const;
 
-    std::string Sign(const int64_t timestamp
-        , const Method http_method
-        , const std::string& request_path
-        , const std::string& request_body = "") const;
+    cpr::Header CreateHeader(const EncodedRequest& request) const;
+
+    // The latency stats of the request's endpoint, looked up once per request kind
+    RestLatencyStats::Stages_t& GetStages(const EncodedRequest& request) const;
+
+    void AddDateSample(const cpr::Response& response, const uint64_t send_wall_ns, const uint64_t receive_wall_ns) const;
+    void AddDateSample(const std::string& date, const uint64_t send_wall_ns, const uint64_t receive_wall_ns) const;
 
     const std::string _key;
-    const std::string _secret;
     const std::string _endpoint;
+
+    const std::shared_ptr<ClockSync> _clock_sync;
+    const std::shared_ptr<RestLatencyStats> _latency_stats;
+    mutable std::array<std::atomic<RestLatencyStats::Stages_t*>, static_cast<int>(RequestKind::NUM_KINDS)> _kind_stages;
+    const std::shared_ptr<ConnectionPool> _connection_pool;
+    const std::shared_ptr<HttpClient> _http_client;
+    const std::shared_ptr<Http2Client> _http2_client;
+    const std::shared_ptr<RequestHedger> _hedger;
+    const RequestEncoder _encoder;
 };
 
 } // namespace ftx
\ No newline at end of file
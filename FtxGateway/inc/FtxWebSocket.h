@@ -1,18 +1,22 @@
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <functional>
 #include <memory>
 #include <string>
 #include <thread>
 
+#include <boost/asio/steady_timer.hpp>
 #include <rapidjson/document.h>
-#include <websocketpp/client.hpp>
-#include <websocketpp/common/memory.hpp>
-#include <websocketpp/common/thread.hpp>
-#include <websocketpp/config/asio_client.hpp>
 
+#include "ClockSync.h"
 #include "FtxWebSocketMessages.h"
+#include "LatencyHistogram.h"
+#include "SocketOptions.h"
+#include "ThreadConfig.h"
+#include "TlsContext.h"
+#include "WebSocketTransport.h"
 
 namespace ftx
 {
@@ -21,58 +25,123 @@ namespace ws
 
 class FtxWebSocket
 {
-private:
-    using Client = websocketpp::client<websocketpp::config::asio_tls_client>;
-    using MessagePtr = websocketpp::config::asio_client::message_type::ptr;
-    using ContextPtr = std::shared_ptr<boost::asio::ssl::context>;
-
 public:
     using BboCallback_t = std::function<void(const Bbo& bbo)>;
     using OrderCallback_t = std::function<void(const Order& order)>;
     using FillCallback_t = std::function<void(const Fill& fill)>;
 
+    enum class Channel
+        : int
+    {
+        TICKER = 0,
+        ORDERS = 1,
+        FILLS = 2,
+        NUM_CHANNELS = 3
+    };
+
+    struct ChannelStats
+    {
+        LatencyHistogram::Snapshot exchange_to_receive;
+        LatencyHistogram::Snapshot receive_to_callback;
+    };
+
+    using FeedStats_t = std::array<ChannelStats, static_cast<int>(Channel::NUM_CHANNELS)>;
+
     explicit FtxWebSocket(const std::string& market
             , const std::string& key
             , const std::string& secret
+            , const std::shared_ptr<const ClockSync>& clock_sync
+            , const std::shared_ptr<TlsContext>& tls_context
+            , const ThreadConfig& thread_config = ThreadConfig()
+            , const SocketOptions& socket_options = SocketOptions()
             , const std::string& endpoint = "wss://ftx.us/ws/");
     virtual ~FtxWebSocket();
 
+    // Closes the connection and joins the receive thread; no callback is called after it
+    // returns. Safe to call more than once.
+    void Stop();
+
     void SetBboCallback(const BboCallback_t& callback);
     void SetOrderCallback(const OrderCallback_t& callback);
     void SetFillCallback(const FillCallback_t& callback);
 
+    // Round trip time of websocket ping/pong over the last minute
+    LatencyHistogram::Snapshot GetConnectionLatency() const;
+    uint64_t GetLastRttNs() const;
+
+    // Per channel feed latency, indexed by Channel
+    FeedStats_t GetFeedStats() const;
+
+    // From the kernel receiving a message to us reading it. Only measured by transports that
+    // read the socket themselves (FTX_NATIVE_WEBSOCKET) with SocketOptions::kernel_timestamps set.
+    LatencyHistogram::Snapshot GetKernelReceiveDelay() const;
+
 private:
 
-    static ContextPtr OnTlsInit();
-    void OnOpen(Client* c, websocketpp::connection_hdl hdl);
-    void OnFail(Client* c, websocketpp::connection_hdl hdl);
-    void OnMessage(Client* c, websocketpp::connection_hdl hdl, MessagePtr msg);
-    void OnClose(Client* c, websocketpp::connection_hdl hdl);
+    struct ReceiveTime
+    {
+        uint64_t monotonic_ns;
+        uint64_t wall_ns;
+    };
 
-    void Heartbeat();
+    struct ChannelHistograms
+    {
+        LatencyHistogram exchange_to_receive;
+        LatencyHistogram receive_to_callback;
+    };
+
+    void OnOpen();
+    void OnFail();
+    void OnMessage(const char* data, const size_t size, const uint64_t kernel_wall_ns);
+    void OnClose();
+    void OnPong(const std::string& payload);
+
+    void ScheduleReconnect();
+    void OnReconnectTimer(const boost::system::error_code& ec);
+
+    void RunReceiver();
+
+    void ScheduleHeartbeat();
+    void OnHeartbeatTimer(const boost::system::error_code& ec);
     void Login();
     void Subscribe();
     void Unsubscribe();
 
-    void CreateAndSendBboUpdate(const rapidjson::Document& json);
-    void CreateAndSendOrderUpdate(const rapidjson::Document& json);
-    void CreateAndSendFillUpdate(const rapidjson::Document& json);
+    void CreateAndSendBboUpdate(const rapidjson::Document& json, const ReceiveTime& receive_time);
+    void CreateAndSendOrderUpdate(const rapidjson::Document& json, const ReceiveTime& receive_time);
+    void CreateAndSendFillUpdate(const rapidjson::Document& json, const ReceiveTime& receive_time);
+
+    void RecordExchangeLatency(const Channel channel, const ReceiveTime& receive_time, const uint64_t exchange_time_ns);
+    void RecordCallbackLatency(const Channel channel, const ReceiveTime& receive_time);
 
     const std::string _market;
     const std::string _key;
     const std::string _secret;
+    const std::shared_ptr<const ClockSync> _clock_sync;
+    const ThreadConfig _thread_config;
 
-    Client _client;
-    Client::connection_ptr _connection_ptr;
+    std::unique_ptr<WebSocketTransport> _transport;
 
     BboCallback_t _bbo_callback;
     OrderCallback_t _order_callback;
     FillCallback_t _fill_callback;
     
     std::unique_ptr<std::thread> _receiver_thread;
-    std::unique_ptr<std::thread> _heartbeat_thread;
+    std::unique_ptr<boost::asio::steady_timer> _heartbeat_timer;
+    std::unique_ptr<boost::asio::steady_timer> _reconnect_timer;
 
     std::atomic<bool> _running;
+    std::atomic<bool> _stopping;
+
+    // Only touched on the io thread
+    bool _ever_opened;
+    int _reconnect_attempt;
+
+    RollingLatencyHistogram _rtt_histogram;
+    std::atomic<uint64_t> _last_rtt_ns;
+
+    std::array<ChannelHistograms, static_cast<int>(Channel::NUM_CHANNELS)> _channel_histograms;
+    LatencyHistogram _kernel_receive_delay;
 };
 
 } // namespace ws
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <stdexcept>
 #include <string>
 
@@ -56,6 +57,10 @@ struct Bbo
 
     BidAsk price;
     BidAsk size;
+
+    // Local monotonic receive time and exchange wall clock time (0 if unknown)
+    uint64_t receive_time_ns;
+    uint64_t exchange_time_ns;
 };
 
 struct Fill
@@ -68,6 +73,9 @@ struct Fill
     double price;
     double size;
     Side side;
+
+    uint64_t receive_time_ns;
+    uint64_t exchange_time_ns;
 };
 
 struct Order
@@ -112,6 +120,9 @@ struct Order
     double remaining_size;
 
     Status status;
+
+    uint64_t receive_time_ns;
+    uint64_t exchange_time_ns;
 };
 
 } // namespace ws
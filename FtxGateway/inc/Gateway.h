@@ -1,9 +1,20 @@
 #pragma once
 
+#include "Clock.h"
 #include "FtxAPI.h"
-#include "FtxWebSocket.h"
+#include "LatencyHistogram.h"
+#include "PooledMessageManager.h"
+#include "RedundantFeed.h"
+#include "RequestEncoder.h"
+#include "RequestScheduler.h"
+#include "ThreadConfig.h"
+#include "TimerWheel.h"
+#include "TlsContext.h"
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <mutex>
@@ -14,11 +25,230 @@ namespace ftx
 class Gateway
 {
 public:
+    // A quote price change is only acted on once it has lasted for a window, so a ticker that
+    // flickers away and straight back does not cost a cancel and requote. The window adapts to
+    // how long such flickers last, within the bounds below.
+    struct DebounceConfig
+    {
+        // Bounds of the window; a max of 0 acts on every change at once. Otherwise the min
+        // must not be above the max.
+        uint64_t min_window_ns = 50'000;
+        uint64_t max_window_ns = 2'000'000;
+
+        // The window is this multiple of the typical duration of a flicker that reverted; must
+        // be positive
+        double flicker_multiple = 2.0;
+
+        // A move of at least this many ticks on either side is acted on at once
+        int immediate_ticks = 2;
+
+        ThreadConfig thread{"ftx-debounce"};
+    };
+
+    struct DebounceStats
+    {
+        uint64_t updates;
+
+        // Quote changes held back, those that reverted within the window (each a cancel and
+        // requote spared), and how the rest were acted on
+        uint64_t deferred;
+        uint64_t suppressed;
+        uint64_t immediate;
+        uint64_t expired;
+
+        uint64_t window_ns;
+
+        // From a held back change until it was acted on
+        LatencyHistogram::Snapshot delay;
+    };
+
+    // Paces requotes by how long the exchange currently takes to work a cancel and replace,
+    // measured from the order updates acknowledging them
+    struct PacingConfig
+    {
+        // Weight of each new ack in the running averages
+        double weight = 0.1;
+
+        // Minimum time between requotes as a multiple of the cancel/replace round trip (cancel
+        // ack plus new order ack), so a slow exchange is not sent cancels faster than it works
+        // them off while a fast one gets them straight away
+        double interval_multiple = 0.5;
+        uint64_t min_interval_ns = 0;
+        uint64_t max_interval_ns = 100'000'000;
+
+        // The debounce window is at least this multiple of the cancel ack latency: a change
+        // that reverts sooner would be back before the cancel even lands
+        double window_multiple = 0.25;
+    };
+
+    struct PacingStats
+    {
+        // From submitting a cancel or new order until the order update acknowledging it
+        LatencyHistogram::Snapshot cancel_ack;
+        LatencyHistogram::Snapshot new_order_ack;
+
+        // The controller's running average and what it currently derives from it
+        uint64_t round_trip_ns;
+        uint64_t requote_interval_ns;
+        uint64_t window_floor_ns;
+
+        uint64_t requotes;
+
+        // Requotes held back by the interval rather than the debounce window
+        uint64_t paced;
+    };
+
+    // Bounds how long a parent order chases the market with post only orders. Once either
+    // budget runs out, the working order is cancelled and the remaining size is sent as a
+    // marketable IOC order, repeated until it is filled.
+    struct ExecutionConfig
+    {
+        // From the parent order's submission; 0 means no limit
+        uint64_t time_budget_ns = 30'000'000'000;
+
+        // Post only orders sent for one parent order; 0 means no limit
+        uint64_t max_requotes = 20;
+
+        // How far through the touch the IOC order is priced
+        int ioc_ticks = 2;
+    };
+
+    struct ExecutionStats
+    {
+        // Parent orders that ran out of each budget
+        uint64_t time_budget_expired;
+        uint64_t requote_budget_expired;
+
+        uint64_t ioc_orders;
+
+        TimerWheel::Stats timers;
+    };
+
+    // Bounds how long an order waits on the exchange. Once a timeout runs out, the order's
+    // status is looked up over REST and applied as if it came over the websocket; an order
+    // the exchange never got is re-sent.
+    struct TimeoutConfig
+    {
+        // From sending a new order until its 'new' update; 0 means no timeout
+        uint64_t ack_timeout_ns = 2'000'000'000;
+
+        // From sending a cancel until the order closes; 0 means no timeout
+        uint64_t cancel_timeout_ns = 2'000'000'000;
+    };
+
+    struct TimeoutStats
+    {
+        uint64_t ack_timeouts;
+        uint64_t cancel_timeouts;
+
+        // Updates applied from a status lookup, and new orders the exchange did not know
+        uint64_t reconciled;
+        uint64_t lost;
+    };
+
+    // A resting order at the touch is kept through a requote, rather than cancelled and
+    // re-joined a tick better, while little is estimated to be queued ahead of it. The
+    // estimate starts from the touch size when the order opens and shrinks as the touch size
+    // drops, in proportion to the share of the rest of the level that is ahead of the order;
+    // size joining the level queues behind it.
+    struct QueueConfig
+    {
+        // Kept while the size ahead is at most this multiple of the order's own size; a
+        // negative ratio requotes every order
+        double max_ahead_ratio = 1.0;
+    };
+
+    struct QueuePosition
+    {
+        uint64_t client_id;
+        ws::Side side;
+        double price;
+        double size;
+
+        // Size estimated ahead of the order (infinite while a better price is at the touch)
+        // and the last size seen at its price
+        double ahead;
+        double level_size;
+    };
+
+    struct QueueStats
+    {
+        // Resting orders at the touch kept through a requote, and those cancelled because too
+        // much was ahead of them
+        uint64_t kept;
+        uint64_t rejoined;
+
+        // Resting orders only
+        std::vector<QueuePosition> orders;
+    };
+
+    struct Config
+    {
+        // One websocket connection per entry, see RedundantFeed. Each is logged in separately;
+        // add entries for redundant connections.
+        std::vector<ThreadConfig> feed_threads = {ThreadConfig{"ftx-feed-0"}};
+        SocketOptions feed_socket_options;
+
+        // REST socket options are in api.connection_pool.socket_options
+        FtxAPI::Config api;
+
+        // REST workers are configured through scheduler.worker_threads
+        RequestScheduler::Config scheduler;
+
+        // From this many working orders on one side, a market update cancels them with one
+        // market and side scoped request instead of one per order; 0 always cancels per order.
+        // The gateway must be the only source of orders in the market for the account.
+        size_t bulk_cancel_threshold = 3;
+
+        DebounceConfig debounce;
+        PacingConfig pacing;
+
+        ExecutionConfig execution;
+        TimeoutConfig timeouts;
+        QueueConfig queue;
+
+        // Drives the execution deadlines and order timeouts
+        TimerWheel::Config timers;
+    };
+
     explicit Gateway(const std::string& key, const std::string& secret, const std::string& market);
+    Gateway(const std::string& key, const std::string& secret, const std::string& market, const Config& config);
     virtual ~Gateway();
 
     void SendMarketOrder(const ws::Side side, const double size);
 
+    RequestScheduler::Stats GetSchedulerStats() const;
+    std::shared_ptr<RestLatencyStats> GetRestLatencyStats() const;
+
+    // Cold (first connection) vs warm (first order) REST latency on the curl transport, plus
+    // keep-alive and re-resolve activity
+    ConnectionPool::Stats GetConnectionStats() const;
+
+    // Websocket handshake times, split by whether the TLS session was resumed
+    TlsContext::Stats GetTlsStats() const;
+
+    RequestHedger::Stats GetHedgeStats() const;
+
+    // Built-in REST transports, including how many requests each batched write carried;
+    // all zero unless that transport is selected
+    HttpClient::Stats GetHttpClientStats() const;
+    Http2Client::Stats GetHttp2ClientStats() const;
+
+    // Per websocket connection first-arrival wins and lag behind the winning copy
+    std::vector<ws::RedundantFeed::ConnectionStats> GetFeedArbitrationStats() const;
+
+    // Websocket frame buffers reused versus allocated, across all feed connections
+    ws::MessagePool::Stats GetMessagePoolStats() const;
+
+    // TSC clock re-anchoring and the cost of reading each clock
+    clock::Stats GetClockStats() const;
+
+    DebounceStats GetDebounceStats() const;
+    PacingStats GetPacingStats() const;
+    ExecutionStats GetExecutionStats() const;
+    TimeoutStats GetTimeoutStats() const;
+    QueueStats GetQueueStats() const;
+
 private:
 
     struct OutstandingOrder
@@ -44,39 +274,189 @@ private:
         double filled_size;
 
         uint64_t queued_count;
+
+        // When the order was last submitted and cancelled, for ack latency
+        uint64_t sent_ns;
+        uint64_t cancel_ns;
+
+        // Set once a budget ran out, from then on every order sent is an IOC order; `ioc` is
+        // whether the working one is
+        bool aggressive;
+        bool ioc;
+        TimerWheel::TimerId_t deadline_timer;
+
+        // Ack or cancel timeout of the working order, 0 if none is armed
+        TimerWheel::TimerId_t timeout_timer;
+
+        // The working order as the exchange opened it, and its queue position estimate
+        double price;
+        double size;
+        double queue_ahead;
+        double level_size;
     };
 
     void SendMarketOrder(const ws::Side side, const double size, const uint64_t client_id, const bool new_order = true);
+    void SendIocOrder(const ws::Side side, const double size, const uint64_t client_id);
+
+    void OnExecutionDeadline(const std::shared_ptr<OutstandingOrder>& outstanding_order);
+
+    // Called with _orders_mtx held. Cancels the working order of an aggressive parent order
+    // once it rests, so the rest can go out as an IOC order when the cancel is confirmed.
+    void Expedite(const std::shared_ptr<OutstandingOrder>& outstanding_order);
+
+    // Called with _orders_mtx held. (Re)starts the timeout for the order's state from
+    // `start_ns`, if that state has one.
+    void ArmTimeout(const std::shared_ptr<OutstandingOrder>& outstanding_order, const uint64_t start_ns);
+    void DisarmTimeout(OutstandingOrder& outstanding_order);
+
+    void OnOrderTimeout(const std::shared_ptr<OutstandingOrder>& outstanding_order, const uint64_t client_id);
+    void Reconcile(const std::shared_ptr<OutstandingOrder>& outstanding_order
+            , const uint64_t client_id
+            , const FtxAPI::Response_t& response);
 
     void SetInitialMarketData();
     void SetWebsocketCallbacks();
 
+    ws::Bbo GetBbo();
+    double GetQuotePrice(const ws::Side side, const ws::Bbo& bbo) const;
+
     void OnBboUpdate(const ws::Bbo& bbo);
     void OnOrderUpdate(const ws::Order& order);
 
-    void HandleNewOrder(const std::shared_ptr<OutstandingOrder>& outstanding_order, const ws::Order& order);
+    // Called with _order_updates_mtx held. `looked_up` marks updates built from an order
+    // lookup rather than received, whose acks are not timed.
+    void ApplyOrderUpdate(const ws::Order& order, const bool looked_up);
+
+    // Called with _orders_mtx held. Whether an update for an order whose status was looked up
+    // was already applied from the lookup.
+    bool IsReplayed(const uint64_t client_id, const OutstandingOrder* outstanding_order, const ws::Order::Status status) const;
+
+    // Called with _bbo_mtx held. Returns true if orders should be requoted right away.
+    bool Debounce(const ws::Bbo& bbo);
+    void AdaptDebounceWindow(const uint64_t flicker_ns);
+    void RunDebounce();
+
+    // When the held back change is due, and whether that is down to the requote interval
+    uint64_t RequoteDeadline(bool& paced) const;
+
+    // Called with _orders_mtx held
+    void RecordAck(LatencyHistogram& histogram, double& average_ns, const uint64_t latency_ns);
+
+    // Cancels every working order so it is re-sent at the current quote, except those worth
+    // keeping for their queue position
+    void Requote();
+
+    // Called with _orders_mtx held
+    void UpdateQueuePositions(const ws::Bbo& bbo);
+    void InitQueuePosition(OutstandingOrder& outstanding_order) const;
+    bool KeepsQueuePosition(const OutstandingOrder& outstanding_order, const ws::Bbo& bbo);
+
+    void HandleNewOrder(const std::shared_ptr<OutstandingOrder>& outstanding_order, const ws::Order& order, const bool looked_up);
     void HandleOpenOrder(const std::shared_ptr<OutstandingOrder>& outstanding_order, const ws::Order& order);
-    void HandleClosedOrder(const std::shared_ptr<OutstandingOrder>& outstanding_order, const ws::Order& order);
+    void HandleClosedOrder(const std::shared_ptr<OutstandingOrder>& outstanding_order, const ws::Order& order, const bool looked_up);
+
+    // Called with _orders_mtx held. Forgets a client id that is closed for good.
+    void Retire(const uint64_t client_id);
+
+    RequestScheduler::Request MakeCancel(const uint64_t client_id);
+
+    // Falls back to cancelling `client_ids` one by one if the exchange rejects it
+    RequestScheduler::Request MakeSideCancel(const ws::Side side, std::vector<uint64_t>&& client_ids);
 
     void Disable(const char* error);
     void CancelAll();
 
+    // Shared by the REST transports and the websocket, so it is constructed first
+    const std::shared_ptr<TlsContext> _tls_context;
     const FtxAPI _api;
-    ws::FtxWebSocket _web_socket;
+    RequestEncoder _encoder;
+    RequestScheduler _scheduler;
+    ws::RedundantFeed _feed;
     const std::string _market;
+    const size_t _bulk_cancel_threshold;
     
     std::atomic<uint64_t> _next_order_id;
     std::atomic<bool> _running;
 
     double _tick_price;
 
+    // Orders are quoted against _current_bbo, which only follows _latest_bbo once a change
+    // got through the debounce
     std::mutex _bbo_mtx;
     ws::Bbo _current_bbo;
+    ws::Bbo _latest_bbo;
+
+    const DebounceConfig _debounce_config;
+    std::condition_variable _debounce_cv;
+    bool _debounce_running;
+
+    // When the held back change was first seen, 0 if there is none, and whether it only waits
+    // for the requote interval
+    uint64_t _pending_since_ns;
+    bool _pending_immediate;
+    double _flicker_ns;
+    uint64_t _last_requote_ns;
+
+    std::atomic<uint64_t> _debounce_window_ns;
+    std::atomic<uint64_t> _bbo_updates;
+    std::atomic<uint64_t> _deferred_updates;
+    std::atomic<uint64_t> _suppressed_updates;
+    std::atomic<uint64_t> _immediate_updates;
+    std::atomic<uint64_t> _expired_updates;
+    LatencyHistogram _debounce_delay;
+
+    const PacingConfig _pacing_config;
+
+    // Running ack averages, under _orders_mtx
+    double _cancel_ack_ns;
+    double _order_ack_ns;
+
+    LatencyHistogram _cancel_ack;
+    LatencyHistogram _order_ack;
+    std::atomic<uint64_t> _round_trip_ns;
+    std::atomic<uint64_t> _requote_interval_ns;
+    std::atomic<uint64_t> _window_floor_ns;
+    std::atomic<uint64_t> _requotes;
+    std::atomic<uint64_t> _paced_requotes;
+
+    std::thread _debounce_thread;
 
     using OrderMap_t = std::unordered_map<uint64_t, std::shared_ptr<OutstandingOrder>>;
 
-    std::mutex _orders_mtx;
+    // Order updates from the websocket and from status lookups are applied one at a time
+    std::mutex _order_updates_mtx;
+
+    mutable std::mutex _orders_mtx;
     OrderMap_t _orders;
+
+    // Client ids whose status was looked up, under _orders_mtx; the websocket may still
+    // deliver the updates the lookup already applied. Retired ones are kept for the last
+    // MAX_RETIRED_RECONCILED, unless the websocket's own close comes first.
+    static constexpr const size_t MAX_RETIRED_RECONCILED = 1024;
+    std::unordered_set<uint64_t> _reconciled;
+    std::deque<uint64_t> _retired_reconciled;
+
+    const ExecutionConfig _execution_config;
+    std::atomic<uint64_t> _time_budget_expired;
+    std::atomic<uint64_t> _requote_budget_expired;
+    std::atomic<uint64_t> _ioc_orders;
+
+    const TimeoutConfig _timeout_config;
+    std::atomic<uint64_t> _ack_timeouts;
+    std::atomic<uint64_t> _cancel_timeouts;
+    std::atomic<uint64_t> _reconciled_updates;
+    std::atomic<uint64_t> _lost_orders;
+
+    const QueueConfig _queue_config;
+
+    // Every BBO update, not just those through the debounce, under _orders_mtx
+    ws::Bbo _queue_bbo;
+
+    std::atomic<uint64_t> _kept_orders;
+    std::atomic<uint64_t> _rejoined_orders;
+
+    // Last, so no deadline fires into a partly destroyed gateway
+    TimerWheel _timers;
 };
 
 } // namespace ftx
\ No newline at end of file
@@ -1,11 +1,10 @@
 #pragma once
 
-#include <iomanip>
-#include <sstream>
+#include <cstring>
+#include <stdexcept>
 #include <string>
-#include <vector>
 
-#include <openssl/hmac.h>
+#include <openssl/evp.h>
 #include <openssl/sha.h>
 
 namespace ftx
@@ -13,29 +12,140 @@ namespace ftx
 namespace crypto
 {
 
-static std::string HmacSha256(const std::string& data, const std::string& secret)
+// HMAC-SHA256 with the key schedule computed once up front: the digest states after the
+// inner and outer key pads are kept, and every signature starts from copies of them.
+class HmacSha256Signer
 {
-    const unsigned char* data_char = reinterpret_cast<const unsigned char*>(data.c_str());
-    const unsigned char* secret_char = reinterpret_cast<const unsigned char*>(secret.c_str());
+public:
+    static constexpr const size_t HEX_LENGTH = 2 * SHA256_DIGEST_LENGTH;
+
+    explicit HmacSha256Signer(const std::string& secret)
+        : _inner(EVP_MD_CTX_new())
+        , _outer(EVP_MD_CTX_new())
+    {
+        unsigned char key_block[SHA256_CBLOCK] = {};
+
+        if (secret.length() > SHA256_CBLOCK)
+        {
+            SHA256(reinterpret_cast<const unsigned char*>(secret.c_str()), secret.length(), key_block);
+        }
+        else
+        {
+            std::memcpy(key_block, secret.c_str(), secret.length());
+        }
 
-    std::vector<unsigned char> result(EVP_MAX_MD_SIZE);
-    unsigned int result_len = 0;
+        unsigned char inner_pad[SHA256_CBLOCK];
+        unsigned char outer_pad[SHA256_CBLOCK];
+        for (size_t i = 0; i < SHA256_CBLOCK; ++i)
+        {
+            inner_pad[i] = key_block[i] ^ 0x36;
+            outer_pad[i] = key_block[i] ^ 0x5c;
+        }
+
+        if (_inner == nullptr || _outer == nullptr
+                || EVP_DigestInit_ex(_inner, EVP_sha256(), nullptr) != 1
+                || EVP_DigestUpdate(_inner, inner_pad, SHA256_CBLOCK) != 1
+                || EVP_DigestInit_ex(_outer, EVP_sha256(), nullptr) != 1
+                || EVP_DigestUpdate(_outer, outer_pad, SHA256_CBLOCK) != 1)
+        {
+            EVP_MD_CTX_free(_inner);
+            EVP_MD_CTX_free(_outer);
+            throw std::runtime_error("Failed to set up HMAC-SHA256");
+        }
+    }
+
+    ~HmacSha256Signer()
+    {
+        EVP_MD_CTX_free(_inner);
+        EVP_MD_CTX_free(_outer);
+    }
 
-    HMAC_CTX* ctx = HMAC_CTX_new();
-    HMAC_Init_ex(ctx, secret_char, secret.length(), EVP_sha256(), NULL);
-    HMAC_Update(ctx, data_char, data.length());
-    HMAC_Final(ctx, result.data(), &result_len);
-    HMAC_CTX_free(ctx);
+    HmacSha256Signer(const HmacSha256Signer&) = delete;
+    HmacSha256Signer& operator=(const HmacSha256Signer&) = delete;
 
-    result.resize(result_len);
+    // The calling thread's working state, set to the start of a new signature. Valid until the
+    // next Begin() on this thread.
+    EVP_MD_CTX* Begin() const
+    {
+        EVP_MD_CTX* ctx = GetWorkingStates().message;
+        EVP_MD_CTX_copy_ex(ctx, _inner);
+        return ctx;
+    }
 
-    std::stringstream ss;
-    for (const unsigned char c : result)
+    static void Update(EVP_MD_CTX* ctx, const char* data, const size_t length)
     {
-        ss << std::setfill('0') << std::setw(2) << std::hex << static_cast<unsigned int>(c);
+        EVP_DigestUpdate(ctx, data, length);
     }
 
-    return ss.str();
+    // Writes HEX_LENGTH lowercase hex characters to `out`
+    void FinishHex(EVP_MD_CTX* ctx, char* out) const
+    {
+        static constexpr const char* HEX = "0123456789abcdef";
+
+        unsigned char inner_digest[SHA256_DIGEST_LENGTH];
+        EVP_DigestFinal_ex(ctx, inner_digest, nullptr);
+
+        EVP_MD_CTX* outer = GetWorkingStates().outer;
+        EVP_MD_CTX_copy_ex(outer, _outer);
+
+        unsigned char digest[SHA256_DIGEST_LENGTH];
+        EVP_DigestUpdate(outer, inner_digest, SHA256_DIGEST_LENGTH);
+        EVP_DigestFinal_ex(outer, digest, nullptr);
+
+        for (size_t i = 0; i < SHA256_DIGEST_LENGTH; ++i)
+        {
+            out[2 * i] = HEX[digest[i] >> 4];
+            out[2 * i + 1] = HEX[digest[i] & 0x0f];
+        }
+    }
+
+private:
+    // Allocated once per thread rather than per signature
+    struct WorkingStates
+    {
+        WorkingStates()
+            : message(EVP_MD_CTX_new())
+            , outer(EVP_MD_CTX_new())
+        {
+            if (message == nullptr || outer == nullptr)
+            {
+                EVP_MD_CTX_free(message);
+                EVP_MD_CTX_free(outer);
+                throw std::runtime_error("Failed to allocate digest contexts");
+            }
+        }
+
+        ~WorkingStates()
+        {
+            EVP_MD_CTX_free(message);
+            EVP_MD_CTX_free(outer);
+        }
+
+        EVP_MD_CTX* message;
+        EVP_MD_CTX* outer;
+    };
+
+    static WorkingStates& GetWorkingStates()
+    {
+        thread_local WorkingStates states;
+        return states;
+    }
+
+    EVP_MD_CTX* _inner;
+    EVP_MD_CTX* _outer;
+};
+
+static std::string HmacSha256(const std::string& data, const std::string& secret)
+{
+    const HmacSha256Signer signer(secret);
+
+    EVP_MD_CTX* ctx = signer.Begin();
+    HmacSha256Signer::Update(ctx, data.c_str(), data.length());
+
+    std::string hex(HmacSha256Signer::HEX_LENGTH, '\0');
+    signer.FinishHex(ctx, &hex[0]);
+
+    return hex;
 }
 
 }  // namespace crypto
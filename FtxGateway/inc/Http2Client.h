@@ -0,0 +1,230 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include "LatencyHistogram.h"
+#include "RequestEncoder.h"
+#include "SocketOptions.h"
+#include "ThreadConfig.h"
+#include "TlsContext.h"
+
+struct nghttp2_session;
+
+namespace ftx
+{
+
+// HTTP/2 client for the order path: every request is a stream on one TLS connection, so any
+// number of threads can have orders and cancels in flight at once without a connection each.
+// Headers that repeat on every request (key, content type, authority) are indexed by HPACK
+// after the first request; the timestamp and signature are sent unindexed so they never push
+// them out of the table. The connection is driven by its own io thread and reopened by the
+// first request after it was lost.
+//
+// Every request has a deadline, and the connection is pinged while it is open. A request past
+// its deadline, or a ping that is not answered before the next one is due, resets the
+// connection: everything in flight on it fails, since a server that stopped answering one
+// stream cannot be trusted with the others.
+//
+// Only functional when built with FTX_HTTP2 (nghttp2); otherwise construction throws.
+class Http2Client
+{
+public:
+    struct Config
+    {
+        ThreadConfig io_thread{"ftx-http2"};
+
+        // Applied to the connection's socket
+        SocketOptions socket_options;
+
+        // Receive window per stream and for the connection
+        uint32_t window_bytes = 1024 * 1024;
+
+        // From handing a request to the io thread until its response is complete, connecting
+        // included; 0 means no deadline
+        uint64_t stream_timeout_ns = 5'000'000'000;
+
+        // Between pings on an open connection; 0 sends none
+        uint64_t ping_interval_ns = 1'000'000'000;
+    };
+
+    struct Stats
+    {
+        uint64_t connections;
+        uint64_t streams;
+        uint64_t failed_streams;
+
+        // Connection resets for a request past its deadline and for an unanswered ping
+        uint64_t stream_timeouts;
+        uint64_t ping_timeouts;
+
+        // Most streams that were in flight at the same time
+        uint64_t peak_concurrent_streams;
+
+        // Writes carrying new requests: requests per flush is flushed_requests / flushes, and
+        // the latency is from collecting the frames until the write completed
+        uint64_t flushes;
+        uint64_t flushed_requests;
+        uint64_t largest_flush;
+        LatencyHistogram::Snapshot flush;
+    };
+
+    struct Response
+    {
+        int status = 0;
+        std::string date;
+        std::string body;
+
+        // From the request being handed to the io thread until its response headers arrived
+        uint64_t first_byte_ns = 0;
+    };
+
+    // Called once per request of a batch with its index; a request that got no response is
+    // reported with status 0
+    using BatchHandler_t = std::function<void(const size_t index, const Response& response)>;
+
+    Http2Client(const std::string& endpoint
+            , const std::string& key
+            , const std::shared_ptr<TlsContext>& tls_context);
+    Http2Client(const std::string& endpoint
+            , const std::string& key
+            , const std::shared_ptr<TlsContext>& tls_context
+            , const Config& config);
+    virtual ~Http2Client();
+
+    Http2Client(const Http2Client&) = delete;
+    Http2Client& operator=(const Http2Client&) = delete;
+
+    // Opens the connection and waits for it. Returns false if it could not be opened.
+    bool WarmUp();
+
+    // Sends `request` on its own stream and blocks until the response is complete. Safe to
+    // call from any number of threads at once. Returns false if no response was received.
+    bool Send(const EncodedRequest& request, Response& response);
+
+    // Opens a stream for every request and writes all their frames at once, then blocks until
+    // each was answered or failed
+    void SendBatch(const std::vector<const EncodedRequest*>& requests, const BatchHandler_t& on_response);
+
+    Stats GetStats() const;
+
+private:
+    using Stream_t = boost::asio::ssl::stream<boost::asio::ip::tcp::socket>;
+
+    // One request/response exchange, owned by the io thread from submission to close
+    struct Exchange
+    {
+        explicit Exchange(boost::asio::io_context& io)
+            : deadline(io)
+        {}
+
+        EncodedRequest request;
+        size_t body_sent = 0;
+
+        // Backing storage for the request's pseudo headers and path
+        std::string path;
+
+        Response* response = nullptr;
+        uint64_t submit_ns = 0;
+
+        // Only used on the io thread. Completed exactly once, by whichever of the stream's
+        // close, its deadline or the connection's close comes first.
+        boost::asio::steady_timer deadline;
+        bool completed = false;
+
+        std::promise<bool> done;
+    };
+
+    enum class State
+        : int
+    {
+        CLOSED,
+        CONNECTING,
+        OPEN
+    };
+
+    // nghttp2 callbacks, defined with the implementation
+    struct Callbacks;
+
+    void Connect();
+    void OnConnected(const std::shared_ptr<Stream_t>& stream, const boost::system::error_code& ec);
+    void OnHandshake(const std::shared_ptr<Stream_t>& stream, const boost::system::error_code& ec, const uint64_t start_ns);
+    void Open();
+
+    // Starts the exchange's deadline and submits it
+    void Start(const std::shared_ptr<Exchange>& exchange);
+    void Submit(const std::shared_ptr<Exchange>& exchange);
+    void Complete(const std::shared_ptr<Exchange>& exchange, const bool received);
+    void Expire(const std::shared_ptr<Exchange>& exchange);
+
+    // Sends a ping every interval while the connection is open, and closes it if the previous
+    // one was not acknowledged by then
+    void Ping();
+
+    void Read();
+    void Flush();
+    void Close();
+
+    void Run();
+
+    const std::shared_ptr<TlsContext> _tls_context;
+    const Config _config;
+    const std::string _key;
+
+    std::string _host;
+    std::string _port;
+    std::string _authority;
+    std::string _path_prefix;
+
+    boost::asio::io_context _io;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> _work;
+    boost::asio::ip::tcp::resolver _resolver;
+
+    // Everything below is only touched on the io thread
+    State _state;
+    std::shared_ptr<Stream_t> _stream;
+    nghttp2_session* _session;
+
+    std::vector<char> _read_buffer;
+    std::vector<uint8_t> _write_buffer;
+    bool _writing;
+
+    // Streams submitted since the last write
+    uint64_t _unflushed_streams;
+
+    // Requests waiting for the connection to open, and those on a stream
+    std::deque<std::shared_ptr<Exchange>> _waiting;
+    std::unordered_map<int32_t, std::shared_ptr<Exchange>> _exchanges;
+    std::vector<std::promise<bool>> _connect_waiters;
+
+    boost::asio::steady_timer _ping_timer;
+    bool _ping_outstanding;
+
+    std::atomic<uint64_t> _connections;
+    std::atomic<uint64_t> _streams;
+    std::atomic<uint64_t> _failed_streams;
+    std::atomic<uint64_t> _stream_timeouts;
+    std::atomic<uint64_t> _ping_timeouts;
+    std::atomic<uint64_t> _peak_concurrent_streams;
+
+    std::atomic<uint64_t> _flushes;
+    std::atomic<uint64_t> _flushed_requests;
+    std::atomic<uint64_t> _largest_flush;
+    LatencyHistogram _flush_latency;
+
+    std::thread _thread;
+};
+
+} // namespace ftx
\ No newline at end of file
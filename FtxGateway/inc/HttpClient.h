@@ -0,0 +1,258 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include "LatencyHistogram.h"
+#include "RequestEncoder.h"
+#include "SocketOptions.h"
+#include "TlsContext.h"
+
+#if FTX_IO_URING
+#include "IoUringSocket.h"
+#endif
+
+namespace ftx
+{
+
+// Minimal blocking HTTP/1.1 client for the order path. Keeps persistent connections to one
+// http or https endpoint and writes every request from a template rendered once, so only the
+// request line, timestamp, signature and body are filled in per request. Responses are parsed
+// in the receive buffer and the body is handed out from there without being copied.
+//
+// A burst of requests can be sent as a batch: it is spread over the idle pooled connections,
+// the requests sharing a connection are pipelined in one write, and every connection is
+// written before any response is read.
+//
+// Connecting, writing and reading each have a deadline. A connection that misses one is
+// closed, its requests still in flight fail with status 0 and are not sent again (the server
+// may have acted on them), and the next request on it connects anew.
+//
+// Built with FTX_IO_URING, connections read and write through io_uring instead of the epoll
+// reactor. Each connection still runs on the thread holding its lease, so each has a ring of
+// its own.
+class HttpClient
+{
+private:
+    struct Connection;
+
+public:
+    struct Config
+    {
+        int connection_count = 2;
+
+        // Applied to every connection the client opens
+        SocketOptions socket_options;
+
+        // Most requests of a batch pipelined on one connection per flush
+        int max_pipeline_depth = 4;
+
+        // TCP connect and TLS handshake together, writing a request (or a pipelined batch),
+        // and from starting to read a response until it is complete; 0 means no deadline
+        uint64_t connect_timeout_ns = 2'000'000'000;
+        uint64_t write_timeout_ns = 1'000'000'000;
+        uint64_t read_timeout_ns = 5'000'000'000;
+    };
+
+    struct Stats
+    {
+        uint64_t new_connections;
+        uint64_t reused_connections;
+
+        // Requests sent again on a new connection because the reused one had been closed
+        uint64_t retries;
+        uint64_t overflows;
+
+        // Connections closed because a connect, write or read missed its deadline
+        uint64_t timeouts;
+
+        // Batch writes: requests per flush is flushed_requests / flushes, and the latency is
+        // from rendering the first request until the last connection was written
+        uint64_t flushes;
+        uint64_t flushed_requests;
+        uint64_t largest_flush;
+        LatencyHistogram::Snapshot flush;
+    };
+
+    // Points into the connection's receive buffer; valid until the lease sends again or is released
+    struct Response
+    {
+        int status = 0;
+        std::string_view date;
+
+        const char* body = "";
+        size_t body_size = 0;
+
+        // Rendering the request, and from writing it until the first response byte arrived
+        uint64_t render_ns = 0;
+        uint64_t first_byte_ns = 0;
+    };
+
+    // Called once per request of a batch with its index. The response is only valid during the
+    // call; a request that got no response is reported with status 0.
+    using BatchHandler_t = std::function<void(const size_t index, const Response& response)>;
+
+    // Exclusive use of one connection until destruction. When every pooled connection is busy
+    // the lease gets an overflow connection that is closed on release.
+    class Lease
+    {
+    public:
+        Lease(Lease&& other) noexcept;
+        ~Lease();
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        Lease& operator=(Lease&&) = delete;
+
+        // Sends `request` and reads the complete response. Returns false if no response was read.
+        bool Send(const EncodedRequest& request, Response& response);
+
+    private:
+        friend class HttpClient;
+
+        Lease(HttpClient* client, Connection* connection);
+
+        HttpClient* _client;
+        Connection* _connection;
+    };
+
+    HttpClient(const std::string& endpoint
+            , const std::string& key
+            , const std::shared_ptr<TlsContext>& tls_context);
+    HttpClient(const std::string& endpoint
+            , const std::string& key
+            , const std::shared_ptr<TlsContext>& tls_context
+            , const Config& config);
+    virtual ~HttpClient() = default;
+
+    HttpClient(const HttpClient&) = delete;
+    HttpClient& operator=(const HttpClient&) = delete;
+
+    // Resolves the endpoint host and connects every pooled connection. Returns false if the
+    // host could not be resolved or no connection succeeded.
+    bool WarmUp();
+
+    Lease Acquire();
+
+    // Sends every request before waiting for any response and blocks until all were answered
+    // or failed, calling `on_response` as each response completes.
+    void SendBatch(const std::vector<const EncodedRequest*>& requests, const BatchHandler_t& on_response);
+
+    Stats GetStats() const;
+
+private:
+#if FTX_IO_URING
+    using Socket_t = IoUringSocket;
+#else
+    using Socket_t = boost::asio::ip::tcp::socket;
+#endif
+
+    // Plain http only uses the next layer
+    using Stream_t = boost::asio::ssl::stream<Socket_t>;
+
+    struct Connection
+    {
+        // Runs this connection's operations on the thread holding its lease, so they can be
+        // given up on at a deadline
+        boost::asio::io_context io;
+
+        std::unique_ptr<Stream_t> stream;
+        bool in_use = false;
+        bool pooled = true;
+
+        // A deadline was missed since the last connect
+        bool expired = false;
+
+        // Rendered requests waiting to be written, one or more pipelined
+        std::string request;
+
+        // Received bytes, of which the first `consumed` belong to the last response handed out
+        std::vector<char> response;
+        size_t buffered = 0;
+        size_t consumed = 0;
+    };
+
+    // The connections of one batch flush and the requests each carries
+    struct Share
+    {
+        Lease lease;
+        size_t first;
+        size_t count;
+        bool reused;
+        bool written;
+        uint64_t write_ns;
+    };
+
+    std::unique_ptr<Connection> CreateConnection() const;
+    void Release(Connection* connection);
+
+    // Up to `count` idle pooled connections, or one overflow connection if none is idle
+    std::vector<Lease> AcquireIdle(const size_t count);
+
+    bool Resolve(boost::asio::ip::tcp::resolver::results_type& endpoints);
+    bool Connect(Connection& connection);
+    void Close(Connection& connection);
+
+    // Appends `request` to the connection's pending requests
+    void Render(Connection& connection, const EncodedRequest& request) const;
+    bool Send(Connection& connection, const EncodedRequest& request, Response& response);
+
+    void Flush(std::vector<Share>& shares);
+    void Receive(Share& share, const BatchHandler_t& on_response);
+
+    // Reads until the next response is complete. `received` is set once any of its data
+    // arrived, after which the request must not be sent again.
+    bool ReadResponse(Connection& connection, Response& response, bool& received, const uint64_t write_ns);
+
+    bool Write(Connection& connection);
+    size_t ReadSome(Connection& connection, char* data, const size_t size, const uint64_t deadline_ns, boost::system::error_code& ec);
+
+    // Runs the connection's pending operation until `done` is set. Past `deadline_ns` (0 for
+    // none) the connection's socket is closed, the aborted operation is run to completion and
+    // false is returned.
+    bool Await(Connection& connection, const uint64_t deadline_ns, const bool& done);
+
+    const std::shared_ptr<TlsContext> _tls_context;
+    const Config _config;
+
+    bool _tls;
+    std::string _host;
+    std::string _port;
+
+    // "<METHOD> <endpoint path>" per HttpMethod, and every header that never changes
+    std::string _request_lines[3];
+    std::string _fixed_headers;
+
+    // Only used to resolve the endpoint, synchronously
+    boost::asio::io_context _io;
+
+    std::mutex _resolve_mtx;
+    bool _resolved;
+    boost::asio::ip::tcp::resolver::results_type _endpoints;
+
+    std::mutex _connections_mtx;
+    std::vector<std::unique_ptr<Connection>> _connections;
+
+    std::atomic<uint64_t> _new_connections;
+    std::atomic<uint64_t> _reused_connections;
+    std::atomic<uint64_t> _retries;
+    std::atomic<uint64_t> _overflows;
+    std::atomic<uint64_t> _timeouts;
+
+    std::atomic<uint64_t> _flushes;
+    std::atomic<uint64_t> _flushed_requests;
+    std::atomic<uint64_t> _largest_flush;
+    LatencyHistogram _flush_latency;
+};
+
+} // namespace ftx
\ No newline at end of file
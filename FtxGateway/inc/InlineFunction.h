@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace ftx
+{
+
+template <typename Signature, size_t Capacity>
+class InlineFunction;
+
+// A std::function that always keeps its target inside the object, so building, copying or
+// moving one never allocates. A target larger than `Capacity` bytes does not compile.
+template <typename R, typename... Args, size_t Capacity>
+class InlineFunction<R(Args...), Capacity>
+{
+public:
+    InlineFunction()
+        : _ops(nullptr)
+    {}
+
+    InlineFunction(std::nullptr_t)
+        : _ops(nullptr)
+    {}
+
+    template <typename F
+            , typename = std::enable_if_t<!std::is_same<std::decay_t<F>, InlineFunction>::value
+                    && !std::is_same<std::decay_t<F>, std::nullptr_t>::value>>
+    InlineFunction(F&& target)
+        : _ops(&Target<std::decay_t<F>>::OPS)
+    {
+        static_assert(sizeof(std::decay_t<F>) <= Capacity, "Target does not fit in the inline storage");
+        static_assert(alignof(std::decay_t<F>) <= alignof(std::max_align_t), "Target is over-aligned");
+
+        new (_storage) std::decay_t<F>(std::forward<F>(target));
+    }
+
+    InlineFunction(const InlineFunction& other)
+        : _ops(other._ops)
+    {
+        if (_ops != nullptr)
+        {
+            _ops->copy(_storage, other._storage);
+        }
+    }
+
+    InlineFunction(InlineFunction&& other) noexcept
+        : _ops(other._ops)
+    {
+        if (_ops != nullptr)
+        {
+            _ops->move(_storage, other._storage);
+            other.Reset();
+        }
+    }
+
+    ~InlineFunction()
+    {
+        Reset();
+    }
+
+    InlineFunction& operator=(const InlineFunction& other)
+    {
+        if (this != &other)
+        {
+            Reset();
+            if (other._ops != nullptr)
+            {
+                other._ops->copy(_storage, other._storage);
+                _ops = other._ops;
+            }
+        }
+
+        return *this;
+    }
+
+    InlineFunction& operator=(InlineFunction&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            if (other._ops != nullptr)
+            {
+                other._ops->move(_storage, other._storage);
+                _ops = other._ops;
+                other.Reset();
+            }
+        }
+
+        return *this;
+    }
+
+    InlineFunction& operator=(std::nullptr_t)
+    {
+        Reset();
+        return *this;
+    }
+
+    template <typename F
+            , typename = std::enable_if_t<!std::is_same<std::decay_t<F>, InlineFunction>::value
+                    && !std::is_same<std::decay_t<F>, std::nullptr_t>::value>>
+    InlineFunction& operator=(F&& target)
+    {
+        return *this = InlineFunction(std::forward<F>(target));
+    }
+
+    explicit operator bool() const
+    {
+        return _ops != nullptr;
+    }
+
+    // Like std::function, calling an empty one is a programming error
+    R operator()(Args... args) const
+    {
+        return _ops->invoke(_storage, std::forward<Args>(args)...);
+    }
+
+private:
+    struct Ops
+    {
+        R (*invoke)(void* target, Args&&... args);
+        void (*copy)(void* to, const void* from);
+        void (*move)(void* to, void* from);
+        void (*destroy)(void* target);
+    };
+
+    template <typename T>
+    struct Target
+    {
+        static R Invoke(void* target, Args&&... args)
+        {
+            return (*static_cast<T*>(target))(std::forward<Args>(args)...);
+        }
+
+        static void Copy(void* to, const void* from)
+        {
+            new (to) T(*static_cast<const T*>(from));
+        }
+
+        static void Move(void* to, void* from)
+        {
+            new (to) T(std::move(*static_cast<T*>(from)));
+        }
+
+        static void Destroy(void* target)
+        {
+            static_cast<T*>(target)->~T();
+        }
+
+        static constexpr Ops OPS = {&Invoke, &Copy, &Move, &Destroy};
+    };
+
+    void Reset()
+    {
+        if (_ops != nullptr)
+        {
+            _ops->destroy(_storage);
+            _ops = nullptr;
+        }
+    }
+
+    const Ops* _ops;
+    alignas(std::max_align_t) mutable unsigned char _storage[Capacity];
+};
+
+} // namespace ftx
\ No newline at end of file
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <linux/io_uring.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+
+namespace ftx
+{
+
+// io_uring behind an asio io_context, as a service of it so every socket on the context
+// shares one ring. Receives are multishot into a ring of registered buffers, so one
+// submission keeps delivering data without a syscall per read. Completions are signalled on
+// an eventfd the io context waits on; Poll() drains them without any syscall. The eventfd
+// is off while submitting, so operations that complete inline (most sends) are drained
+// through the io context's queue instead of a wake up.
+//
+// Only for io_context. Not thread safe: everything, including Poll(), runs on its thread.
+class IoUring
+    : public boost::asio::execution_context::service
+{
+public:
+    // Held by the ring until its last completion
+    class Operation
+    {
+    public:
+        virtual ~Operation() = default;
+
+        // `result` is the byte count or -errno. For receives `data` holds the bytes received,
+        // valid for the duration of the call only. `more` is false on the last completion.
+        virtual void OnComplete(const int result, const char* data, const bool more) = 0;
+    };
+
+    struct Stats
+    {
+        // io_uring_enter calls, completions processed and eventfd wake ups
+        uint64_t submits;
+        uint64_t completions;
+        uint64_t wakeups;
+
+        // Receives that found every registered buffer in use
+        uint64_t buffer_exhaustions;
+    };
+
+    static boost::asio::execution_context::id id;
+
+    explicit IoUring(boost::asio::execution_context& context);
+    virtual ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // Receives until the socket is shut down or fails
+    void Receive(const int fd, const std::shared_ptr<Operation>& operation);
+    void Send(const int fd, const void* data, const size_t size, const std::shared_ptr<Operation>& operation);
+
+    // Processes completed operations, returns how many
+    size_t Poll();
+
+    Stats GetStats() const;
+
+private:
+    void shutdown() override;
+
+    void Release();
+    [[noreturn]] void Fail(const std::string& what);
+
+    io_uring_sqe* NextSqe();
+    void Submit();
+
+    void WaitForCompletions();
+    void ReleaseBuffer(const uint16_t buffer_id);
+
+    int _ring_fd;
+    int _event_fd;
+
+    void* _sq_ring;
+    size_t _sq_ring_size;
+    void* _cq_ring;
+    size_t _cq_ring_size;
+    io_uring_sqe* _sqes;
+    size_t _sqes_size;
+
+    unsigned* _sq_head;
+    unsigned* _sq_tail;
+    unsigned _sq_mask;
+    unsigned* _sq_array;
+    unsigned _sq_pending;
+
+    unsigned* _cq_head;
+    unsigned* _cq_tail;
+    unsigned* _cq_flags;
+    unsigned _cq_mask;
+    io_uring_cqe* _cqes;
+
+    // A Poll() is queued on the io context
+    bool _poll_posted;
+
+    // io_uring_buf_ring's flexible array member is laid out differently in C++, so the ring
+    // is addressed as plain entries; the tail overlays the first entry's resv field
+    io_uring_buf* _buffer_ring;
+    size_t _buffer_ring_size;
+    char* _buffers;
+
+    uint64_t _next_user_data;
+    std::unordered_map<uint64_t, std::shared_ptr<Operation>> _operations;
+
+    boost::asio::posix::stream_descriptor _event;
+
+    std::atomic<uint64_t> _submits;
+    std::atomic<uint64_t> _completions;
+    std::atomic<uint64_t> _wakeups;
+    std::atomic<uint64_t> _buffer_exhaustions;
+};
+
+} // namespace ftx
\ No newline at end of file
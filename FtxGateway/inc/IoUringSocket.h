@@ -0,0 +1,269 @@
+#pragma once
+
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "IoUring.h"
+
+namespace ftx
+{
+
+// TCP socket usable as the next layer of an asio ssl::stream that reads and writes through
+// the io context's IoUring. The first read arms one multishot receive that runs for the life
+// of the connection; data arriving while no read is pending is kept until the next one.
+// Handlers must be copyable.
+class IoUringSocket
+{
+public:
+    using Socket_t = boost::asio::ip::tcp::socket;
+    using lowest_layer_type = Socket_t::lowest_layer_type;
+    using executor_type = Socket_t::executor_type;
+    using Handler_t = std::function<void(const boost::system::error_code& ec, const size_t bytes)>;
+
+    explicit IoUringSocket(boost::asio::io_context& io)
+        : _socket(io)
+        , _ring(boost::asio::use_service<IoUring>(io))
+    {}
+
+    ~IoUringSocket()
+    {
+        boost::system::error_code ec;
+        Close(ec);
+    }
+
+    executor_type get_executor()
+    {
+        return _socket.get_executor();
+    }
+
+    lowest_layer_type& lowest_layer()
+    {
+        return _socket.lowest_layer();
+    }
+
+    const lowest_layer_type& lowest_layer() const
+    {
+        return _socket.lowest_layer();
+    }
+
+    // io_uring receives carry no kernel timestamps
+    uint64_t GetKernelWallNs() const
+    {
+        return 0;
+    }
+
+    // Ends the receive still running in the ring, then closes the socket
+    void Close(boost::system::error_code& ec)
+    {
+        if (_receive)
+        {
+            _receive->Detach();
+        }
+
+        if (_socket.is_open())
+        {
+            ::shutdown(_socket.native_handle(), SHUT_RDWR);
+        }
+
+        _socket.close(ec);
+    }
+
+    template <typename MutableBufferSequence, typename ReadHandler>
+    void async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler)
+    {
+        const boost::asio::mutable_buffer buffer = *boost::asio::buffer_sequence_begin(buffers);
+
+        // ssl::stream reads nothing to get a completion it already has through the executor
+        if (buffer.size() == 0)
+        {
+            boost::asio::post(get_executor(), [handler = Handler_t(std::forward<ReadHandler>(handler))]()
+            {
+                handler(boost::system::error_code(), 0);
+            });
+            return;
+        }
+
+        if (!_receive)
+        {
+            _receive = std::make_shared<ReceiveOperation>(get_executor(), _ring, _socket.native_handle());
+            _ring.Receive(_socket.native_handle(), _receive);
+        }
+
+        _receive->Read(buffer, Handler_t(std::forward<ReadHandler>(handler)));
+    }
+
+    template <typename ConstBufferSequence, typename WriteHandler>
+    void async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler)
+    {
+        const boost::asio::const_buffer buffer = *boost::asio::buffer_sequence_begin(buffers);
+
+        _ring.Send(_socket.native_handle(), buffer.data(), buffer.size()
+                , std::make_shared<SendOperation>(Handler_t(std::forward<WriteHandler>(handler))));
+    }
+
+private:
+    class ReceiveOperation
+        : public IoUring::Operation
+        , public std::enable_shared_from_this<ReceiveOperation>
+    {
+    public:
+        ReceiveOperation(const executor_type& executor, IoUring& ring, const int fd)
+            : _executor(executor)
+            , _ring(ring)
+            , _fd(fd)
+            , _delivered(0)
+            , _pending_begin(0)
+            , _detached(false)
+        {}
+
+        void OnComplete(const int result, const char* data, const bool more) override
+        {
+            if (result > 0)
+            {
+                Store(data, static_cast<size_t>(result));
+            }
+            else if (result == 0)
+            {
+                _ec = boost::asio::error::eof;
+            }
+            else if (result != -ENOBUFS)
+            {
+                // Out of buffers only stops the receive, the data is still in the socket
+                _ec = boost::system::error_code(-result, boost::asio::error::get_system_category());
+            }
+
+            // Multishot receives also end when the registered buffers ran out
+            if (!more && !_ec && !_detached)
+            {
+                _ring.Receive(_fd, shared_from_this());
+            }
+
+            Deliver();
+        }
+
+        void Read(const boost::asio::mutable_buffer& buffer, Handler_t handler)
+        {
+            _buffer = buffer;
+            _handler = std::move(handler);
+
+            // Completion handlers may not run inside the initiating call
+            if (_pending_begin < _pending.size() || _ec)
+            {
+                boost::asio::post(_executor, [self = shared_from_this()](){ self->Deliver(); });
+            }
+        }
+
+        // The socket is closing, its descriptor may be reused
+        void Detach()
+        {
+            _detached = true;
+        }
+
+    private:
+        void Store(const char* data, size_t size)
+        {
+            // Straight into the waiting read when there is one
+            if (_handler && _pending_begin == _pending.size())
+            {
+                const size_t copied = std::min(size, _buffer.size());
+                std::memcpy(_buffer.data(), data, copied);
+                _buffer += copied;
+                _delivered += copied;
+
+                data += copied;
+                size -= copied;
+            }
+
+            _pending.insert(std::end(_pending), data, data + size);
+        }
+
+        void Deliver()
+        {
+            if (!_handler)
+            {
+                return;
+            }
+
+            const size_t available = _pending.size() - _pending_begin;
+            if (available > 0 && _buffer.size() > 0)
+            {
+                const size_t copied = std::min(available, _buffer.size());
+                std::memcpy(_buffer.data(), _pending.data() + _pending_begin, copied);
+                _buffer += copied;
+                _delivered += copied;
+                _pending_begin += copied;
+
+                if (_pending_begin == _pending.size())
+                {
+                    _pending.clear();
+                    _pending_begin = 0;
+                }
+            }
+
+            if (_delivered == 0 && !_ec)
+            {
+                return;
+            }
+
+            // Data goes out before the error that followed it
+            const boost::system::error_code ec = _delivered > 0 ? boost::system::error_code() : _ec;
+            const size_t delivered = _delivered;
+            _delivered = 0;
+
+            Handler_t handler = std::move(_handler);
+            _handler = nullptr;
+            handler(ec, delivered);
+        }
+
+        const executor_type _executor;
+        IoUring& _ring;
+        const int _fd;
+
+        boost::asio::mutable_buffer _buffer;
+        Handler_t _handler;
+        size_t _delivered;
+
+        std::vector<char> _pending;
+        size_t _pending_begin;
+
+        boost::system::error_code _ec;
+        bool _detached;
+    };
+
+    class SendOperation
+        : public IoUring::Operation
+    {
+    public:
+        explicit SendOperation(Handler_t handler)
+            : _handler(std::move(handler))
+        {}
+
+        void OnComplete(const int result, const char*, const bool) override
+        {
+            if (result < 0)
+            {
+                _handler(boost::system::error_code(-result, boost::asio::error::get_system_category()), 0);
+                return;
+            }
+
+            _handler(boost::system::error_code(), static_cast<size_t>(result));
+        }
+
+    private:
+        Handler_t _handler;
+    };
+
+    Socket_t _socket;
+    IoUring& _ring;
+    std::shared_ptr<ReceiveOperation> _receive;
+};
+
+} // namespace ftx
\ No newline at end of file
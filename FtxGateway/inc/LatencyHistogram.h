@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace ftx
+{
+
+// Lock-free log-linear histogram of nanosecond durations. Values are bucketed with
+// 16 sub-buckets per power of two, so any reported percentile is within ~6% of the
+// recorded value. Record() may be called concurrently from any number of threads.
+class LatencyHistogram
+{
+public:
+    struct Snapshot
+    {
+        uint64_t count = 0;
+        uint64_t min_ns = 0;
+        uint64_t max_ns = 0;
+        double mean_ns = 0.0;
+        uint64_t p50_ns = 0;
+        uint64_t p90_ns = 0;
+        uint64_t p99_ns = 0;
+        uint64_t p999_ns = 0;
+    };
+
+    LatencyHistogram();
+
+    void Record(const uint64_t value_ns);
+    void Reset();
+
+    Snapshot GetSnapshot() const;
+
+    // Upper bound of the bucket holding the given quantile (0..1), 0 if nothing was recorded
+    uint64_t GetPercentile(const double quantile) const;
+
+    // Adds this histogram's counts into `target`, used to merge windows
+    void AddTo(LatencyHistogram& target) const;
+
+private:
+    static constexpr const int SUB_BUCKET_BITS = 4;
+    static constexpr const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr const int NUM_BUCKETS = 2 * SUB_BUCKETS + (63 - SUB_BUCKET_BITS) * SUB_BUCKETS;
+
+    static int BucketIndex(const uint64_t value);
+    static uint64_t BucketUpperBound(const int index);
+
+    std::array<std::atomic<uint64_t>, NUM_BUCKETS> _buckets;
+    std::atomic<uint64_t> _count;
+    std::atomic<uint64_t> _sum;
+    std::atomic<uint64_t> _min;
+    std::atomic<uint64_t> _max;
+};
+
+// Histogram over a sliding time window made of NUM_SLOTS slots of `slot_ns` each.
+// Record() is expected to be called from a single thread (e.g. the io thread);
+// GetSnapshot() may be called from anywhere.
+class RollingLatencyHistogram
+{
+public:
+    explicit RollingLatencyHistogram(const uint64_t slot_ns);
+
+    void Record(const uint64_t now_ns, const uint64_t value_ns);
+
+    LatencyHistogram::Snapshot GetSnapshot(const uint64_t now_ns) const;
+    uint64_t GetPercentile(const uint64_t now_ns, const double quantile) const;
+
+private:
+    static constexpr const int NUM_SLOTS = 6;
+
+    struct Slot
+    {
+        std::atomic<uint64_t> epoch{0};
+        LatencyHistogram histogram;
+    };
+
+    void MergeInto(const uint64_t now_ns, LatencyHistogram& merged) const;
+
+    const uint64_t _slot_ns;
+    std::array<Slot, NUM_SLOTS> _slots;
+};
+
+} // namespace ftx
\ No newline at end of file
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include "WebSocketFrame.h"
+#include "WebSocketTransport.h"
+
+#if FTX_IO_URING
+#include "IoUringSocket.h"
+#endif
+
+namespace ftx
+{
+namespace ws
+{
+
+// TCP socket usable as the next layer of an asio ssl::stream that reads with
+// SocketOptions::ReceiveWithTimestamp, so the time the kernel received the last read data is
+// known (when the socket has kernel timestamps enabled). Reads are attempted right away and
+// only wait for readiness when nothing is there.
+class TimestampingSocket
+{
+public:
+    using Socket_t = boost::asio::ip::tcp::socket;
+    using lowest_layer_type = Socket_t::lowest_layer_type;
+    using executor_type = Socket_t::executor_type;
+
+    explicit TimestampingSocket(boost::asio::io_context& io)
+        : _socket(io)
+        , _kernel_wall_ns(0)
+    {}
+
+    executor_type get_executor()
+    {
+        return _socket.get_executor();
+    }
+
+    lowest_layer_type& lowest_layer()
+    {
+        return _socket.lowest_layer();
+    }
+
+    const lowest_layer_type& lowest_layer() const
+    {
+        return _socket.lowest_layer();
+    }
+
+    // CLOCK_REALTIME ns of the last read, 0 if not known
+    uint64_t GetKernelWallNs() const
+    {
+        return _kernel_wall_ns;
+    }
+
+    void Close(boost::system::error_code& ec)
+    {
+        _socket.close(ec);
+    }
+
+    template <typename MutableBufferSequence, typename ReadHandler>
+    void async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler)
+    {
+        const boost::asio::mutable_buffer buffer = *boost::asio::buffer_sequence_begin(buffers);
+
+        boost::system::error_code ec;
+        size_t bytes = 0;
+        if (!TryRead(buffer, ec, bytes))
+        {
+            _socket.async_wait(Socket_t::wait_read
+                    , [this, buffer, handler = std::forward<ReadHandler>(handler)](boost::system::error_code ec) mutable
+            {
+                size_t bytes = 0;
+                if (!ec && !TryRead(buffer, ec, bytes))
+                {
+                    // Spurious wake up
+                    async_read_some(boost::asio::mutable_buffers_1(buffer), std::move(handler));
+                    return;
+                }
+
+                handler(ec, bytes);
+            });
+            return;
+        }
+
+        // Completion handlers may not run inside the initiating call
+        boost::asio::post(_socket.get_executor()
+                , [handler = std::forward<ReadHandler>(handler), ec, bytes]() mutable { handler(ec, bytes); });
+    }
+
+    template <typename ConstBufferSequence, typename WriteHandler>
+    void async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler)
+    {
+        _socket.async_write_some(buffers, std::forward<WriteHandler>(handler));
+    }
+
+private:
+    // False if the read would block
+    bool TryRead(const boost::asio::mutable_buffer& buffer, boost::system::error_code& ec, size_t& bytes)
+    {
+        uint64_t kernel_ns = 0;
+        const ssize_t result = SocketOptions::ReceiveWithTimestamp(_socket.native_handle(), buffer.data(), buffer.size(), kernel_ns);
+
+        if (result < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return false;
+            }
+
+            ec = boost::system::error_code(errno, boost::asio::error::get_system_category());
+            return true;
+        }
+
+        if (result == 0 && buffer.size() > 0)
+        {
+            ec = boost::asio::error::eof;
+            return true;
+        }
+
+        if (kernel_ns != 0)
+        {
+            _kernel_wall_ns = kernel_ns;
+        }
+
+        bytes = static_cast<size_t>(result);
+        return true;
+    }
+
+    Socket_t _socket;
+    uint64_t _kernel_wall_ns;
+};
+
+// WebSocketTransport written directly on asio: one receive buffer that frames are parsed in
+// place from and handed on as views, masking with SIMD XOR on send, and kernel receive
+// timestamps read from the socket. Only fragmented messages are copied. wss:// only.
+//
+// Built with FTX_IO_URING, socket reads and writes go through io_uring instead (no kernel
+// timestamps then).
+class NativeWebSocketTransport
+    : public WebSocketTransport
+{
+public:
+    NativeWebSocketTransport(const std::string& endpoint
+            , const std::shared_ptr<TlsContext>& tls_context
+            , const SocketOptions& socket_options
+            , const Handlers& handlers);
+    virtual ~NativeWebSocketTransport();
+
+    boost::asio::io_context& GetIoContext() override;
+
+    void Connect() override;
+
+    void Send(const std::string& text) override;
+    void Ping(const std::string& payload) override;
+
+    void Stop() override;
+
+private:
+#if FTX_IO_URING
+    using Socket_t = IoUringSocket;
+#else
+    using Socket_t = TimestampingSocket;
+#endif
+
+    // One connection attempt. Every completion holds its connection, which keeps the stream
+    // and buffers alive for asio operations still in flight; completions of a connection
+    // that was replaced are ignored.
+    struct Connection
+    {
+        Connection(boost::asio::io_context& io, boost::asio::ssl::context& context)
+            : stream(io, context)
+        {}
+
+        boost::asio::ssl::stream<Socket_t> stream;
+
+        bool open = false;
+        uint64_t handshake_start_ns = 0;
+        std::string upgrade_key;
+
+        // Received bytes not yet consumed are [read_begin, read_end)
+        std::vector<char> read_buffer;
+        size_t read_begin = 0;
+        size_t read_end = 0;
+
+        // A fragmented message being reassembled
+        std::string fragments;
+        bool fragmented = false;
+
+        std::deque<std::string> write_queue;
+        bool close_after_write = false;
+    };
+
+    using ConnectionPtr_t = std::shared_ptr<Connection>;
+
+    void OnResolve(const ConnectionPtr_t& connection, const boost::system::error_code& ec, const boost::asio::ip::tcp::resolver::results_type& endpoints);
+    void OnConnect(const ConnectionPtr_t& connection, const boost::system::error_code& ec);
+    void OnTlsHandshake(const ConnectionPtr_t& connection, const boost::system::error_code& ec);
+    void ReadUpgradeResponse(const ConnectionPtr_t& connection);
+    void OnUpgradeResponse(const ConnectionPtr_t& connection, const boost::system::error_code& ec, const size_t bytes);
+    bool IsUpgradeAccepted(const ConnectionPtr_t& connection, const std::string& response) const;
+
+    void Read(const ConnectionPtr_t& connection);
+    void OnRead(const ConnectionPtr_t& connection, const boost::system::error_code& ec, const size_t bytes);
+
+    // False once the connection is gone
+    bool ConsumeFrames(const ConnectionPtr_t& connection);
+    bool OnFrame(const ConnectionPtr_t& connection, const frame::Header& header, const char* payload);
+
+    void QueueFrame(const ConnectionPtr_t& connection, const frame::Opcode opcode, const char* payload, const size_t size);
+    void QueueWrite(const ConnectionPtr_t& connection, std::string data);
+    void WriteNext(const ConnectionPtr_t& connection);
+    void OnWrite(const ConnectionPtr_t& connection, const boost::system::error_code& ec);
+
+    void EnsureReadSpace(Connection& connection, const size_t bytes);
+    frame::MaskKey_t NextMask();
+
+    // Reports the end of the current connection as a close if it had opened, as a failure if not
+    void Disconnect(const ConnectionPtr_t& connection, const bool close_socket);
+
+    std::string _host;
+    std::string _port;
+    std::string _path;
+
+    const std::shared_ptr<TlsContext> _tls_context;
+    const SocketOptions _socket_options;
+    const Handlers _handlers;
+
+    boost::asio::io_context _io;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> _work;
+    boost::asio::ip::tcp::resolver _resolver;
+
+    // Only touched on the io thread
+    ConnectionPtr_t _connection;
+    std::mt19937 _mask_rng;
+};
+
+} // namespace ws
+} // namespace ftx
\ No newline at end of file
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/config/asio_client.hpp>
+
+namespace ftx
+{
+namespace ws
+{
+
+// Hit/miss counters shared by every pooled message manager in the process
+class MessagePool
+{
+public:
+    struct Stats
+    {
+        // Messages handed out from a pool, and messages that had to be allocated
+        uint64_t hits;
+        uint64_t misses;
+    };
+
+    static Stats GetStats();
+
+protected:
+    static std::atomic<uint64_t> _hits;
+    static std::atomic<uint64_t> _misses;
+};
+
+// websocketpp connection message manager that keeps the messages (and their payload buffers)
+// it hands out and hands them out again once nobody else holds them, instead of allocating a
+// message and payload per frame. A message is free again when the pool holds its only
+// reference, so callbacks may keep a message for as long as they like.
+//
+// Once the pool has grown to POOL_SIZE messages, a message needed while all of them are
+// still in use is allocated and not kept.
+template <typename message>
+class PooledMessageManager
+    : public MessagePool
+    , public websocketpp::lib::enable_shared_from_this<PooledMessageManager<message>>
+{
+public:
+    // Names required by websocketpp
+    typedef PooledMessageManager<message> type;
+    typedef websocketpp::lib::shared_ptr<PooledMessageManager> ptr;
+    typedef websocketpp::lib::weak_ptr<PooledMessageManager> weak_ptr;
+    typedef typename message::ptr message_ptr;
+
+    static constexpr const size_t POOL_SIZE = 16;
+
+    PooledMessageManager()
+    {
+        _pool.reserve(POOL_SIZE);
+    }
+
+    message_ptr get_message()
+    {
+        message_ptr msg = Reuse();
+
+        return msg
+            ? msg
+            : Keep(websocketpp::lib::make_shared<message>(type::shared_from_this()));
+    }
+
+    message_ptr get_message(const websocketpp::frame::opcode::value op, const size_t size)
+    {
+        message_ptr msg = Reuse();
+
+        if (!msg)
+        {
+            return Keep(websocketpp::lib::make_shared<message>(type::shared_from_this(), op, size));
+        }
+
+        msg->set_opcode(op);
+        msg->get_raw_payload().reserve(size);
+
+        return msg;
+    }
+
+    // Messages go back to the pool by themselves when their last outside reference is dropped
+    bool recycle(message*)
+    {
+        return false;
+    }
+
+private:
+    message_ptr Reuse()
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+
+        for (const message_ptr& msg : _pool)
+        {
+            // Only the pool can hand out new references, so once the count is one it stays one
+            if (msg.use_count() != 1)
+            {
+                continue;
+            }
+
+            // Pairs with the release of the last outside reference, so its writes are visible
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            msg->get_raw_payload().clear();
+            msg->set_header("");
+            msg->set_prepared(false);
+            msg->set_fin(true);
+            msg->set_terminal(false);
+            msg->set_compressed(false);
+
+            _hits.fetch_add(1, std::memory_order_relaxed);
+            return msg;
+        }
+
+        return message_ptr();
+    }
+
+    message_ptr Keep(const message_ptr& msg)
+    {
+        _misses.fetch_add(1, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (_pool.size() < POOL_SIZE)
+        {
+            _pool.push_back(msg);
+        }
+
+        return msg;
+    }
+
+    // Frames are read on the io thread but may be sent from any thread
+    std::mutex _mtx;
+    std::vector<message_ptr> _pool;
+};
+
+// The asio TLS client config with pooled messages
+struct PooledTlsClientConfig
+    : public websocketpp::config::asio_tls_client
+{
+    typedef PooledTlsClientConfig type;
+    typedef websocketpp::config::asio_tls_client base;
+
+    typedef websocketpp::message_buffer::message<PooledMessageManager> message_type;
+    typedef PooledMessageManager<message_type> con_msg_manager_type;
+    typedef websocketpp::message_buffer::alloc::endpoint_msg_manager<con_msg_manager_type> endpoint_msg_manager_type;
+};
+
+} // namespace ws
+} // namespace ftx
\ No newline at end of file
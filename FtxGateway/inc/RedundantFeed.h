@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "FtxWebSocket.h"
+#include "FtxWebSocketMessages.h"
+#include "LatencyHistogram.h"
+
+namespace ftx
+{
+namespace ws
+{
+
+// Runs several independent websocket connections (one per receive thread config) subscribed
+// to the same channels and forwards the first copy of every update. Later copies are dropped,
+// as are updates older than what was already forwarded, so a stalled connection never delays
+// or rewinds the feed while it is behind. Every connection stays subscribed, so losing one
+// costs nothing.
+//
+// Callbacks are called one at a time, in the order updates were accepted, from whichever
+// connection's io thread delivered the winning copy.
+class RedundantFeed
+{
+public:
+    struct ConnectionStats
+    {
+        // Updates this connection delivered first, and copies it delivered after another did
+        uint64_t wins;
+        uint64_t duplicates;
+
+        // How far behind the winning copy its duplicates arrived
+        LatencyHistogram::Snapshot lag;
+    };
+
+    RedundantFeed(const std::string& market
+            , const std::string& key
+            , const std::string& secret
+            , const std::shared_ptr<const ClockSync>& clock_sync
+            , const std::shared_ptr<TlsContext>& tls_context
+            , const std::vector<ThreadConfig>& thread_configs
+            , const SocketOptions& socket_options);
+    virtual ~RedundantFeed() = default;
+
+    // Stops every connection; no callback is called after it returns
+    void Stop();
+
+    void SetBboCallback(const FtxWebSocket::BboCallback_t& callback);
+    void SetOrderCallback(const FtxWebSocket::OrderCallback_t& callback);
+    void SetFillCallback(const FtxWebSocket::FillCallback_t& callback);
+
+    size_t GetConnectionCount() const;
+
+    // For per connection round trip and feed latency
+    const FtxWebSocket& GetConnection(const size_t index) const;
+
+    std::vector<ConnectionStats> GetStats() const;
+
+private:
+    struct OrderState
+    {
+        Order::Status status;
+        double filled_size;
+        uint64_t receive_time_ns;
+    };
+
+    struct ConnectionCounters
+    {
+        std::atomic<uint64_t> wins{0};
+        std::atomic<uint64_t> duplicates{0};
+        LatencyHistogram lag;
+    };
+
+    void OnBbo(const size_t connection, const Bbo& bbo);
+    void OnOrder(const size_t connection, const Order& order);
+    void OnFill(const size_t connection, const Fill& fill);
+
+    void RecordWin(const size_t connection);
+    void RecordDuplicate(const size_t connection, const uint64_t receive_time_ns, const uint64_t winner_receive_time_ns);
+
+    // Closed orders and fills are remembered for this many entries to catch late copies
+    static constexpr const size_t MAX_REMEMBERED = 1024;
+
+    std::vector<std::unique_ptr<ConnectionCounters>> _counters;
+
+    std::mutex _mtx;
+
+    FtxWebSocket::BboCallback_t _bbo_callback;
+    FtxWebSocket::OrderCallback_t _order_callback;
+    FtxWebSocket::FillCallback_t _fill_callback;
+
+    bool _has_bbo;
+    Bbo _last_bbo;
+
+    std::unordered_map<int64_t, OrderState> _orders;
+    std::deque<int64_t> _closed_orders;
+
+    std::unordered_map<int64_t, uint64_t> _fills;
+    std::deque<int64_t> _fill_order;
+
+    // Declared last so no connection delivers into a partially constructed or destroyed feed
+    std::vector<std::unique_ptr<FtxWebSocket>> _connections;
+};
+
+} // namespace ws
+} // namespace ftx
\ No newline at end of file
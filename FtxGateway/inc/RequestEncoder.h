@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "ClockSync.h"
+#include "FtxWebSocketMessages.h"
+#include "HmacSha256.hpp"
+
+namespace ftx
+{
+
+enum class HttpMethod
+    : int
+{
+    GET,
+    POST,
+    DELETE
+};
+
+// Which encoder call rendered a request, so per request kind state can be kept without
+// looking at its path. Requests of one kind all go to the same endpoint.
+enum class RequestKind
+    : int
+{
+    NEW_ORDER,
+    CANCEL_BY_CLIENT_ID,
+    ORDER_STATUS,
+    CANCEL_ALL,
+    CANCEL_SIDE,
+    OTHER,
+
+    NUM_KINDS
+};
+
+// Fixed capacity character buffer; overflowing it is a programming error
+template <size_t N>
+struct FixedBuffer
+{
+    char data[N];
+    size_t size = 0;
+
+    void Clear()
+    {
+        size = 0;
+    }
+
+    void Append(const char* str, const size_t length)
+    {
+        if (size + length > N)
+        {
+            throw std::length_error("Encoded request buffer overflow");
+        }
+
+        // An empty string_view may have no data at all
+        if (length > 0)
+        {
+            std::memcpy(data + size, str, length);
+            size += length;
+        }
+    }
+
+    void Append(const std::string_view str)
+    {
+        Append(str.data(), str.size());
+    }
+
+    std::string_view View() const
+    {
+        return std::string_view(data, size);
+    }
+};
+
+// A fully rendered REST request: everything needed on the wire except the transport's own framing
+struct EncodedRequest
+{
+    HttpMethod method;
+    RequestKind kind;
+    FixedBuffer<256> url;
+    FixedBuffer<192> path;
+    FixedBuffer<1024> body;
+    FixedBuffer<24> timestamp;
+    FixedBuffer<crypto::HmacSha256Signer::HEX_LENGTH> signature;
+
+    // Time spent rendering and signing, for request latency stats
+    uint64_t serialize_ns;
+    uint64_t sign_ns;
+};
+
+// Renders signed order entry requests without heap allocation. Every Encode call writes into
+// a buffer owned by the calling thread and returns it; the result stays valid until the next
+// Encode call on the same thread. All constant fragments (market, prefixes) are rendered once.
+class RequestEncoder
+{
+public:
+    RequestEncoder(const std::string& endpoint
+            , const std::string& market
+            , const std::string& secret
+            , const std::shared_ptr<const ClockSync>& clock_sync);
+
+    // Sets the number of decimals prices and sizes are rendered with. Not thread safe;
+    // call before encoding starts.
+    void SetPriceIncrement(const double increment);
+    void SetSizeIncrement(const double increment);
+
+    const EncodedRequest& EncodeNewOrder(const ws::Side side
+            , const double price
+            , const double size
+            , const uint64_t client_id) const;
+
+    // Limit order that takes what it can at `price` right away and cancels the rest
+    const EncodedRequest& EncodeIocOrder(const ws::Side side
+            , const double price
+            , const double size
+            , const uint64_t client_id) const;
+
+    const EncodedRequest& EncodeCancelByClientId(const uint64_t client_id) const;
+
+    // Looks up an order's current status and fills
+    const EncodedRequest& EncodeOrderStatus(const uint64_t client_id) const;
+    const EncodedRequest& EncodeCancelAll() const;
+
+    // Cancels every order on one side of this encoder's market with a single request
+    const EncodedRequest& EncodeCancelSide(const ws::Side side) const;
+
+    // Generic request, for queries and other infrequent calls
+    const EncodedRequest& Encode(const HttpMethod method, const std::string_view path, const std::string_view body = {}) const;
+
+    static const char* MethodToString(const HttpMethod method);
+
+    // Writes an unsigned integer, returns the number of characters written (at most 20)
+    static size_t FormatUInt(char* out, uint64_t value);
+
+    // Writes `value` rounded to `decimals` places with trailing zeros trimmed, returns the
+    // number of characters written (at most 32)
+    static size_t FormatDecimal(char* out, const double value, const int decimals);
+
+private:
+    static int DecimalsFor(const double increment);
+
+    // Limit order whose JSON flags, from reduceOnly up to the clientId value, are `flags`
+    const EncodedRequest& EncodeOrder(const ws::Side side
+            , const double price
+            , const double size
+            , const uint64_t client_id
+            , const std::string_view flags) const;
+
+    // Request on /orders/by_client_id/<client_id>
+    const EncodedRequest& EncodeByClientId(const HttpMethod method
+            , const RequestKind kind
+            , const uint64_t client_id) const;
+
+    EncodedRequest& Begin(const HttpMethod method, const RequestKind kind) const;
+    void SetPath(EncodedRequest& request, const std::string_view path) const;
+    void Sign(EncodedRequest& request, const uint64_t start_ns) const;
+
+    const std::string _endpoint;
+    const crypto::HmacSha256Signer _signer;
+    const std::shared_ptr<const ClockSync> _clock_sync;
+
+    // Everything in a new order body up to the side value
+    const std::string _order_prefix;
+
+    int _price_decimals;
+    int _size_decimals;
+};
+
+} // namespace ftx
\ No newline at end of file
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <rapidjson/document.h>
+
+#include "LatencyHistogram.h"
+#include "RequestEncoder.h"
+#include "ThreadConfig.h"
+
+namespace ftx
+{
+
+// Sends a request and, if it has not been answered within a percentile of recent round trips,
+// sends the same signed request again over another connection and returns whichever answer
+// comes first. Only for requests the exchange deduplicates (orders carrying a client id,
+// cancels), so the loser is at worst rejected as a duplicate. A duplicate reject only means
+// the other send got there first, so it never answers while the other is still in flight.
+class RequestHedger
+{
+public:
+    using Response_t = rapidjson::Document;
+    using Send_t = std::function<Response_t(const EncodedRequest& request)>;
+
+    struct Config
+    {
+        bool enabled = false;
+
+        // Quantile of recent round trips after which the hedge is sent
+        double quantile = 0.9;
+
+        // Bounds on the hedge delay; the initial delay is used until round trips are known
+        uint64_t min_delay_ns = 2'000'000;
+        uint64_t initial_delay_ns = 50'000'000;
+
+        int worker_count = 4;
+        std::vector<ThreadConfig> worker_threads;
+    };
+
+    struct Stats
+    {
+        uint64_t requests;
+        uint64_t hedges_issued;
+        uint64_t hedges_won;
+        uint64_t duplicate_rejects;
+        uint64_t delay_ns;
+        LatencyHistogram::Snapshot round_trip;
+    };
+
+    explicit RequestHedger(const Send_t& send);
+    RequestHedger(const Send_t& send, const Config& config);
+    virtual ~RequestHedger();
+
+    bool IsEnabled() const;
+
+    // Blocks until the first of the original and the hedge is answered
+    Response_t Send(const EncodedRequest& request);
+
+    Stats GetStats() const;
+
+private:
+    // Shared between the caller and both sends; whichever finishes first hands its response over
+    struct Attempt
+    {
+        EncodedRequest request;
+
+        std::mutex mtx;
+        std::condition_variable cv;
+        bool done = false;
+        Response_t response;
+
+        // Sends not answered yet
+        int in_flight = 0;
+    };
+
+    static bool IsDuplicateReject(const Response_t& response);
+
+    void Launch(const std::shared_ptr<Attempt>& attempt, const bool hedge);
+    uint64_t GetDelayNs();
+
+    void Run();
+
+    const Send_t _send;
+    const Config _config;
+
+    std::mutex _rtt_mtx;
+    RollingLatencyHistogram _rtt;
+
+    std::atomic<uint64_t> _delay_ns;
+    std::atomic<uint64_t> _delay_updated_ns;
+
+    std::atomic<uint64_t> _requests;
+    std::atomic<uint64_t> _hedges_issued;
+    std::atomic<uint64_t> _hedges_won;
+    std::atomic<uint64_t> _duplicate_rejects;
+
+    std::mutex _tasks_mtx;
+    std::condition_variable _tasks_cv;
+    std::deque<std::function<void()>> _tasks;
+    bool _running;
+    std::vector<std::thread> _workers;
+};
+
+} // namespace ftx
\ No newline at end of file
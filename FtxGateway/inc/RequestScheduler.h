@@ -0,0 +1,220 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FtxAPI.h"
+#include "InlineFunction.h"
+#include "LatencyHistogram.h"
+#include "ThreadConfig.h"
+
+namespace ftx
+{
+
+// Sits in front of FtxAPI and dispatches requests by priority within the exchange rate limits.
+// Requests are executed on the scheduler's own worker threads; callbacks run on those threads.
+// Requests still queued when the scheduler stops are dropped through their on_dropped.
+class RequestScheduler
+{
+public:
+    enum class Priority
+        : int
+    {
+        CANCEL_ALL = 0,
+        CANCEL = 1,
+        NEW_ORDER = 2,
+        QUERY = 3,
+        NUM_PRIORITIES = 4
+    };
+
+    enum class DropReason
+        : int
+    {
+        // No longer current at dispatch
+        STALE,
+        // Replaced by a later request with the same supersede key
+        SUPERSEDED,
+        // Submitted to or still queued in a stopped scheduler
+        STOPPED
+    };
+
+    // Callbacks are kept inside the request, so submitting one does not allocate for them;
+    // their captures must fit in CALLBACK_CAPACITY bytes
+    static constexpr const size_t CALLBACK_CAPACITY = 48;
+
+    using ResponseCallback_t = InlineFunction<void(const FtxAPI::Response_t& response), CALLBACK_CAPACITY>;
+    using CurrentCheck_t = InlineFunction<bool(), CALLBACK_CAPACITY>;
+    using DropCallback_t = InlineFunction<void(const DropReason reason), CALLBACK_CAPACITY>;
+    using Encoder_t = InlineFunction<const EncodedRequest&(), CALLBACK_CAPACITY>;
+
+    struct Request
+    {
+        Priority priority;
+        FtxAPI::Method method;
+        std::string path;
+        std::string body;
+
+        // If set, the request is rendered by this at dispatch on the worker thread (so its
+        // timestamp is fresh) and method/path/body are ignored
+        Encoder_t encode;
+
+        // Lets FtxAPI duplicate a slow request over a second connection; only for requests
+        // the exchange deduplicates
+        bool hedge = false;
+
+        // Non-zero keys identify what a request acts on; submitting a request with the same
+        // key and priority replaces the queued one instead of sending both
+        uint64_t supersede_key = 0;
+
+        // Checked right before dispatch; a request that is no longer current is dropped
+        CurrentCheck_t is_current;
+
+        // Exactly one of these is called for every submitted request
+        ResponseCallback_t on_response;
+        DropCallback_t on_dropped;
+    };
+
+    // Rates must be positive and bursts at least 1, the constructor throws otherwise
+    struct Config
+    {
+        // Overall request budget
+        int request_rate_per_s = 30;
+        int request_burst = 30;
+
+        // Order entry (new orders and cancels) budget
+        int order_rate_per_s = 10;
+        int order_burst = 10;
+
+        int worker_count = 2;
+
+        // Per worker naming, pinning and priority; workers without an entry only get a name
+        std::vector<ThreadConfig> worker_threads;
+
+        // How long the budgets are emptied for after the exchange reports a rate limit
+        uint64_t rate_limit_penalty_ns = 1'000'000'000;
+    };
+
+    struct Stats
+    {
+        std::array<LatencyHistogram::Snapshot, static_cast<int>(Priority::NUM_PRIORITIES)> queue_wait;
+        std::array<uint64_t, static_cast<int>(Priority::NUM_PRIORITIES)> dispatched;
+        uint64_t throttled;
+        uint64_t rate_limited;
+        uint64_t superseded;
+        uint64_t stale;
+        uint64_t queued;
+
+        // Dispatches of more than one request through FtxAPI::SendBatch, and their requests
+        uint64_t batches;
+        uint64_t batched_requests;
+    };
+
+    explicit RequestScheduler(const FtxAPI& api);
+    RequestScheduler(const FtxAPI& api, const Config& config);
+    virtual ~RequestScheduler();
+
+    // Lets in-flight requests finish, joins the workers and drops whatever is still queued or
+    // submitted later. Callbacks are not called after it returns. Safe to call more than once,
+    // but not from a callback.
+    void Stop();
+
+    void Submit(Request&& request);
+
+    // Submits requests produced together, e.g. the cancels for one market update. Those with
+    // an encoder that are next in line together and within the budgets are dispatched as one
+    // batch, written to the exchange before any of their responses is waited for.
+    void SubmitBatch(std::vector<Request>&& requests);
+
+    // Submits the request and blocks until it has been sent and answered
+    FtxAPI::Response_t Execute(Request&& request);
+
+    Stats GetStats() const;
+
+private:
+    class TokenBucket
+    {
+    public:
+        TokenBucket(const int rate_per_s, const int burst);
+
+        // Returns 0 if a token is available, otherwise how long until one is
+        uint64_t TimeUntilAvailable(const uint64_t now_ns);
+        void Take();
+        void Refund();
+        void Drain(const uint64_t now_ns, const uint64_t penalty_ns);
+
+    private:
+        void Refill(const uint64_t now_ns);
+
+        const double _tokens_per_ns;
+        const double _burst;
+        double _tokens;
+        uint64_t _last_refill_ns;
+    };
+
+    struct QueuedRequest
+    {
+        Request request;
+        uint64_t enqueue_ns;
+        bool throttled;
+
+        // Shared by the requests of one SubmitBatch call, 0 for requests submitted alone
+        uint64_t batch;
+    };
+
+    static bool IsOrderEntry(const Priority priority);
+    static bool IsRateLimitResponse(const FtxAPI::Response_t& response);
+
+    struct Dropped
+    {
+        DropCallback_t on_dropped;
+        DropReason reason;
+    };
+
+    // Called with _queue_mtx held. Requests that are dropped instead are added to `dropped`,
+    // whose callbacks are called through NotifyDropped once the lock is released.
+    void Enqueue(Request&& request, const uint64_t batch, std::vector<Dropped>& dropped);
+    static void NotifyDropped(std::vector<Dropped>& dropped);
+
+    void Run();
+    bool PopNext(std::vector<QueuedRequest>& next, std::unique_lock<std::mutex>& lock);
+    void Dispatch(std::vector<QueuedRequest>& next);
+    void Dispatch(QueuedRequest& next);
+
+    // Drops a request that is no longer current and refunds its tokens; returns whether it did
+    bool DropIfStale(QueuedRequest& next);
+    void OnResponse(Request& request, const FtxAPI::Response_t& response);
+
+    FtxAPI::Response_t Send(const Request& request) const;
+
+    const FtxAPI& _api;
+    const Config _config;
+
+    mutable std::mutex _queue_mtx;
+    std::condition_variable _queue_cv;
+    std::array<std::deque<QueuedRequest>, static_cast<int>(Priority::NUM_PRIORITIES)> _queues;
+    uint64_t _next_batch;
+
+    TokenBucket _request_bucket;
+    TokenBucket _order_bucket;
+
+    std::atomic<bool> _running;
+    std::vector<std::thread> _workers;
+
+    std::array<LatencyHistogram, static_cast<int>(Priority::NUM_PRIORITIES)> _queue_wait;
+    std::array<std::atomic<uint64_t>, static_cast<int>(Priority::NUM_PRIORITIES)> _dispatched;
+    std::atomic<uint64_t> _throttled;
+    std::atomic<uint64_t> _rate_limited;
+    std::atomic<uint64_t> _superseded;
+    std::atomic<uint64_t> _stale;
+    std::atomic<uint64_t> _batches;
+    std::atomic<uint64_t> _batched_requests;
+};
+
+} // namespace ftx
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LatencyHistogram.h"
+
+namespace ftx
+{
+
+// Per endpoint breakdown of where REST request time goes. Endpoints are keyed by method and
+// path template, with numeric path segments folded into "{id}".
+class RestLatencyStats
+{
+public:
+    enum class Stage
+        : int
+    {
+        SERIALIZE = 0,
+        SIGN = 1,
+        HEADER = 2,
+        FIRST_BYTE = 3,
+        TRANSFER = 4,
+        PARSE = 5,
+        TOTAL = 6,
+        NUM_STAGES = 7
+    };
+
+    using Stages_t = std::array<LatencyHistogram, static_cast<int>(Stage::NUM_STAGES)>;
+
+    struct EndpointSnapshot
+    {
+        std::string method;
+        std::string path_template;
+        std::array<LatencyHistogram::Snapshot, static_cast<int>(Stage::NUM_STAGES)> stages;
+    };
+
+    RestLatencyStats() = default;
+    virtual ~RestLatencyStats();
+
+    // Histograms for an endpoint, created on first use. The reference stays valid for the
+    // lifetime of this object so callers can record into it without further lookups.
+    Stages_t& GetEndpoint(const std::string& method, const std::string& path);
+
+    std::vector<EndpointSnapshot> GetSnapshot() const;
+    void Dump(std::ostream& out) const;
+
+    // Dumps to `out` every `period_s` seconds until StopPeriodicDump() or destruction
+    void StartPeriodicDump(std::ostream& out, const int period_s);
+    void StopPeriodicDump();
+
+    static std::string PathTemplate(const std::string& path);
+    static const char* StageToString(const Stage stage);
+
+private:
+    using Key_t = std::pair<std::string, std::string>;
+
+    mutable std::shared_mutex _endpoints_mtx;
+    std::map<Key_t, std::unique_ptr<Stages_t>> _endpoints;
+
+    std::mutex _dump_mtx;
+    std::condition_variable _dump_cv;
+    bool _dumping = false;
+    std::unique_ptr<std::thread> _dump_thread;
+};
+
+} // namespace ftx
\ No newline at end of file
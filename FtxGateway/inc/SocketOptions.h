@@ -0,0 +1,44 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ftx
+{
+
+// Latency related socket options, applied to a connected (or connecting) TCP socket by
+// whichever transport owns it. Options the platform or our privileges do not allow are
+// reported and skipped.
+struct SocketOptions
+{
+    // Disable Nagle so small frames and orders leave immediately
+    bool no_delay = true;
+
+    // Ack incoming data right away instead of delaying to piggyback. Linux clears it again
+    // by itself, so transports re-arm it after reads with RearmQuickAck().
+    bool quick_ack = true;
+
+    // SO_BUSY_POLL: microseconds a blocking read spins on the device queue; 0 leaves the
+    // system default. Raising it needs CAP_NET_ADMIN.
+    int busy_poll_us = 0;
+
+    // SO_SNDBUF / SO_RCVBUF in bytes; 0 leaves the kernel's autotuning alone
+    int send_buffer_bytes = 0;
+    int receive_buffer_bytes = 0;
+
+    // Software receive timestamps (SO_TIMESTAMPING), read back by ReceiveWithTimestamp()
+    bool kernel_timestamps = false;
+
+    // Returns false if any requested option could not be set
+    bool Apply(const int fd) const;
+
+    static void RearmQuickAck(const int fd);
+
+    // recv() that also returns when the kernel received the data, in CLOCK_REALTIME ns
+    // (0 if the socket has no timestamps enabled). Only usable by transports doing their own reads.
+    static ssize_t ReceiveWithTimestamp(const int fd, void* buffer, const size_t length, uint64_t& kernel_ns);
+};
+
+} // namespace ftx
\ No newline at end of file
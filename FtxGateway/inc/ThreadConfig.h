@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace ftx
+{
+
+// Scheduling setup for one of our threads, applied by the thread itself when it starts
+struct ThreadConfig
+{
+    // Shown in top/perf; Linux truncates it to 15 characters
+    std::string name;
+
+    // Core to pin to; negative leaves affinity alone
+    int cpu = -1;
+
+    // SCHED_FIFO priority (1-99); 0 keeps the default time sharing policy. Needs
+    // CAP_SYS_NICE or an rtprio limit, otherwise it is reported and skipped.
+    int fifo_priority = 0;
+
+    // Io loops only: spin on poll() instead of sleeping in run(). Burns the whole core,
+    // so pair it with `cpu`.
+    bool busy_poll = false;
+
+    // Applies name, affinity and priority to the calling thread. Returns false if any of it
+    // could not be applied; the thread keeps running either way.
+    bool Apply() const;
+
+    // This config for the index-th thread of a group, or a config with just a default name
+    // if the group has no entry for it
+    static ThreadConfig ForIndex(const std::vector<ThreadConfig>& configs, const size_t index, const std::string& default_name);
+};
+
+} // namespace ftx
\ No newline at end of file
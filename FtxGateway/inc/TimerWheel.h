@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "LatencyHistogram.h"
+#include "ThreadConfig.h"
+
+namespace ftx
+{
+
+// Hashed hierarchical timing wheel for deadlines on the monotonic clock. The first level has a
+// slot per tick; each further level has a slot per full turn of the level below, so a handful
+// of levels cover days at a fine tick. A timer goes into the lowest level whose span reaches
+// its deadline and is moved down a level each time the wheel below turns over onto its slot.
+// Scheduling and cancelling are O(1). The wheel's thread sleeps until the next occupied tick
+// (or the next turn that moves timers down) rather than waking every tick, and runs the
+// callbacks of expired timers outside its lock.
+class TimerWheel
+{
+public:
+    using Callback_t = std::function<void()>;
+    using TimerId_t = uint64_t;
+
+    struct Config
+    {
+        uint64_t tick_ns = 1'000'000;
+
+        // 2^slot_bits slots per level. Deadlines beyond the last level's span are clamped to
+        // it and fire late; the defaults span about 50 days.
+        size_t slot_bits = 8;
+        size_t level_count = 4;
+
+        ThreadConfig thread{"ftx-timers"};
+    };
+
+    struct Stats
+    {
+        uint64_t scheduled;
+        uint64_t cancelled;
+        uint64_t fired;
+
+        // Timers moved down a level
+        uint64_t cascaded;
+
+        uint64_t pending;
+
+        // From a timer's deadline until its callback was started
+        LatencyHistogram::Snapshot lateness;
+    };
+
+    TimerWheel();
+    explicit TimerWheel(const Config& config);
+    virtual ~TimerWheel();
+
+    // Joins the wheel's thread; pending timers never fire. Safe to call more than once.
+    void Stop();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // Runs `callback` on the wheel's thread once `deadline_ns` (clock::MonotonicNs) has passed;
+    // a deadline already in the past fires on the next tick
+    TimerId_t Schedule(const uint64_t deadline_ns, Callback_t&& callback);
+
+    // Returns false if the timer already fired (its callback may still be running) or never existed
+    bool Cancel(const TimerId_t id);
+
+    Stats GetStats() const;
+
+private:
+    struct Timer
+    {
+        TimerId_t id;
+        uint64_t deadline_ns;
+        uint64_t tick;
+        Callback_t callback;
+
+        // Where it is filed
+        size_t level;
+        size_t slot;
+    };
+
+    using Slot_t = std::list<Timer>;
+
+    void Run();
+
+    // Files the timer at `position` of `from` into the wheel. Lists are spliced rather than
+    // copied, so the iterators in _timers stay valid as timers move down.
+    void Insert(Slot_t& from, const Slot_t::iterator position);
+
+    // Moves every timer due by `now_tick` to `due`
+    void Expire(const uint64_t now_tick, std::vector<Timer>& due);
+
+    // Re-files the timers of the slot of `level` that comes up at `tick`
+    void Cascade(const size_t level, const uint64_t tick);
+
+    // Earliest tick the wheel has work at (a timer due or timers to move down), or 0 if it is empty
+    uint64_t NextTick() const;
+
+    const Config _config;
+    const uint64_t _slot_mask;
+
+    mutable std::mutex _mtx;
+    std::condition_variable _cv;
+    bool _running;
+
+    // _levels[level][slot]
+    std::vector<std::vector<Slot_t>> _levels;
+    std::unordered_map<TimerId_t, Slot_t::iterator> _timers;
+
+    // First tick not expired yet
+    uint64_t _current_tick;
+
+    // Tick the thread sleeps until, 0 while it is awake
+    uint64_t _wake_tick;
+    TimerId_t _next_id;
+
+    std::atomic<uint64_t> _scheduled;
+    std::atomic<uint64_t> _cancelled;
+    std::atomic<uint64_t> _fired;
+    std::atomic<uint64_t> _cascaded;
+    std::atomic<uint64_t> _pending;
+    LatencyHistogram _lateness;
+
+    std::thread _thread;
+};
+
+} // namespace ftx
\ No newline at end of file
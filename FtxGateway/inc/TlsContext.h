@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <boost/asio/ssl.hpp>
+#include <openssl/ssl.h>
+
+#include "LatencyHistogram.h"
+
+namespace ftx
+{
+
+// Long lived TLS client context shared by every asio based connection. Servers are verified
+// against the system trust store and the host connected to. Sessions handed out by servers
+// are kept per host and offered again on the next handshake to that host, so a reconnect
+// resumes instead of doing a full handshake.
+class TlsContext
+{
+public:
+    using Context_t = boost::asio::ssl::context;
+
+    struct Stats
+    {
+        LatencyHistogram::Snapshot full_handshake;
+        LatencyHistogram::Snapshot resumed_handshake;
+    };
+
+    TlsContext();
+    virtual ~TlsContext();
+
+    TlsContext(const TlsContext&) = delete;
+    TlsContext& operator=(const TlsContext&) = delete;
+
+    std::shared_ptr<Context_t> GetContext() const;
+
+    // Call before the handshake: sets SNI and the name the server's certificate is checked
+    // against, and offers the last session seen for `host`
+    void PrepareSession(SSL* ssl, const std::string& host);
+
+    // Whether the server presented a certificate that checked out against the system trust
+    // store and the host, or verification was turned off on the context. The handshake
+    // already fails otherwise; this is for callers that act on what the handshake negotiated.
+    bool IsVerified(SSL* ssl) const;
+
+    // Call once the handshake completed; records its duration as full or resumed
+    void RecordHandshake(SSL* ssl, const uint64_t duration_ns);
+
+    Stats GetStats() const;
+
+private:
+    static int OnNewSession(SSL* ssl, SSL_SESSION* session);
+
+    const std::shared_ptr<Context_t> _context;
+
+    std::mutex _sessions_mtx;
+    std::unordered_map<std::string, SSL_SESSION*> _sessions;
+
+    LatencyHistogram _full_handshakes;
+    LatencyHistogram _resumed_handshakes;
+};
+
+} // namespace ftx
\ No newline at end of file
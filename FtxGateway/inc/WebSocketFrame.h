@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace ftx
+{
+namespace ws
+{
+namespace frame
+{
+
+// RFC 6455 framing, for transports that do their own
+
+enum class Opcode
+    : uint8_t
+{
+    CONTINUATION = 0x0,
+    TEXT = 0x1,
+    BINARY = 0x2,
+    CLOSE = 0x8,
+    PING = 0x9,
+    PONG = 0xA
+};
+
+using MaskKey_t = std::array<uint8_t, 4>;
+
+struct Header
+{
+    bool fin;
+    Opcode opcode;
+    bool masked;
+    MaskKey_t mask;
+    uint64_t payload_size;
+    size_t header_size;
+};
+
+// Two bytes, an eight byte extended length and the mask
+static constexpr const size_t MAX_HEADER_SIZE = 14;
+
+// Parses the header at the start of `data`; false if more bytes are needed
+bool ParseHeader(const char* data, const size_t size, Header& header);
+
+// Writes a final, masked (client to server) frame header, returns its size
+size_t WriteHeader(char* out, const Opcode opcode, const uint64_t payload_size, const MaskKey_t& mask);
+
+// XORs `data` in place with the repeating mask, 32 bytes at a time with AVX2 and 16 with SSE2.
+// Unmasking is the same operation.
+void Mask(char* data, const size_t size, const MaskKey_t& mask);
+
+} // namespace frame
+} // namespace ws
+} // namespace ftx
\ No newline at end of file
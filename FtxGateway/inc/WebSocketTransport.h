@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <boost/asio/io_context.hpp>
+
+#include "SocketOptions.h"
+#include "TlsContext.h"
+
+namespace ftx
+{
+namespace ws
+{
+
+// The websocket client under FtxWebSocket. Handlers are called on the thread running the
+// io context, which the owner runs itself; Send and Ping may be called from any thread.
+class WebSocketTransport
+{
+public:
+    struct Handlers
+    {
+        std::function<void()> on_open;
+
+        // The connection could not be established, or was lost before it opened
+        std::function<void()> on_fail;
+        std::function<void()> on_close;
+
+        // The payload is only valid for the duration of the call. kernel_wall_ns is when the
+        // kernel received the last of it (CLOCK_REALTIME), 0 if the transport cannot tell.
+        std::function<void(const char* data, const size_t size, const uint64_t kernel_wall_ns)> on_message;
+        std::function<void(const std::string& payload)> on_pong;
+    };
+
+    virtual ~WebSocketTransport() = default;
+
+    virtual boost::asio::io_context& GetIoContext() = 0;
+
+    // Starts a new connection, after the previous one (if any) failed or closed
+    virtual void Connect() = 0;
+
+    virtual void Send(const std::string& text) = 0;
+    virtual void Ping(const std::string& payload) = 0;
+
+    // Makes the io context return from run() as soon as possible
+    virtual void Stop() = 0;
+};
+
+// websocketpp unless built with FTX_NATIVE_WEBSOCKET
+std::unique_ptr<WebSocketTransport> MakeWebSocketTransport(const std::string& endpoint
+        , const std::shared_ptr<TlsContext>& tls_context
+        , const SocketOptions& socket_options
+        , const WebSocketTransport::Handlers& handlers);
+
+} // namespace ws
+} // namespace ftx
\ No newline at end of file
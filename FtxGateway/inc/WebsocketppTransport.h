@@ -0,0 +1,69 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <websocketpp/client.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/thread.hpp>
+#include <websocketpp/config/asio_client.hpp>
+
+#include "PooledMessageManager.h"
+#include "WebSocketTransport.h"
+
+namespace ftx
+{
+namespace ws
+{
+
+// WebSocketTransport on websocketpp's asio TLS client, with pooled messages
+class WebsocketppTransport
+    : public WebSocketTransport
+{
+private:
+    using Client = websocketpp::client<PooledTlsClientConfig>;
+    using MessagePtr = PooledTlsClientConfig::message_type::ptr;
+    using ContextPtr = std::shared_ptr<boost::asio::ssl::context>;
+    using TlsStream = boost::asio::ssl::stream<boost::asio::ip::tcp::socket>;
+
+public:
+    WebsocketppTransport(const std::string& endpoint
+            , const std::shared_ptr<TlsContext>& tls_context
+            , const SocketOptions& socket_options
+            , const Handlers& handlers);
+    virtual ~WebsocketppTransport() = default;
+
+    boost::asio::io_context& GetIoContext() override;
+
+    void Connect() override;
+
+    void Send(const std::string& text) override;
+    void Ping(const std::string& payload) override;
+
+    void Stop() override;
+
+private:
+    ContextPtr OnTlsInit(websocketpp::connection_hdl hdl);
+    void OnSocketInit(websocketpp::connection_hdl hdl, TlsStream& stream);
+    void OnTcpPostInit(websocketpp::connection_hdl hdl);
+    void OnOpen(websocketpp::connection_hdl hdl);
+    void OnFail(websocketpp::connection_hdl hdl);
+    void OnMessage(websocketpp::connection_hdl hdl, MessagePtr msg);
+    void OnClose(websocketpp::connection_hdl hdl);
+    void OnPong(websocketpp::connection_hdl hdl, std::string payload);
+
+    const std::string _endpoint;
+    const std::shared_ptr<TlsContext> _tls_context;
+    const SocketOptions _socket_options;
+    const Handlers _handlers;
+
+    Client _client;
+    Client::connection_ptr _connection_ptr;
+
+    // Only touched on the io thread
+    uint64_t _handshake_start_ns;
+    int _socket_fd;
+};
+
+} // namespace ws
+} // namespace ftx
\ No newline at end of file
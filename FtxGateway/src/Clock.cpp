@@ -0,0 +1,364 @@
+#include "Clock.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+#if FTX_HAS_TSC
+#include <cpuid.h>
+#endif
+
+#include "ThreadConfig.h"
+
+namespace ftx
+{
+namespace clock
+{
+
+namespace
+{
+
+static constexpr const uint64_t CALIBRATION_PERIOD_NS = 50'000'000;
+static constexpr const int CALIBRATION_SAMPLES = 16;
+static constexpr const int CALL_COST_ITERATIONS = 10'000;
+static constexpr const std::chrono::seconds ANCHOR_INTERVAL{1};
+
+// Most CLOCK_REALTIME is slewed by NTP (500 ppm), with some slack
+static constexpr const double MAX_SLEW = 0.001;
+
+struct Sample
+{
+    uint64_t tsc;
+    uint64_t monotonic_ns;
+    uint64_t wall_ns;
+};
+
+static inline uint64_t ReadClockNs(const clockid_t clock_id)
+{
+    struct timespec ts;
+    clock_gettime(clock_id, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+static bool HasInvariantTsc()
+{
+#if FTX_HAS_TSC
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+    {
+        return false;
+    }
+
+    return (edx & (1u << 8)) != 0;
+#else
+    return false;
+#endif
+}
+
+// Takes several TSC/clock pairs and keeps the one with the tightest TSC bracket,
+// which is the one least disturbed by interrupts or preemption
+static Sample TakeSample()
+{
+    Sample best{};
+    uint64_t best_window = std::numeric_limits<uint64_t>::max();
+
+    for (int i = 0; i < CALIBRATION_SAMPLES; ++i)
+    {
+        const uint64_t before = ReadTsc();
+        const uint64_t monotonic_ns = ReadClockNs(CLOCK_MONOTONIC_RAW);
+        const uint64_t wall_ns = ReadClockNs(CLOCK_REALTIME);
+        const uint64_t after = ReadTsc();
+
+        if (after - before < best_window)
+        {
+            best_window = after - before;
+            best = Sample{before + (after - before) / 2, monotonic_ns, wall_ns};
+        }
+    }
+
+    return best;
+}
+
+template <typename Func>
+static double MeasureCallCost(Func&& func)
+{
+    const uint64_t start_ns = ReadClockNs(CLOCK_MONOTONIC_RAW);
+
+    volatile uint64_t sink = 0;
+    for (int i = 0; i < CALL_COST_ITERATIONS; ++i)
+    {
+        sink = func();
+    }
+
+    const uint64_t elapsed_ns = ReadClockNs(CLOCK_MONOTONIC_RAW) - start_ns;
+    static_cast<void>(sink);
+
+    return static_cast<double>(elapsed_ns) / CALL_COST_ITERATIONS;
+}
+
+// Start of the run, which the TSC rate is measured from
+static Sample s_origin{};
+
+// The anchor readers see, behind a sequence lock: odd while it is being written. Every field
+// is an atomic, so a read racing a write is merely retried rather than undefined.
+static std::atomic<bool> s_tsc_enabled{false};
+static std::atomic<uint64_t> s_sequence{0};
+static std::atomic<double> s_ns_per_tick{0.0};
+static std::atomic<double> s_wall_ns_per_tick{0.0};
+static std::atomic<uint64_t> s_tsc_base{0};
+static std::atomic<uint64_t> s_monotonic_base_ns{0};
+static std::atomic<uint64_t> s_wall_base_ns{0};
+
+// Writer side, under s_anchor_mtx
+static std::mutex s_anchor_mtx;
+static detail::Anchor s_anchor{};
+static Sample s_last_sample{};
+
+static std::atomic<uint64_t> s_anchors{0};
+static std::atomic<int64_t> s_last_wall_error_ns{0};
+static std::atomic<uint64_t> s_max_wall_error_ns{0};
+
+static void Publish(const detail::Anchor& anchor)
+{
+    const uint64_t sequence = s_sequence.load(std::memory_order_relaxed);
+
+    s_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    s_ns_per_tick.store(anchor.ns_per_tick, std::memory_order_relaxed);
+    s_wall_ns_per_tick.store(anchor.wall_ns_per_tick, std::memory_order_relaxed);
+    s_tsc_base.store(anchor.tsc_base, std::memory_order_relaxed);
+    s_monotonic_base_ns.store(anchor.monotonic_base_ns, std::memory_order_relaxed);
+    s_wall_base_ns.store(anchor.wall_base_ns, std::memory_order_relaxed);
+
+    s_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+// Measures the TSC rate over CALIBRATION_PERIOD_NS and publishes the first anchor
+static void MeasureRate()
+{
+    if (!HasInvariantTsc())
+    {
+        return;
+    }
+
+    s_origin = TakeSample();
+
+    while (ReadClockNs(CLOCK_MONOTONIC_RAW) - s_origin.monotonic_ns < CALIBRATION_PERIOD_NS)
+    {}
+
+    const Sample end = TakeSample();
+    if (end.tsc <= s_origin.tsc)
+    {
+        return;
+    }
+
+    const double ns_per_tick = static_cast<double>(end.monotonic_ns - s_origin.monotonic_ns) / (end.tsc - s_origin.tsc);
+
+    std::lock_guard<std::mutex> lock(s_anchor_mtx);
+
+    s_anchor = detail::Anchor{ns_per_tick, ns_per_tick, end.tsc, end.monotonic_ns, end.wall_ns};
+    s_last_sample = end;
+
+    Publish(s_anchor);
+    s_tsc_enabled.store(true, std::memory_order_release);
+}
+
+static void Reanchor()
+{
+    std::lock_guard<std::mutex> lock(s_anchor_mtx);
+
+    const Sample sample = TakeSample();
+    const detail::Anchor& previous = s_anchor;
+
+    if (sample.tsc <= s_last_sample.tsc)
+    {
+        return;
+    }
+
+    detail::Anchor anchor;
+
+    // Over the whole run, so it only gets more precise
+    anchor.ns_per_tick = static_cast<double>(sample.monotonic_ns - s_origin.monotonic_ns) / (sample.tsc - s_origin.tsc);
+    anchor.tsc_base = sample.tsc;
+
+    // Carries on from the previous anchor rather than jumping onto the sample. A reader can
+    // still be using the previous anchor for a moment after this one is taken; if the rate
+    // went down, one extra nanosecond keeps it from getting ahead of this anchor there.
+    const uint64_t monotonic_ns = detail::Extrapolate(previous.monotonic_base_ns, sample.tsc, previous.tsc_base, previous.ns_per_tick);
+    anchor.monotonic_base_ns = monotonic_ns + (anchor.ns_per_tick < previous.ns_per_tick ? 1 : 0);
+
+    // The rate CLOCK_REALTIME kept since the last anchor, which includes NTP's slewing. Off by
+    // more than any slew, the clock was stepped and the monotonic rate is used instead.
+    const double wall_ns_per_tick = static_cast<double>(static_cast<int64_t>(sample.wall_ns - s_last_sample.wall_ns))
+        / (sample.tsc - s_last_sample.tsc);
+    anchor.wall_ns_per_tick = std::fabs(wall_ns_per_tick / anchor.ns_per_tick - 1.0) <= MAX_SLEW
+        ? wall_ns_per_tick
+        : anchor.ns_per_tick;
+
+    // Steps, like CLOCK_REALTIME itself
+    anchor.wall_base_ns = sample.wall_ns;
+
+    const int64_t wall_error_ns = static_cast<int64_t>(
+        detail::Extrapolate(previous.wall_base_ns, sample.tsc, previous.tsc_base, previous.wall_ns_per_tick) - sample.wall_ns);
+
+    s_anchor = anchor;
+    s_last_sample = sample;
+    Publish(s_anchor);
+
+    ++s_anchors;
+    s_last_wall_error_ns.store(wall_error_ns, std::memory_order_relaxed);
+
+    const uint64_t magnitude = static_cast<uint64_t>(wall_error_ns < 0 ? -wall_error_ns : wall_error_ns);
+    if (magnitude > s_max_wall_error_ns.load(std::memory_order_relaxed))
+    {
+        s_max_wall_error_ns.store(magnitude, std::memory_order_relaxed);
+    }
+}
+
+// Re-anchors every ANCHOR_INTERVAL until the process exits
+class AnchorThread
+{
+public:
+    AnchorThread()
+        : _running(true)
+        , _thread([this](){ this->Run(); })
+    {}
+
+    ~AnchorThread()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            _running = false;
+        }
+
+        _cv.notify_all();
+        _thread.join();
+    }
+
+private:
+    void Run()
+    {
+        ThreadConfig{"ftx-clock"}.Apply();
+
+        std::unique_lock<std::mutex> lock(_mtx);
+        while (!_cv.wait_for(lock, ANCHOR_INTERVAL, [this](){ return !_running; }))
+        {
+            lock.unlock();
+            Reanchor();
+            lock.lock();
+        }
+    }
+
+    std::mutex _mtx;
+    std::condition_variable _cv;
+    bool _running;
+    std::thread _thread;
+};
+
+} // namespace
+
+namespace detail
+{
+
+bool Read(Anchor& anchor, uint64_t& tsc)
+{
+    if (!s_tsc_enabled.load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+
+    while (true)
+    {
+        const uint64_t sequence = s_sequence.load(std::memory_order_acquire);
+
+        anchor.ns_per_tick = s_ns_per_tick.load(std::memory_order_relaxed);
+        anchor.wall_ns_per_tick = s_wall_ns_per_tick.load(std::memory_order_relaxed);
+        anchor.tsc_base = s_tsc_base.load(std::memory_order_relaxed);
+        anchor.monotonic_base_ns = s_monotonic_base_ns.load(std::memory_order_relaxed);
+        anchor.wall_base_ns = s_wall_base_ns.load(std::memory_order_relaxed);
+
+        // Inside the read, so a TSC value is never paired with an anchor replaced before it
+        tsc = ReadTsc();
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ((sequence & 1) == 0 && s_sequence.load(std::memory_order_relaxed) == sequence)
+        {
+            return true;
+        }
+    }
+}
+
+} // namespace detail
+
+void Calibrate()
+{
+    static std::once_flag calibrated;
+
+    std::call_once(calibrated, []()
+    {
+        MeasureRate();
+
+        if (s_tsc_enabled.load(std::memory_order_relaxed))
+        {
+            static AnchorThread anchor_thread;
+        }
+    });
+}
+
+Stats GetStats()
+{
+    struct CallCosts
+    {
+        double monotonic_ns;
+        double wall_ns;
+        double system_clock_ns;
+    };
+
+    // The clocks have to be up before their cost can be measured
+    static const CallCosts costs = []()
+    {
+        Calibrate();
+
+        return CallCosts
+        {
+            MeasureCallCost([](){ return MonotonicNs(); }),
+            MeasureCallCost([](){ return WallNs(); }),
+            MeasureCallCost([]()
+            {
+                return static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+            })
+        };
+    }();
+
+    Stats stats;
+
+    stats.tsc_enabled = s_tsc_enabled.load(std::memory_order_relaxed);
+    stats.ns_per_tick = s_ns_per_tick.load(std::memory_order_relaxed);
+    stats.anchors = s_anchors.load(std::memory_order_relaxed);
+    stats.last_wall_error_ns = s_last_wall_error_ns.load(std::memory_order_relaxed);
+    stats.max_wall_error_ns = s_max_wall_error_ns.load(std::memory_order_relaxed);
+    stats.monotonic_call_ns = costs.monotonic_ns;
+    stats.wall_call_ns = costs.wall_ns;
+    stats.system_clock_call_ns = costs.system_clock_ns;
+
+    return stats;
+}
+
+void Recalibrate()
+{
+    // Makes sure the first anchor is in place
+    Calibrate();
+
+    if (s_tsc_enabled.load(std::memory_order_relaxed))
+    {
+        Reanchor();
+    }
+}
+
+} // namespace clock
+} // namespace ftx
\ No newline at end of file
@@ -0,0 +1,237 @@
+#include "ClockSync.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+#include "Clock.h"
+
+namespace ftx
+{
+
+namespace
+{
+
+static constexpr const int64_t NS_PER_S = 1'000'000'000;
+
+static int64_t DaysFromCivil(int64_t year, const int month, const int day)
+{
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const int64_t year_of_era = year - era * 400;
+    const int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+static inline bool ValidTime(const int month, const int day, const int hour, const int minute, const int second)
+{
+    return month >= 1 && month <= 12
+        && day >= 1 && day <= 31
+        && hour >= 0 && hour <= 23
+        && minute >= 0 && minute <= 59
+        && second >= 0 && second <= 60;
+}
+
+static inline int64_t ToEpochNs(const int year, const int month, const int day, const int hour, const int minute, const int second)
+{
+    const int64_t days = DaysFromCivil(year, month, day);
+    return ((days * 24 + hour) * 60 + minute) * 60 * NS_PER_S + static_cast<int64_t>(second) * NS_PER_S;
+}
+
+}
+
+ClockSync::ClockSync()
+    : _samples()
+    , _sample_count(0)
+    , _offset_ns(0)
+    , _uncertainty_ns(0)
+    , _last_rtt_ns(0)
+{}
+
+void ClockSync::AddSample(const uint64_t send_wall_ns
+        , const uint64_t receive_wall_ns
+        , const uint64_t server_ns
+        , const uint64_t resolution_ns)
+{
+    if (receive_wall_ns < send_wall_ns)
+    {
+        return;
+    }
+
+    // The server read its clock somewhere in [send, receive] of ours, and what it reported
+    // is that reading truncated down to its resolution
+    const Sample sample
+    {
+        static_cast<int64_t>(server_ns) - static_cast<int64_t>(receive_wall_ns),
+        static_cast<int64_t>(server_ns + resolution_ns) - static_cast<int64_t>(send_wall_ns),
+        receive_wall_ns,
+        resolution_ns <= MAX_PRECISE_RESOLUTION_NS
+    };
+
+    _last_rtt_ns.store(receive_wall_ns - send_wall_ns, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(_samples_mtx);
+    _samples[_sample_count % MAX_SAMPLES] = sample;
+    ++_sample_count;
+
+    UpdateEstimate(receive_wall_ns);
+}
+
+int64_t ClockSync::GetOffsetNs() const
+{
+    return _offset_ns.load(std::memory_order_relaxed);
+}
+
+int64_t ClockSync::NowMs() const
+{
+    return static_cast<int64_t>(NowNs() / 1'000'000);
+}
+
+uint64_t ClockSync::NowNs() const
+{
+    return clock::WallNs() + GetOffsetNs();
+}
+
+ClockSync::Stats ClockSync::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(_samples_mtx);
+
+    return Stats
+    {
+        _offset_ns.load(std::memory_order_relaxed),
+        _uncertainty_ns.load(std::memory_order_relaxed),
+        _last_rtt_ns.load(std::memory_order_relaxed),
+        _sample_count
+    };
+}
+
+void ClockSync::UpdateEstimate(const uint64_t now_ns)
+{
+    int64_t lower = std::numeric_limits<int64_t>::min();
+    int64_t upper = std::numeric_limits<int64_t>::max();
+    bool precise = false;
+
+    const uint64_t available = _sample_count < MAX_SAMPLES ? _sample_count : MAX_SAMPLES;
+
+    // Walk from the newest sample back, stopping at the first one that disagrees with the
+    // newer ones (e.g. after a clock step) so stale samples never override fresh ones
+    for (uint64_t i = 0; i < available; ++i)
+    {
+        const Sample& sample = _samples[(_sample_count - 1 - i) % MAX_SAMPLES];
+
+        const int64_t age_ns = static_cast<int64_t>(now_ns - sample.taken_ns);
+        const int64_t drift_ns = age_ns / 1'000'000 * DRIFT_PPM;
+
+        const int64_t sample_lower = sample.lower_ns - drift_ns;
+        const int64_t sample_upper = sample.upper_ns + drift_ns;
+
+        const int64_t new_lower = sample_lower > lower ? sample_lower : lower;
+        const int64_t new_upper = sample_upper < upper ? sample_upper : upper;
+
+        if (new_lower > new_upper)
+        {
+            break;
+        }
+
+        lower = new_lower;
+        upper = new_upper;
+        precise = precise || sample.precise;
+    }
+
+    if (precise)
+    {
+        _offset_ns.store(lower + (upper - lower) / 2, std::memory_order_relaxed);
+        _uncertainty_ns.store(static_cast<uint64_t>(upper - lower) / 2, std::memory_order_relaxed);
+        return;
+    }
+
+    // A Date header's midpoint can be off by half a second, far worse than the local clock is
+    // likely to be, so its bounds only tell how far off the unadjusted local clock may be
+    _offset_ns.store(0, std::memory_order_relaxed);
+    _uncertainty_ns.store(static_cast<uint64_t>(std::max(-lower, upper)), std::memory_order_relaxed);
+}
+
+bool ClockSync::ParseHttpDate(const std::string& date, uint64_t& time_ns)
+{
+    static constexpr const char* MONTHS[] =
+    {
+        "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+    };
+
+    char month_str[4] = {};
+    int day = 0, year = 0, hour = 0, minute = 0, second = 0;
+
+    if (std::sscanf(date.c_str(), "%*3s, %d %3s %d %d:%d:%d", &day, month_str, &year, &hour, &minute, &second) != 6)
+    {
+        return false;
+    }
+
+    int month = 0;
+    for (int i = 0; i < 12; ++i)
+    {
+        if (std::strcmp(month_str, MONTHS[i]) == 0)
+        {
+            month = i + 1;
+            break;
+        }
+    }
+
+    if (!ValidTime(month, day, hour, minute, second))
+    {
+        return false;
+    }
+
+    time_ns = ToEpochNs(year, month, day, hour, minute, second);
+    return true;
+}
+
+bool ClockSync::ParseIso8601(const std::string& time, uint64_t& time_ns)
+{
+    int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+    int consumed = 0;
+
+    if (std::sscanf(time.c_str(), "%d-%d-%d%*1[T ]%d:%d:%d%n", &year, &month, &day, &hour, &minute, &second, &consumed) != 6
+            || !ValidTime(month, day, hour, minute, second))
+    {
+        return false;
+    }
+
+    const char* p = time.c_str() + consumed;
+
+    int64_t fraction_ns = 0;
+    if (*p == '.')
+    {
+        ++p;
+        int64_t scale = NS_PER_S / 10;
+        while (std::isdigit(static_cast<unsigned char>(*p)))
+        {
+            fraction_ns += (*p - '0') * scale;
+            scale /= 10;
+            ++p;
+        }
+    }
+
+    int64_t utc_offset_ns = 0;
+    if (*p == '+' || *p == '-')
+    {
+        int offset_hours = 0, offset_minutes = 0;
+        if (std::sscanf(p + 1, "%d:%d", &offset_hours, &offset_minutes) != 2)
+        {
+            return false;
+        }
+
+        utc_offset_ns = (static_cast<int64_t>(offset_hours) * 3600 + offset_minutes * 60) * NS_PER_S;
+        if (*p == '-')
+        {
+            utc_offset_ns = -utc_offset_ns;
+        }
+    }
+
+    time_ns = ToEpochNs(year, month, day, hour, minute, second) + fraction_ns - utc_offset_ns;
+    return true;
+}
+
+} // namespace ftx
\ No newline at end of file
@@ -0,0 +1,515 @@
+#include "ConnectionPool.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include <chrono>
+
+#include "Clock.h"
+#include "ThreadConfig.h"
+
+namespace ftx
+{
+
+namespace
+{
+
+static bool ParseHostPort(const std::string& url, std::string& host, std::string& port)
+{
+    const size_t scheme_end = url.find("://");
+    if (scheme_end == std::string::npos)
+    {
+        return false;
+    }
+
+    const size_t host_start = scheme_end + 3;
+    const size_t host_end = url.find_first_of(":/", host_start);
+    host = url.substr(host_start, host_end == std::string::npos ? std::string::npos : host_end - host_start);
+
+    if (host_end != std::string::npos && url[host_end] == ':')
+    {
+        const size_t port_end = url.find('/', host_end);
+        port = url.substr(host_end + 1, port_end == std::string::npos ? std::string::npos : port_end - host_end - 1);
+    }
+    else
+    {
+        port = url.compare(0, scheme_end, "https") == 0 ? "443" : "80";
+    }
+
+    return !host.empty() && !port.empty();
+}
+
+static std::string AddressToString(const addrinfo& address)
+{
+    char buffer[INET6_ADDRSTRLEN];
+
+    if (address.ai_family == AF_INET)
+    {
+        const auto* in = reinterpret_cast<const sockaddr_in*>(address.ai_addr);
+        if (inet_ntop(AF_INET, &in->sin_addr, buffer, sizeof(buffer)) != nullptr)
+        {
+            return buffer;
+        }
+    }
+    else if (address.ai_family == AF_INET6)
+    {
+        const auto* in6 = reinterpret_cast<const sockaddr_in6*>(address.ai_addr);
+        if (inet_ntop(AF_INET6, &in6->sin6_addr, buffer, sizeof(buffer)) != nullptr)
+        {
+            return std::string("[") + buffer + "]";
+        }
+    }
+
+    return "";
+}
+
+}
+
+ConnectionPool::Lease::Lease(ConnectionPool* pool, Connection* connection)
+    : _pool(pool)
+    , _connection(connection)
+{}
+
+ConnectionPool::Lease::Lease(Lease&& other) noexcept
+    : _pool(other._pool)
+    , _connection(other._connection)
+{
+    other._connection = nullptr;
+}
+
+ConnectionPool::Lease::~Lease()
+{
+    if (_connection)
+    {
+        _pool->Release(_connection);
+    }
+}
+
+cpr::Session& ConnectionPool::Lease::GetSession()
+{
+    return _connection->session;
+}
+
+ConnectionPool::ConnectionPool(const std::string& endpoint)
+    : ConnectionPool(endpoint, Config())
+{}
+
+ConnectionPool::ConnectionPool(const std::string& endpoint, const Config& config)
+    : _endpoint(endpoint)
+    , _config(config)
+    , _share(curl_share_init())
+    , _resolve(nullptr)
+    , _resolve_generation(0)
+    , _resolve_requested(false)
+    , _last_resolve_ns(0)
+    , _cold_request_ns(0)
+    , _first_request_ns(0)
+    , _first_request_connected(false)
+    , _first_request_done(false)
+    , _warm_up_ns(0)
+    , _new_connections(0)
+    , _reused_connections(0)
+    , _keep_alives(0)
+    , _overflows(0)
+    , _re_resolves(0)
+    , _keeping_alive(false)
+{
+    // Connections themselves are not shared: each session keeps its own so keep-alive and
+    // warm-up act on a known socket. Overflow sessions still skip DNS and resume TLS.
+    curl_share_setopt(_share, CURLSHOPT_LOCKFUNC, &ConnectionPool::LockShare);
+    curl_share_setopt(_share, CURLSHOPT_UNLOCKFUNC, &ConnectionPool::UnlockShare);
+    curl_share_setopt(_share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+    for (int i = 0; i < _config.connection_count; ++i)
+    {
+        _connections.push_back(CreateConnection());
+    }
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    StopKeepAlive();
+
+    // Sessions reference the share handle and resolve list, so they go first
+    _connections.clear();
+
+    curl_share_cleanup(_share);
+    curl_slist_free_all(_resolve);
+
+    for (curl_slist* resolve : _replaced_resolves)
+    {
+        curl_slist_free_all(resolve);
+    }
+}
+
+bool ConnectionPool::WarmUp()
+{
+    const uint64_t start_ns = clock::MonotonicNs();
+
+    if (!Resolve())
+    {
+        return false;
+    }
+
+    std::vector<Lease> leases;
+    leases.reserve(_config.connection_count);
+    for (int i = 0; i < _config.connection_count; ++i)
+    {
+        leases.push_back(Acquire());
+    }
+
+    // One after the other, so every connection after the first resumes the first one's TLS session
+    bool connected = false;
+    for (Lease& lease : leases)
+    {
+        const uint64_t ping_start_ns = clock::MonotonicNs();
+        const cpr::Response response = Ping(lease.GetSession());
+        const uint64_t ping_ns = clock::MonotonicNs() - ping_start_ns;
+
+        if (response.error)
+        {
+            continue;
+        }
+
+        connected = true;
+
+        uint64_t expected = 0;
+        _cold_request_ns.compare_exchange_strong(expected, ping_ns);
+    }
+
+    leases.clear();
+
+    _warm_up_ns = clock::MonotonicNs() - start_ns;
+
+    if (connected && (_config.keep_alive_period_s > 0 || _config.resolve_period_s > 0))
+    {
+        StopKeepAlive();
+
+        {
+            std::lock_guard<std::mutex> lock(_keep_alive_mtx);
+            _keeping_alive = true;
+        }
+
+        _keep_alive_thread = std::make_unique<std::thread>([this](){ this->RunKeepAlive(); });
+    }
+
+    return connected;
+}
+
+ConnectionPool::Lease ConnectionPool::Acquire()
+{
+    Connection* connection = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(_connections_mtx);
+
+        for (const auto& pooled : _connections)
+        {
+            if (!pooled->in_use)
+            {
+                connection = pooled.get();
+                break;
+            }
+        }
+
+        if (connection == nullptr)
+        {
+            connection = CreateConnection().release();
+            connection->pooled = false;
+            ++_overflows;
+        }
+
+        connection->in_use = true;
+
+        if (_resolve != nullptr && connection->resolve_generation != _resolve_generation)
+        {
+            curl_easy_setopt(connection->session.GetCurlHolder()->handle, CURLOPT_RESOLVE, _resolve);
+            connection->resolve_generation = _resolve_generation;
+        }
+    }
+
+    return Lease(this, connection);
+}
+
+cpr::Response ConnectionPool::Get(const std::string& path)
+{
+    Lease lease = Acquire();
+    cpr::Session& session = lease.GetSession();
+
+    session.SetUrl(cpr::Url{_endpoint + path});
+    session.SetHeader(cpr::Header{});
+    session.SetBody(cpr::Body{std::string()});
+
+    cpr::Response response = session.Get();
+    CountConnection(session);
+
+    if (response.status_code == 0)
+    {
+        RecordFailure();
+    }
+
+    return response;
+}
+
+void ConnectionPool::RecordRequest(Lease& lease, const uint64_t duration_ns, const bool order_entry)
+{
+    const bool connected = CountConnection(lease.GetSession());
+
+    if (order_entry && !_first_request_done.exchange(true))
+    {
+        _first_request_ns = duration_ns;
+        _first_request_connected = connected;
+    }
+}
+
+void ConnectionPool::RecordFailure()
+{
+    _resolve_requested = true;
+}
+
+ConnectionPool::Stats ConnectionPool::GetStats() const
+{
+    Stats stats;
+
+    stats.cold_request_ns = _cold_request_ns.load(std::memory_order_relaxed);
+    stats.first_request_ns = _first_request_ns.load(std::memory_order_relaxed);
+    stats.first_request_connected = _first_request_connected.load(std::memory_order_relaxed);
+    stats.warm_up_ns = _warm_up_ns.load(std::memory_order_relaxed);
+    stats.new_connections = _new_connections.load(std::memory_order_relaxed);
+    stats.reused_connections = _reused_connections.load(std::memory_order_relaxed);
+    stats.keep_alives = _keep_alives.load(std::memory_order_relaxed);
+    stats.overflows = _overflows.load(std::memory_order_relaxed);
+    stats.re_resolves = _re_resolves.load(std::memory_order_relaxed);
+
+    return stats;
+}
+
+void ConnectionPool::LockShare(CURL* /*handle*/, curl_lock_data data, curl_lock_access /*access*/, void* user)
+{
+    static_cast<ConnectionPool*>(user)->_share_mtx[data].lock();
+}
+
+void ConnectionPool::UnlockShare(CURL* /*handle*/, curl_lock_data data, void* user)
+{
+    static_cast<ConnectionPool*>(user)->_share_mtx[data].unlock();
+}
+
+int ConnectionPool::OnSocketCreated(void* user, curl_socket_t fd, curlsocktype purpose)
+{
+    if (purpose == CURLSOCKTYPE_IPCXN)
+    {
+        static_cast<const SocketOptions*>(user)->Apply(fd);
+    }
+
+    return CURL_SOCKOPT_OK;
+}
+
+bool ConnectionPool::CountConnection(cpr::Session& session)
+{
+    long new_connections = 0;
+    curl_easy_getinfo(session.GetCurlHolder()->handle, CURLINFO_NUM_CONNECTS, &new_connections);
+
+    if (new_connections > 0)
+    {
+        _new_connections += new_connections;
+        return true;
+    }
+
+    ++_reused_connections;
+    return false;
+}
+
+std::unique_ptr<ConnectionPool::Connection> ConnectionPool::CreateConnection() const
+{
+    auto connection = std::make_unique<Connection>();
+
+    CURL* handle = connection->session.GetCurlHolder()->handle;
+    curl_easy_setopt(handle, CURLOPT_SHARE, _share);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_NODELAY, _config.socket_options.no_delay ? 1L : 0L);
+    curl_easy_setopt(handle, CURLOPT_SOCKOPTFUNCTION, &ConnectionPool::OnSocketCreated);
+    curl_easy_setopt(handle, CURLOPT_SOCKOPTDATA, &_config.socket_options);
+
+    connection->last_used_ns = clock::MonotonicNs();
+
+    return connection;
+}
+
+void ConnectionPool::Release(Connection* connection)
+{
+    if (!connection->pooled)
+    {
+        delete connection;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_connections_mtx);
+    connection->in_use = false;
+    connection->last_used_ns = clock::MonotonicNs();
+}
+
+bool ConnectionPool::Resolve()
+{
+    std::string host;
+    std::string port;
+    if (!ParseHostPort(_endpoint, host, port))
+    {
+        return false;
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0)
+    {
+        return false;
+    }
+
+    std::string entry = host + ":" + port + ":";
+    bool first = true;
+    for (const addrinfo* address = addresses; address != nullptr; address = address->ai_next)
+    {
+        const std::string address_string = AddressToString(*address);
+        if (address_string.empty() || entry.find(address_string) != std::string::npos)
+        {
+            continue;
+        }
+
+        entry += (first ? "" : ",") + address_string;
+        first = false;
+    }
+
+    freeaddrinfo(addresses);
+
+    if (first)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_connections_mtx);
+
+    _last_resolve_ns = clock::MonotonicNs();
+
+    if (entry == _resolve_entry)
+    {
+        return true;
+    }
+
+    // Entries given through CURLOPT_RESOLVE never expire from the shared DNS cache, so the
+    // old one is removed before the new one is added. Each session applies the list at the
+    // start of its next transfer.
+    curl_slist* resolve = nullptr;
+    if (_resolve != nullptr)
+    {
+        resolve = curl_slist_append(resolve, ("-" + host + ":" + port).c_str());
+        _replaced_resolves.push_back(_resolve);
+        ++_re_resolves;
+    }
+
+    _resolve = curl_slist_append(resolve, entry.c_str());
+    _resolve_entry = entry;
+    ++_resolve_generation;
+
+    return true;
+}
+
+cpr::Response ConnectionPool::Ping(cpr::Session& session) const
+{
+    // A pooled session keeps the body of its last POST, so it is cleared explicitly
+    session.SetUrl(cpr::Url{_endpoint + _config.ping_path});
+    session.SetHeader(cpr::Header{});
+    session.SetBody(cpr::Body{std::string()});
+
+    return session.Get();
+}
+
+void ConnectionPool::KeepAliveIdle()
+{
+    const uint64_t idle_ns = static_cast<uint64_t>(_config.keep_alive_period_s) * 1'000'000'000;
+    const uint64_t now_ns = clock::MonotonicNs();
+
+    std::vector<Lease> leases;
+
+    {
+        std::lock_guard<std::mutex> lock(_connections_mtx);
+        for (const auto& connection : _connections)
+        {
+            if (!connection->in_use && now_ns - connection->last_used_ns >= idle_ns)
+            {
+                connection->in_use = true;
+                leases.push_back(Lease(this, connection.get()));
+            }
+        }
+    }
+
+    for (Lease& lease : leases)
+    {
+        if (Ping(lease.GetSession()).status_code == 0)
+        {
+            RecordFailure();
+        }
+
+        CountConnection(lease.GetSession());
+        ++_keep_alives;
+    }
+}
+
+void ConnectionPool::ResolveIfDue()
+{
+    const uint64_t period_ns = static_cast<uint64_t>(_config.resolve_period_s) * 1'000'000'000;
+
+    uint64_t last_resolve_ns = 0;
+    {
+        std::lock_guard<std::mutex> lock(_connections_mtx);
+        last_resolve_ns = _last_resolve_ns;
+    }
+
+    const bool due = period_ns > 0 && clock::MonotonicNs() - last_resolve_ns >= period_ns;
+    if (_resolve_requested.exchange(false) || due)
+    {
+        // A failed lookup keeps the pinned addresses, the next period tries again
+        Resolve();
+    }
+}
+
+void ConnectionPool::RunKeepAlive()
+{
+    ThreadConfig{"ftx-keepalive"}.Apply();
+
+    std::unique_lock<std::mutex> lock(_keep_alive_mtx);
+    while (!_keep_alive_cv.wait_for(lock, std::chrono::seconds(1), [this](){ return !_keeping_alive; }))
+    {
+        lock.unlock();
+
+        if (_config.keep_alive_period_s > 0)
+        {
+            KeepAliveIdle();
+        }
+
+        ResolveIfDue();
+
+        lock.lock();
+    }
+}
+
+void ConnectionPool::StopKeepAlive()
+{
+    {
+        std::lock_guard<std::mutex> lock(_keep_alive_mtx);
+        _keeping_alive = false;
+    }
+
+    _keep_alive_cv.notify_all();
+
+    if (_keep_alive_thread)
+    {
+        _keep_alive_thread->join();
+        _keep_alive_thread.reset();
+    }
+}
+
+} // namespace ftx
\ No newline at end of file
@@ -1,19 +1,8 @@
 #include "FtxAPI.h"
 
-#include <chrono>
+#include <curl/curl.h>
 
-#include "HmacSha256.hpp"
-
-namespace
-{
-
-static int64_t GetTimestampMs()
-{
-    using namespace std::chrono;
-    return duration_cast<seconds>(system_clock::now().time_since_epoch()).count() * 1000;
-}
-
-}
+#include "Clock.h"
 
 namespace ftx
 {
@@ -21,99 +10,484 @@ namespace ftx
 FtxAPI::FtxAPI(const std::string& key
             , const std::string& secret
             , const std::string& endpoint)
+    : FtxAPI(key, secret, endpoint, Config())
+{}
+
+FtxAPI::FtxAPI(const std::string& key
+            , const std::string& secret
+            , const std::string& endpoint
+            , const Config& config)
+    : FtxAPI(key, secret, endpoint, config, std::make_shared<TlsContext>())
+{}
+
+FtxAPI::FtxAPI(const std::string& key
+            , const std::string& secret
+            , const std::string& endpoint
+            , const Config& config
+            , const std::shared_ptr<TlsContext>& tls_context)
     : _key(key)
-    , _secret(secret)
     , _endpoint(endpoint)
-{}
+    , _clock_sync(std::make_shared<ClockSync>())
+    , _latency_stats(std::make_shared<RestLatencyStats>())
+    , _connection_pool(std::make_shared<ConnectionPool>(endpoint, PoolConfig(config)))
+    , _http_client(config.transport == Transport::HTTP1
+            ? std::make_shared<HttpClient>(endpoint, key, tls_context, HttpConfig(config))
+            : nullptr)
+    , _http2_client(config.transport == Transport::HTTP2
+            ? std::make_shared<Http2Client>(endpoint, key, tls_context, config.http2)
+            : nullptr)
+    , _hedger(std::make_shared<RequestHedger>([this](const EncodedRequest& request){ return SendOnce(request); }, config.hedge))
+    , _encoder(endpoint, "", secret, _clock_sync)
+{
+    for (std::atomic<RestLatencyStats::Stages_t*>& stages : _kind_stages)
+    {
+        stages.store(nullptr, std::memory_order_relaxed);
+    }
+}
 
 FtxAPI::Response_t FtxAPI::GetRequest(const std::string& path) const
 {
-    const int64_t time_ms = GetTimestampMs();
+    return Send(Method::GET, path);
+}
+
+FtxAPI::Response_t FtxAPI::PostRequest(const std::string& path, const std::string& body) const
+{
+    return Send(Method::POST, path, body);
+}
+
+FtxAPI::Response_t FtxAPI::DeleteRequest(const std::string& path) const
+{
+    return Send(Method::DELETE, path);
+}
+
+bool FtxAPI::WarmUp() const
+{
+    const bool pool_connected = _connection_pool->WarmUp();
+
+    if (_http_client)
+    {
+        return _http_client->WarmUp() && pool_connected;
+    }
+
+    if (_http2_client)
+    {
+        return _http2_client->WarmUp() && pool_connected;
+    }
+
+    return pool_connected;
+}
+
+void FtxAPI::SyncClock(const int samples) const
+{
+    static constexpr const uint64_t TIME_ENDPOINT_RESOLUTION_NS = 1'000;
+
+    for (int i = 0; i < samples; ++i)
+    {
+        const uint64_t send_wall_ns = clock::WallNs();
+        cpr::Response r = _connection_pool->Get("/time");
+        const uint64_t receive_wall_ns = clock::WallNs();
+
+        rapidjson::Document json_response;
+        json_response.Parse(r.text.c_str());
+
+        if (json_response.HasParseError()
+                || !json_response.IsObject()
+                || !json_response.HasMember("result")
+                || !json_response["result"].IsString())
+        {
+            AddDateSample(r, send_wall_ns, receive_wall_ns);
+            continue;
+        }
+
+        uint64_t server_ns = 0;
+        if (ClockSync::ParseIso8601(json_response["result"].GetString(), server_ns))
+        {
+            _clock_sync->AddSample(send_wall_ns, receive_wall_ns, server_ns, TIME_ENDPOINT_RESOLUTION_NS);
+        }
+    }
+}
+
+const std::string& FtxAPI::GetEndpoint() const
+{
+    return _endpoint;
+}
+
+std::shared_ptr<ClockSync> FtxAPI::GetClockSync() const
+{
+    return _clock_sync;
+}
+
+std::shared_ptr<RestLatencyStats> FtxAPI::GetLatencyStats() const
+{
+    return _latency_stats;
+}
+
+ConnectionPool::Stats FtxAPI::GetConnectionStats() const
+{
+    return _connection_pool->GetStats();
+}
+
+RequestHedger::Stats FtxAPI::GetHedgeStats() const
+{
+    return _hedger->GetStats();
+}
+
+HttpClient::Stats FtxAPI::GetHttpClientStats() const
+{
+    return _http_client ? _http_client->GetStats() : HttpClient::Stats{};
+}
+
+Http2Client::Stats FtxAPI::GetHttp2ClientStats() const
+{
+    return _http2_client ? _http2_client->GetStats() : Http2Client::Stats{};
+}
+
+ConnectionPool::Config FtxAPI::PoolConfig(const Config& config)
+{
+    ConnectionPool::Config pool_config = config.connection_pool;
+
+    // Every in flight request may need a second warm connection for its hedge
+    if (config.hedge.enabled)
+    {
+        pool_config.connection_count *= 2;
+    }
+
+    return pool_config;
+}
+
+HttpClient::Config FtxAPI::HttpConfig(const Config& config)
+{
+    HttpClient::Config http_config = config.http;
+
+    if (config.hedge.enabled)
+    {
+        http_config.connection_count *= 2;
+    }
+
+    return http_config;
+}
+
+FtxAPI::Response_t FtxAPI::Send(const Method method, const std::string& path, const std::string& body) const
+{
+    return Send(_encoder.Encode(method, path, body));
+}
+
+FtxAPI::Response_t FtxAPI::Send(const EncodedRequest& request, const bool hedge) const
+{
+    if (hedge && _hedger->IsEnabled())
+    {
+        return _hedger->Send(request);
+    }
+
+    return SendOnce(request);
+}
+
+FtxAPI::Response_t FtxAPI::SendOnce(const EncodedRequest& request) const
+{
+    if (_http_client)
+    {
+        return SendNative(request);
+    }
+
+    if (_http2_client)
+    {
+        return SendHttp2(request);
+    }
+
+    using Stage = RestLatencyStats::Stage;
+
+    RestLatencyStats::Stages_t& stages = GetStages(request);
+    const auto record = [&stages](const Stage stage, const uint64_t duration_ns)
+    {
+        stages[static_cast<int>(stage)].Record(duration_ns);
+    };
+
+    const uint64_t start_ns = clock::MonotonicNs();
+
+    ConnectionPool::Lease lease = _connection_pool->Acquire();
+    cpr::Session& session = lease.GetSession();
+
+    // Always set, a pooled session would otherwise still carry the body of its last POST
+    session.SetUrl(cpr::Url{std::string(request.url.View())});
+    session.SetBody(cpr::Body(request.body.data, request.body.size));
+    session.SetHeader(CreateHeader(request));
+
+    const uint64_t header_ns = clock::MonotonicNs();
+    const uint64_t send_wall_ns = clock::WallNs();
 
-    cpr::Response r = cpr::Get(
-        cpr::Url{_endpoint + path},
-        CreateHeader(path, time_ms, Method::GET)
-    );
+    cpr::Response r = Perform(session, request.method);
+
+    const uint64_t transferred_ns = clock::MonotonicNs();
+    AddDateSample(r, send_wall_ns, clock::WallNs());
 
     rapidjson::Document json_response;
     json_response.Parse(r.text.c_str());
 
+    const uint64_t parsed_ns = clock::MonotonicNs();
+
+    // Both are counted from the start of the transfer, so DNS, connect and TLS come off
+    curl_off_t first_byte_us = 0;
+    curl_off_t sent_us = 0;
+    if (curl_easy_getinfo(session.GetCurlHolder()->handle, CURLINFO_STARTTRANSFER_TIME_T, &first_byte_us) == CURLE_OK
+            && curl_easy_getinfo(session.GetCurlHolder()->handle, CURLINFO_PRETRANSFER_TIME_T, &sent_us) == CURLE_OK
+            && first_byte_us >= sent_us)
+    {
+        record(Stage::FIRST_BYTE, static_cast<uint64_t>(first_byte_us - sent_us) * 1000);
+    }
+
+    record(Stage::SERIALIZE, request.serialize_ns);
+    record(Stage::SIGN, request.sign_ns);
+    record(Stage::HEADER, header_ns - start_ns);
+    record(Stage::TRANSFER, transferred_ns - header_ns);
+    record(Stage::PARSE, parsed_ns - transferred_ns);
+    record(Stage::TOTAL, request.serialize_ns + request.sign_ns + parsed_ns - start_ns);
+
+    if (r.status_code == 0)
+    {
+        _connection_pool->RecordFailure();
+    }
+
+    // Reads (market data, order status) do not count as the first order
+    _connection_pool->RecordRequest(lease, request.serialize_ns + request.sign_ns + parsed_ns - start_ns
+            , request.method != HttpMethod::GET);
+
     return json_response;
 }
 
-FtxAPI::Response_t FtxAPI::PostRequest(const std::string& path, const std::string& body) const
+FtxAPI::Response_t FtxAPI::SendNative(const EncodedRequest& request) const
 {
-    const int64_t time_ms = GetTimestampMs();
+    using Stage = RestLatencyStats::Stage;
+
+    RestLatencyStats::Stages_t& stages = GetStages(request);
+    const auto record = [&stages](const Stage stage, const uint64_t duration_ns)
+    {
+        stages[static_cast<int>(stage)].Record(duration_ns);
+    };
+
+    const uint64_t start_ns = clock::MonotonicNs();
 
-    cpr::Response r = cpr::Post(
-        cpr::Url{_endpoint + path},
-        CreateHeader(path, time_ms, Method::POST, body),
-        cpr::Body(body)
-    );
+    HttpClient::Lease lease = _http_client->Acquire();
+    HttpClient::Response response;
+
+    const uint64_t send_wall_ns = clock::WallNs();
+    const bool sent = lease.Send(request, response);
+
+    const uint64_t transferred_ns = clock::MonotonicNs();
+    if (!response.date.empty())
+    {
+        AddDateSample(std::string(response.date), send_wall_ns, clock::WallNs());
+    }
 
+    // Straight from the receive buffer, which the lease keeps until it is released
     rapidjson::Document json_response;
-    json_response.Parse(r.text.c_str());
+    json_response.Parse(response.body, response.body_size);
+
+    const uint64_t parsed_ns = clock::MonotonicNs();
+
+    if (sent)
+    {
+        record(Stage::FIRST_BYTE, response.first_byte_ns);
+    }
+
+    record(Stage::SERIALIZE, request.serialize_ns);
+    record(Stage::SIGN, request.sign_ns);
+    record(Stage::HEADER, response.render_ns);
+    record(Stage::TRANSFER, transferred_ns - start_ns - response.render_ns);
+    record(Stage::PARSE, parsed_ns - transferred_ns);
+    record(Stage::TOTAL, request.serialize_ns + request.sign_ns + parsed_ns - start_ns);
 
     return json_response;
 }
 
-FtxAPI::Response_t FtxAPI::DeleteRequest(const std::string& path) const
+FtxAPI::Response_t FtxAPI::SendHttp2(const EncodedRequest& request) const
 {
-    const int64_t time_ms = GetTimestampMs();
+    using Stage = RestLatencyStats::Stage;
+
+    RestLatencyStats::Stages_t& stages = GetStages(request);
+    const auto record = [&stages](const Stage stage, const uint64_t duration_ns)
+    {
+        stages[static_cast<int>(stage)].Record(duration_ns);
+    };
+
+    const uint64_t start_ns = clock::MonotonicNs();
+    const uint64_t send_wall_ns = clock::WallNs();
 
-    cpr::Response r = cpr::Delete(
-        cpr::Url{_endpoint + path},
-        CreateHeader(path, time_ms, Method::DELETE)
-    );
+    Http2Client::Response response;
+    const bool sent = _http2_client->Send(request, response);
+
+    const uint64_t transferred_ns = clock::MonotonicNs();
+    if (!response.date.empty())
+    {
+        AddDateSample(response.date, send_wall_ns, clock::WallNs());
+    }
 
     rapidjson::Document json_response;
-    json_response.Parse(r.text.c_str());
+    json_response.Parse(response.body.data(), response.body.size());
+
+    const uint64_t parsed_ns = clock::MonotonicNs();
+
+    if (sent)
+    {
+        record(Stage::FIRST_BYTE, response.first_byte_ns);
+    }
+
+    // Headers are built on the io thread as part of the transfer
+    record(Stage::SERIALIZE, request.serialize_ns);
+    record(Stage::SIGN, request.sign_ns);
+    record(Stage::TRANSFER, transferred_ns - start_ns);
+    record(Stage::PARSE, parsed_ns - transferred_ns);
+    record(Stage::TOTAL, request.serialize_ns + request.sign_ns + parsed_ns - start_ns);
 
     return json_response;
 }
 
-std::string FtxAPI::MethodToString(const Method method)
+std::vector<FtxAPI::Response_t> FtxAPI::SendBatch(const std::vector<const EncodedRequest*>& requests) const
+{
+    std::vector<Response_t> responses(requests.size());
+
+    if (!_http_client && !_http2_client)
+    {
+        // libcurl gives no say over when a request is written
+        for (size_t i = 0; i < requests.size(); ++i)
+        {
+            responses[i] = SendOnce(*requests[i]);
+        }
+
+        return responses;
+    }
+
+    using Stage = RestLatencyStats::Stage;
+
+    const uint64_t start_ns = clock::MonotonicNs();
+    const uint64_t send_wall_ns = clock::WallNs();
+
+    // Every request of the batch is timed from the batch's start
+    const auto complete = [&](const size_t index
+            , const bool sent
+            , const uint64_t first_byte_ns
+            , const std::string_view date
+            , const char* body
+            , const size_t body_size)
+    {
+        const EncodedRequest& request = *requests[index];
+
+        RestLatencyStats::Stages_t& stages = GetStages(request);
+        const auto record = [&stages](const Stage stage, const uint64_t duration_ns)
+        {
+            stages[static_cast<int>(stage)].Record(duration_ns);
+        };
+
+        const uint64_t transferred_ns = clock::MonotonicNs();
+        if (!date.empty())
+        {
+            AddDateSample(std::string(date), send_wall_ns, clock::WallNs());
+        }
+
+        responses[index].Parse(body, body_size);
+
+        const uint64_t parsed_ns = clock::MonotonicNs();
+
+        if (sent)
+        {
+            record(Stage::FIRST_BYTE, first_byte_ns);
+        }
+
+        record(Stage::SERIALIZE, request.serialize_ns);
+        record(Stage::SIGN, request.sign_ns);
+        record(Stage::TRANSFER, transferred_ns - start_ns);
+        record(Stage::PARSE, parsed_ns - transferred_ns);
+        record(Stage::TOTAL, request.serialize_ns + request.sign_ns + parsed_ns - start_ns);
+    };
+
+    if (_http_client)
+    {
+        _http_client->SendBatch(requests, [&complete](const size_t index, const HttpClient::Response& response)
+        {
+            complete(index, response.status != 0, response.first_byte_ns, response.date, response.body, response.body_size);
+        });
+    }
+    else
+    {
+        _http2_client->SendBatch(requests, [&complete](const size_t index, const Http2Client::Response& response)
+        {
+            complete(index, response.status != 0, response.first_byte_ns, response.date, response.body.data(), response.body.size());
+        });
+    }
+
+    return responses;
+}
+
+cpr::Response FtxAPI::Perform(cpr::Session& session, const Method method)
 {
     switch (method)
     {
     case Method::GET:
-        return "GET";
+        return session.Get();
     case Method::POST:
-        return "POST";
+        return session.Post();
     case Method::DELETE:
-        return "DELETE";
+        return session.Delete();
     default:
         throw std::runtime_error("Invalid method");
     }
 }
 
-cpr::Header FtxAPI::CreateHeader(const std::string& request_path
-            , const int64_t time_ms
-            , const Method method
-            , const std::string& body) const
+void FtxAPI::AddDateSample(const cpr::Response& response, const uint64_t send_wall_ns, const uint64_t receive_wall_ns) const
+{
+    const auto date = response.header.find("Date");
+    if (date != std::end(response.header))
+    {
+        AddDateSample(date->second, send_wall_ns, receive_wall_ns);
+    }
+}
+
+void FtxAPI::AddDateSample(const std::string& date, const uint64_t send_wall_ns, const uint64_t receive_wall_ns) const
 {
-    static constexpr const char* PATH_PREFIX = "/api";
+    static constexpr const uint64_t DATE_RESOLUTION_NS = 1'000'000'000;
+
+    uint64_t server_ns = 0;
+    if (ClockSync::ParseHttpDate(date, server_ns))
+    {
+        _clock_sync->AddSample(send_wall_ns, receive_wall_ns, server_ns, DATE_RESOLUTION_NS);
+    }
+}
 
+cpr::Header FtxAPI::CreateHeader(const EncodedRequest& request) const
+{
     return cpr::Header
     {
         {"FTXUS-KEY", _key},
-        {"FTXUS-SIGN", Sign(time_ms, method, PATH_PREFIX + request_path, body)},
-        {"FTXUS-TS", std::to_string(time_ms)},
+        {"FTXUS-SIGN", std::string(request.signature.View())},
+        {"FTXUS-TS", std::string(request.timestamp.View())},
         {"Content-Type", "application/json"},
         {"Accepts", "application/json"}
     };
 }
 
-std::string FtxAPI::Sign(const int64_t timestamp
-        , const Method http_method
-        , const std::string& request_path
-        , const std::string& request_body) const
+RestLatencyStats::Stages_t& FtxAPI::GetStages(const EncodedRequest& request) const
 {
-    const std::string data = std::to_string(timestamp)
-        + MethodToString(http_method)
-        + request_path
-        + request_body;
-    
-    return HmacSha256(data, _secret);
+    const auto lookup = [this, &request]() -> RestLatencyStats::Stages_t&
+    {
+        return _latency_stats->GetEndpoint(RequestEncoder::MethodToString(request.method)
+                , std::string(request.path.View()));
+    };
+
+    // Generic requests can go anywhere
+    if (request.kind == RequestKind::OTHER)
+    {
+        return lookup();
+    }
+
+    // Endpoints are never removed, so a racing lookup stores the same pointer
+    std::atomic<RestLatencyStats::Stages_t*>& cached = _kind_stages[static_cast<int>(request.kind)];
+    RestLatencyStats::Stages_t* stages = cached.load(std::memory_order_acquire);
+    if (stages == nullptr)
+    {
+        stages = &lookup();
+        cached.store(stages, std::memory_order_release);
+    }
+
+    return *stages;
 }
+
 } // namespace ftx
\ No newline at end of file
@@ -1,13 +1,17 @@
 #include "FtxWebSocket.h"
 
+#include <algorithm>
 #include <chrono>
-#include <ctime>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
 
 #include <boost/bind.hpp>
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
-#include <websocketpp/endpoint.hpp>
 
+#include "Clock.h"
 #include "HmacSha256.hpp"
 
 namespace ftx
@@ -15,53 +19,82 @@ namespace ftx
 namespace ws
 {
 
+namespace
+{
+
+static constexpr const int HEARTBEAT_PERIOD_S = 10;
+static constexpr const uint64_t RTT_WINDOW_SLOT_NS = 10'000'000'000;
+
+static constexpr const int RECONNECT_BASE_MS = 100;
+static constexpr const int RECONNECT_MAX_MS = 10'000;
+
+static inline uint64_t ExchangeTimeToNs(const double time_s)
+{
+    return time_s > 0 ? static_cast<uint64_t>(std::llround(time_s * 1e9)) : 0;
+}
+
+}
+
 FtxWebSocket::FtxWebSocket(const std::string& market
         , const std::string& key
         , const std::string& secret
+        , const std::shared_ptr<const ClockSync>& clock_sync
+        , const std::shared_ptr<TlsContext>& tls_context
+        , const ThreadConfig& thread_config
+        , const SocketOptions& socket_options
         , const std::string& endpoint)
     : _market(market)
     , _key(key)
     , _secret(secret)
-    , _client()
+    , _clock_sync(clock_sync)
+    , _thread_config(thread_config)
     , _bbo_callback([](const Bbo&){})
     , _order_callback([](const Order&){})
     , _fill_callback([](const Fill&){})
     , _running(false)
+    , _stopping(false)
+    , _ever_opened(false)
+    , _reconnect_attempt(0)
+    , _rtt_histogram(RTT_WINDOW_SLOT_NS)
+    , _last_rtt_ns(0)
 {
-    _client.clear_access_channels(websocketpp::log::alevel::all);
-    _client.clear_error_channels(websocketpp::log::elevel::all);
-    _client.init_asio();
-    
-    _client.set_open_handler(boost::bind(&FtxWebSocket::OnOpen, this, &_client, boost::placeholders::_1));
-    _client.set_fail_handler(boost::bind(&FtxWebSocket::OnFail, this, &_client, boost::placeholders::_1));
-    _client.set_message_handler(boost::bind(&FtxWebSocket::OnMessage, this, &_client, boost::placeholders::_1, boost::placeholders::_2));
-    _client.set_close_handler(boost::bind(&FtxWebSocket::OnClose, this, &_client, boost::placeholders::_1));
-    _client.set_tls_init_handler(boost::bind(&FtxWebSocket::OnTlsInit));
+    WebSocketTransport::Handlers handlers;
+    handlers.on_open = [this](){ this->OnOpen(); };
+    handlers.on_fail = [this](){ this->OnFail(); };
+    handlers.on_close = [this](){ this->OnClose(); };
+    handlers.on_message = [this](const char* data, const size_t size, const uint64_t kernel_wall_ns){ this->OnMessage(data, size, kernel_wall_ns); };
+    handlers.on_pong = [this](const std::string& payload){ this->OnPong(payload); };
 
-    _client.start_perpetual();
+    _transport = MakeWebSocketTransport(endpoint, tls_context, socket_options, handlers);
 
-    websocketpp::lib::error_code ec;
-    _connection_ptr = _client.get_connection(endpoint, ec);
-    _client.connect(_connection_ptr);
+    _heartbeat_timer = std::make_unique<boost::asio::steady_timer>(_transport->GetIoContext());
+    _reconnect_timer = std::make_unique<boost::asio::steady_timer>(_transport->GetIoContext());
 
-    _receiver_thread = std::make_unique<std::thread>([this](){_client.run();});
+    _transport->Connect();
+
+    _receiver_thread = std::make_unique<std::thread>([this](){ this->RunReceiver(); });
 }
 
 FtxWebSocket::~FtxWebSocket()
 {
+    Stop();
+}
+
+void FtxWebSocket::Stop()
+{
+    if (_stopping.exchange(true))
+    {
+        return;
+    }
+
     Unsubscribe();
     
     _running = false;
-    _client.stop();
+    _transport->Stop();
     if (_receiver_thread)
     {
         _receiver_thread->join();
     }
-
-    if (_heartbeat_thread)
-    {
-        _heartbeat_thread->join();
-    }
 }
 
 void FtxWebSocket::SetBboCallback(const BboCallback_t& callback)
@@ -79,86 +112,128 @@ void FtxWebSocket::SetFillCallback(const FillCallback_t& callback)
     _fill_callback = callback;
 }
 
-FtxWebSocket::ContextPtr FtxWebSocket::OnTlsInit()
+LatencyHistogram::Snapshot FtxWebSocket::GetConnectionLatency() const
+{
+    return _rtt_histogram.GetSnapshot(clock::MonotonicNs());
+}
+
+uint64_t FtxWebSocket::GetLastRttNs() const
+{
+    return _last_rtt_ns.load(std::memory_order_relaxed);
+}
+
+FtxWebSocket::FeedStats_t FtxWebSocket::GetFeedStats() const
 {
-    ContextPtr ctx = std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::sslv23);
+    FeedStats_t stats;
 
-    try
+    for (size_t i = 0; i < stats.size(); ++i)
     {
-        ctx->set_options(
-            boost::asio::ssl::context::default_workarounds
-            | boost::asio::ssl::context::no_sslv2
-            | boost::asio::ssl::context::no_sslv3
-            | boost::asio::ssl::context::single_dh_use
-        );
+        stats[i].exchange_to_receive = _channel_histograms[i].exchange_to_receive.GetSnapshot();
+        stats[i].receive_to_callback = _channel_histograms[i].receive_to_callback.GetSnapshot();
+    }
+
+    return stats;
+}
+
+LatencyHistogram::Snapshot FtxWebSocket::GetKernelReceiveDelay() const
+{
+    return _kernel_receive_delay.GetSnapshot();
+}
+
+void FtxWebSocket::RunReceiver()
+{
+    _thread_config.Apply();
+
+    boost::asio::io_context& io = _transport->GetIoContext();
+
+    if (!_thread_config.busy_poll)
+    {
+        io.run();
+        return;
+    }
 
+    // Never sleeps in epoll_wait, so a message is picked up as soon as it is readable
+    while (!io.stopped())
+    {
+        io.poll();
     }
-    catch (std::exception &e)
+}
+
+void FtxWebSocket::ScheduleReconnect()
+{
+    if (_stopping)
     {
-        std::cout << "Error in context pointer: " << e.what() << std::endl;
+        return;
     }
-    
-    return ctx;
+
+    const int delay_ms = std::min(RECONNECT_MAX_MS, RECONNECT_BASE_MS << std::min(_reconnect_attempt, 16));
+    ++_reconnect_attempt;
+
+    _reconnect_timer->expires_after(std::chrono::milliseconds(delay_ms));
+    _reconnect_timer->async_wait(boost::bind(&FtxWebSocket::OnReconnectTimer, this, boost::placeholders::_1));
 }
 
-void FtxWebSocket::OnOpen(Client* c, websocketpp::connection_hdl hdl)
+void FtxWebSocket::OnReconnectTimer(const boost::system::error_code& ec)
 {
+    if (ec || _stopping)
+    {
+        return;
+    }
+
+    _transport->Connect();
+}
+
+void FtxWebSocket::OnOpen()
+{
+    _ever_opened = true;
+    _reconnect_attempt = 0;
     _running = true;
-    _heartbeat_thread = std::make_unique<std::thread>([this](){this->Heartbeat();});
 
     Login();
     Subscribe();
+
+    ScheduleHeartbeat();
 }
 
 void FtxWebSocket::Subscribe()
 {
-    websocketpp::lib::error_code ec;
-    _client.send(_connection_ptr->get_handle()
-            , "{\"op\":\"subscribe\",\"channel\":\"ticker\",\"market\":\"" + _market + "\"}"
-            ,  websocketpp::frame::opcode::text
-            , ec);
-
-    _client.send(_connection_ptr->get_handle()
-            , "{\"op\": \"subscribe\", \"channel\": \"fills\"}"
-            ,  websocketpp::frame::opcode::text
-            , ec);
-
-    _client.send(_connection_ptr->get_handle()
-            , "{\"op\": \"subscribe\", \"channel\": \"orders\"}"
-            ,  websocketpp::frame::opcode::text
-            , ec);
+    _transport->Send("{\"op\":\"subscribe\",\"channel\":\"ticker\",\"market\":\"" + _market + "\"}");
+    _transport->Send("{\"op\": \"subscribe\", \"channel\": \"fills\"}");
+    _transport->Send("{\"op\": \"subscribe\", \"channel\": \"orders\"}");
 }
 
 void FtxWebSocket::Unsubscribe()
 {
-    websocketpp::lib::error_code ec;
-    _client.send(_connection_ptr->get_handle()
-            , "{\"op\":\"unsubscribe\",\"channel\":\"ticker\",\"market\":\"" + _market + "\"}"
-            ,  websocketpp::frame::opcode::text
-            , ec);
-
-    _client.send(_connection_ptr->get_handle()
-            , "{\"op\": \"unsubscribe\", \"channel\": \"fills\"}"
-            ,  websocketpp::frame::opcode::text
-            , ec);
-
-    _client.send(_connection_ptr->get_handle()
-            , "{\"op\": \"unsubscribe\", \"channel\": \"orders\"}"
-            ,  websocketpp::frame::opcode::text
-            , ec);
+    _transport->Send("{\"op\":\"unsubscribe\",\"channel\":\"ticker\",\"market\":\"" + _market + "\"}");
+    _transport->Send("{\"op\": \"unsubscribe\", \"channel\": \"fills\"}");
+    _transport->Send("{\"op\": \"unsubscribe\", \"channel\": \"orders\"}");
 }
 
-void FtxWebSocket::OnFail(Client* c, websocketpp::connection_hdl hdl)
+void FtxWebSocket::OnFail()
 {
     std::cerr << "Failed to connect to websocket" << std::endl;
-    throw std::runtime_error("WS connection failure");
+
+    if (!_ever_opened)
+    {
+        throw std::runtime_error("WS connection failure");
+    }
+
+    ScheduleReconnect();
 }
 
-void FtxWebSocket::OnMessage(Client* c, websocketpp::connection_hdl hdl, MessagePtr msg)
+void FtxWebSocket::OnMessage(const char* data, const size_t size, const uint64_t kernel_wall_ns)
 {
+    const ReceiveTime receive_time{clock::MonotonicNs(), clock::WallNs()};
+
+    if (kernel_wall_ns != 0 && receive_time.wall_ns > kernel_wall_ns)
+    {
+        _kernel_receive_delay.Record(receive_time.wall_ns - kernel_wall_ns);
+    }
+
     rapidjson::Document json;
 
-    json.Parse(msg->get_payload().c_str());
+    // Parsed straight out of the transport's buffer
+    json.Parse(data, size);
 
     if (!json.HasMember("channel"))
     {
@@ -176,44 +251,68 @@ void FtxWebSocket::OnMessage(Client* c, websocketpp::connection_hdl hdl, Message
 
     if (channel == "ticker")
     {
-        CreateAndSendBboUpdate(json);
+        CreateAndSendBboUpdate(json, receive_time);
     }
     else if (channel == "orders")
     {
-        CreateAndSendOrderUpdate(json);
+        CreateAndSendOrderUpdate(json, receive_time);
     }
     else if (channel == "fills")
     {
-        CreateAndSendFillUpdate(json);
+        CreateAndSendFillUpdate(json, receive_time);
     }
 }
 
-void FtxWebSocket::OnClose(Client* c, websocketpp::connection_hdl hdl)
+void FtxWebSocket::OnClose()
 {
     std::cout << "WS connection closed" << std::endl;
+
+    _running = false;
+    ScheduleReconnect();
 }
 
-void FtxWebSocket::Heartbeat()
+void FtxWebSocket::OnPong(const std::string& payload)
 {
-    static constexpr const int HEARTBEAT_PERIOD_S = 10;
-    static constexpr const char* HB_STRING = "{\"op\":\"ping\"}";
+    // The ping payload carries the monotonic send time, so no per-ping state is kept
+    const uint64_t now_ns = clock::MonotonicNs();
+    const uint64_t sent_ns = std::strtoull(payload.c_str(), nullptr, 10);
 
-    while (_running)
+    if (sent_ns == 0 || sent_ns > now_ns)
     {
-        std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-        struct std::tm* next_hb_time = std::localtime(&now);
-        next_hb_time->tm_sec += HEARTBEAT_PERIOD_S;
+        return;
+    }
 
-        websocketpp::lib::error_code ec;
-        _client.send(_connection_ptr->get_handle(), HB_STRING, websocketpp::frame::opcode::text, ec);
+    const uint64_t rtt_ns = now_ns - sent_ns;
+    _last_rtt_ns.store(rtt_ns, std::memory_order_relaxed);
+    _rtt_histogram.Record(now_ns, rtt_ns);
+}
 
-        std::this_thread::sleep_until(std::chrono::system_clock::from_time_t(mktime(next_hb_time)));
+void FtxWebSocket::ScheduleHeartbeat()
+{
+    _heartbeat_timer->expires_after(std::chrono::seconds(HEARTBEAT_PERIOD_S));
+    _heartbeat_timer->async_wait(boost::bind(&FtxWebSocket::OnHeartbeatTimer, this, boost::placeholders::_1));
+}
+
+void FtxWebSocket::OnHeartbeatTimer(const boost::system::error_code& ec)
+{
+    static constexpr const char* HB_STRING = "{\"op\":\"ping\"}";
+
+    if (ec || !_running)
+    {
+        return;
     }
+
+    // Runs on the io thread, so sends here never contend with the receive path.
+    // The exchange still expects its application level ping to keep the session alive.
+    _transport->Ping(std::to_string(clock::MonotonicNs()));
+    _transport->Send(HB_STRING);
+
+    ScheduleHeartbeat();
 }
 
 void FtxWebSocket::Login()
 {
-    const int64_t time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    const int64_t time_ms = _clock_sync->NowMs();
 
     rapidjson::StringBuffer buffer;
     rapidjson::Writer<rapidjson::StringBuffer> login_json(buffer);
@@ -230,7 +329,7 @@ void FtxWebSocket::Login()
     login_json.String(_key.c_str());
 
     login_json.Key("sign");
-    login_json.String(HmacSha256(std::to_string(time_ms) + "websocket_login", _secret).c_str());
+    login_json.String(crypto::HmacSha256(std::to_string(time_ms) + "websocket_login", _secret).c_str());
 
     login_json.Key("time");
     login_json.Int64(time_ms);
@@ -238,22 +337,26 @@ void FtxWebSocket::Login()
     login_json.EndObject();
     login_json.EndObject();
 
-    websocketpp::lib::error_code ec;
-    _client.send(_connection_ptr->get_handle(), buffer.GetString(),  websocketpp::frame::opcode::text, ec);
+    _transport->Send(buffer.GetString());
 }
 
-void FtxWebSocket::CreateAndSendBboUpdate(const rapidjson::Document& json)
+void FtxWebSocket::CreateAndSendBboUpdate(const rapidjson::Document& json, const ReceiveTime& receive_time)
 {
     ws::Bbo bbo;
     bbo.price.bid = json["data"]["bid"].GetDouble();
     bbo.price.ask = json["data"]["ask"].GetDouble();
     bbo.size.bid = json["data"]["bidSize"].GetDouble();
     bbo.size.ask = json["data"]["askSize"].GetDouble();
+    bbo.receive_time_ns = receive_time.monotonic_ns;
+    bbo.exchange_time_ns = ExchangeTimeToNs(json["data"]["time"].GetDouble());
+
+    RecordExchangeLatency(Channel::TICKER, receive_time, bbo.exchange_time_ns);
+    RecordCallbackLatency(Channel::TICKER, receive_time);
 
     _bbo_callback(bbo);
 }
 
-void FtxWebSocket::CreateAndSendOrderUpdate(const rapidjson::Document& json)
+void FtxWebSocket::CreateAndSendOrderUpdate(const rapidjson::Document& json, const ReceiveTime& receive_time)
 {
     Order order;
 
@@ -271,13 +374,64 @@ void FtxWebSocket::CreateAndSendOrderUpdate(const rapidjson::Document& json)
     order.filled_size = data["filledSize"].GetDouble();
     order.remaining_size = data["remainingSize"].GetDouble();
     order.status = Order::StatusFromString(data["status"].GetString());
+    order.receive_time_ns = receive_time.monotonic_ns;
+    order.exchange_time_ns = 0;
+
+    RecordCallbackLatency(Channel::ORDERS, receive_time);
 
     _order_callback(order);
 }
 
-void FtxWebSocket::CreateAndSendFillUpdate(const rapidjson::Document& json)
+void FtxWebSocket::CreateAndSendFillUpdate(const rapidjson::Document& json, const ReceiveTime& receive_time)
+{
+    Fill fill;
+
+    const auto& data = json["data"];
+
+    fill.fee = data["fee"].GetDouble();
+    fill.fee_rate = data["feeRate"].GetDouble();
+    fill.market = data["market"].GetString();
+    fill.order_id = data["orderId"].GetInt64();
+
+    // Fills that are not from a trade have no trade id; their own id is just as unique
+    const auto& trade_id = data["tradeId"];
+    fill.trade_id = trade_id.IsInt64() ? trade_id.GetInt64() : data["id"].GetInt64();
+
+    fill.price = data["price"].GetDouble();
+    fill.size = data["size"].GetDouble();
+    fill.side = SideFromString(data["side"].GetString());
+    fill.receive_time_ns = receive_time.monotonic_ns;
+
+    // An ISO 8601 string here, unlike the ticker's seconds
+    fill.exchange_time_ns = 0;
+    const auto& time = data["time"];
+    if (time.IsString() && !ClockSync::ParseIso8601(time.GetString(), fill.exchange_time_ns))
+    {
+        fill.exchange_time_ns = 0;
+    }
+
+    RecordExchangeLatency(Channel::FILLS, receive_time, fill.exchange_time_ns);
+    RecordCallbackLatency(Channel::FILLS, receive_time);
+
+    _fill_callback(fill);
+}
+
+void FtxWebSocket::RecordExchangeLatency(const Channel channel, const ReceiveTime& receive_time, const uint64_t exchange_time_ns)
+{
+    const uint64_t receive_server_ns = receive_time.wall_ns + _clock_sync->GetOffsetNs();
+
+    // Residual clock error can still put the exchange time ahead of ours, which says nothing useful about the network
+    if (exchange_time_ns == 0 || exchange_time_ns > receive_server_ns)
+    {
+        return;
+    }
+
+    _channel_histograms[static_cast<int>(channel)].exchange_to_receive.Record(receive_server_ns - exchange_time_ns);
+}
+
+void FtxWebSocket::RecordCallbackLatency(const Channel channel, const ReceiveTime& receive_time)
 {
-    // TODO: This is not 100% necessary since this information can be gleaned from orders
+    _channel_histograms[static_cast<int>(channel)].receive_to_callback.Record(clock::MonotonicNs() - receive_time.monotonic_ns);
 }
 
 } // namespace ws
@@ -1,12 +1,16 @@
 #include "Gateway.h"
 
+#include <algorithm>
+#include <array>
 #include <chrono>
-
-#include <rapidjson/stringbuffer.h>
-#include <rapidjson/writer.h>
-
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
 #include <thread>
 
+#include "Clock.h"
+
 namespace ftx
 {
 
@@ -18,6 +22,70 @@ static inline bool Equal(const double a, const double b, const double epsilon =
     return std::fabs(a - b) < epsilon;
 }
 
+// Connections are warmed first so the clock samples see steady state round trips
+static std::shared_ptr<const ClockSync> WarmUpAndSyncClock(const FtxAPI& api)
+{
+    if (!api.WarmUp())
+    {
+        std::cerr << "Failed to warm up REST connections, the first requests will connect on demand" << std::endl;
+    }
+
+    api.SyncClock();
+    return api.GetClockSync();
+}
+
+static const Gateway::DebounceConfig& CheckDebounceConfig(const Gateway::DebounceConfig& config)
+{
+    if (config.max_window_ns != 0 && config.min_window_ns > config.max_window_ns)
+    {
+        throw std::invalid_argument("Debounce min_window_ns is above max_window_ns");
+    }
+
+    // The flicker estimate starts at the minimum window divided by it; written so NaN fails too
+    if (!(config.flicker_multiple > 0.0))
+    {
+        throw std::invalid_argument("Debounce flicker_multiple must be positive");
+    }
+
+    return config;
+}
+
+static RequestScheduler::Request MakeRequest(const RequestScheduler::Priority priority
+        , const RequestScheduler::Encoder_t& encode
+        , const uint64_t supersede_key = 0)
+{
+    RequestScheduler::Request request;
+    request.priority = priority;
+    request.encode = encode;
+    request.supersede_key = supersede_key;
+
+    // Orders carry a client id and cancels are idempotent, so a duplicate is harmless
+    request.hedge = true;
+    return request;
+}
+
+// Whether an order lookup result has every field an order update is built from
+static bool IsOrderResult(const rapidjson::Value& result)
+{
+    if (!result.IsObject()
+            || !result.HasMember("id") || !result["id"].IsInt64()
+            || !result.HasMember("status") || !result["status"].IsString())
+    {
+        return false;
+    }
+
+    for (const char* field : {"size", "filledSize", "remainingSize"})
+    {
+        if (!result.HasMember(field) || !result[field].IsNumber())
+        {
+            return false;
+        }
+    }
+
+    const std::string_view status = result["status"].GetString();
+    return status == "new" || status == "open" || status == "closed";
+}
+
 static inline double GetSlippagePercentage(const ws::Side side, const double order_price, const double fill_price)
 {
     return 100 * (side == ws::Side::BUY
@@ -28,19 +96,88 @@ static inline double GetSlippagePercentage(const ws::Side side, const double ord
 }
 
 Gateway::Gateway(const std::string& key, const std::string& secret, const std::string& market)
-    : _api(key, secret)
-    , _web_socket(market, key, secret)
+    : Gateway(key, secret, market, Config())
+{}
+
+Gateway::Gateway(const std::string& key, const std::string& secret, const std::string& market, const Config& config)
+    : _tls_context(std::make_shared<TlsContext>())
+    , _api(key, secret, FtxAPI::DEFAULT_ENDPOINT, config.api, _tls_context)
+    , _encoder(_api.GetEndpoint(), market, secret, _api.GetClockSync())
+    , _scheduler(_api, config.scheduler)
+    , _feed(market, key, secret, WarmUpAndSyncClock(_api), _tls_context, config.feed_threads, config.feed_socket_options)
     , _market(market)
-    , _next_order_id(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count())
+    , _bulk_cancel_threshold(config.bulk_cancel_threshold)
+    , _next_order_id(clock::WallNs())
+    , _debounce_config(CheckDebounceConfig(config.debounce))
+    , _debounce_running(true)
+    , _pending_since_ns(0)
+    , _pending_immediate(false)
+    , _flicker_ns(_debounce_config.min_window_ns / _debounce_config.flicker_multiple)
+    , _last_requote_ns(0)
+    , _debounce_window_ns(config.debounce.min_window_ns)
+    , _bbo_updates(0)
+    , _deferred_updates(0)
+    , _suppressed_updates(0)
+    , _immediate_updates(0)
+    , _expired_updates(0)
+    , _pacing_config(config.pacing)
+    , _cancel_ack_ns(0)
+    , _order_ack_ns(0)
+    , _round_trip_ns(0)
+    , _requote_interval_ns(config.pacing.min_interval_ns)
+    , _window_floor_ns(0)
+    , _requotes(0)
+    , _paced_requotes(0)
+    , _execution_config(config.execution)
+    , _time_budget_expired(0)
+    , _requote_budget_expired(0)
+    , _ioc_orders(0)
+    , _timeout_config(config.timeouts)
+    , _ack_timeouts(0)
+    , _cancel_timeouts(0)
+    , _reconciled_updates(0)
+    , _lost_orders(0)
+    , _queue_config(config.queue)
+    , _kept_orders(0)
+    , _rejoined_orders(0)
+    , _timers(config.timers)
 {
+    // Here rather than on the first clock read, which may be on the feed or an order path
+    clock::Calibrate();
+
     SetInitialMarketData();
+
+    _debounce_thread = std::thread([this]()
+    {
+        _debounce_config.thread.Apply();
+        this->RunDebounce();
+    });
+
     SetWebsocketCallbacks();
     _running = true;
 }
 
 Gateway::~Gateway()
 {
+    // Every thread that calls back into the gateway is stopped before any member goes away;
+    // order handling still in flight meanwhile sends nothing new
+    _running = false;
+
+    _feed.Stop();
+
+    {
+        std::lock_guard<std::mutex> lock(_bbo_mtx);
+        _debounce_running = false;
+    }
+
+    _debounce_cv.notify_all();
+    _debounce_thread.join();
+
+    _timers.Stop();
+
     CancelAll();
+
+    _scheduler.Stop();
 }
 
 void Gateway::SetInitialMarketData()
@@ -57,17 +194,22 @@ void Gateway::SetInitialMarketData()
 
     _tick_price = result["priceIncrement"].GetDouble();
 
+    _encoder.SetPriceIncrement(_tick_price);
+    _encoder.SetSizeIncrement(result["sizeIncrement"].GetDouble());
+
     std::lock_guard<std::mutex> lock(_bbo_mtx);
     _current_bbo.price.bid = result["bid"].GetDouble();
     _current_bbo.price.ask = result["ask"].GetDouble();
     _current_bbo.size.bid = 1;
     _current_bbo.size.ask = 1;
+    _latest_bbo = _current_bbo;
+    _queue_bbo = _current_bbo;
 }
 
 void Gateway::SetWebsocketCallbacks()
 {
-    _web_socket.SetBboCallback([this](const ws::Bbo& bbo){this->OnBboUpdate(bbo);});
-    _web_socket.SetOrderCallback([this](const ws::Order& order){this->OnOrderUpdate(order);});
+    _feed.SetBboCallback([this](const ws::Bbo& bbo){this->OnBboUpdate(bbo);});
+    _feed.SetOrderCallback([this](const ws::Order& order){this->OnOrderUpdate(order);});
 }
 
 void Gateway::SendMarketOrder(const ws::Side side, const double size)
@@ -75,6 +217,136 @@ void Gateway::SendMarketOrder(const ws::Side side, const double size)
     SendMarketOrder(side, size, _next_order_id.fetch_add(1), true);
 }
 
+RequestScheduler::Stats Gateway::GetSchedulerStats() const
+{
+    return _scheduler.GetStats();
+}
+
+std::shared_ptr<RestLatencyStats> Gateway::GetRestLatencyStats() const
+{
+    return _api.GetLatencyStats();
+}
+
+ConnectionPool::Stats Gateway::GetConnectionStats() const
+{
+    return _api.GetConnectionStats();
+}
+
+TlsContext::Stats Gateway::GetTlsStats() const
+{
+    return _tls_context->GetStats();
+}
+
+RequestHedger::Stats Gateway::GetHedgeStats() const
+{
+    return _api.GetHedgeStats();
+}
+
+HttpClient::Stats Gateway::GetHttpClientStats() const
+{
+    return _api.GetHttpClientStats();
+}
+
+Http2Client::Stats Gateway::GetHttp2ClientStats() const
+{
+    return _api.GetHttp2ClientStats();
+}
+
+std::vector<ws::RedundantFeed::ConnectionStats> Gateway::GetFeedArbitrationStats() const
+{
+    return _feed.GetStats();
+}
+
+ws::MessagePool::Stats Gateway::GetMessagePoolStats() const
+{
+    return ws::MessagePool::GetStats();
+}
+
+clock::Stats Gateway::GetClockStats() const
+{
+    return clock::GetStats();
+}
+
+Gateway::PacingStats Gateway::GetPacingStats() const
+{
+    PacingStats stats;
+
+    stats.cancel_ack = _cancel_ack.GetSnapshot();
+    stats.new_order_ack = _order_ack.GetSnapshot();
+    stats.round_trip_ns = _round_trip_ns.load(std::memory_order_relaxed);
+    stats.requote_interval_ns = _requote_interval_ns.load(std::memory_order_relaxed);
+    stats.window_floor_ns = _window_floor_ns.load(std::memory_order_relaxed);
+    stats.requotes = _requotes.load(std::memory_order_relaxed);
+    stats.paced = _paced_requotes.load(std::memory_order_relaxed);
+
+    return stats;
+}
+
+Gateway::ExecutionStats Gateway::GetExecutionStats() const
+{
+    ExecutionStats stats;
+
+    stats.time_budget_expired = _time_budget_expired.load(std::memory_order_relaxed);
+    stats.requote_budget_expired = _requote_budget_expired.load(std::memory_order_relaxed);
+    stats.ioc_orders = _ioc_orders.load(std::memory_order_relaxed);
+    stats.timers = _timers.GetStats();
+
+    return stats;
+}
+
+Gateway::TimeoutStats Gateway::GetTimeoutStats() const
+{
+    TimeoutStats stats;
+
+    stats.ack_timeouts = _ack_timeouts.load(std::memory_order_relaxed);
+    stats.cancel_timeouts = _cancel_timeouts.load(std::memory_order_relaxed);
+    stats.reconciled = _reconciled_updates.load(std::memory_order_relaxed);
+    stats.lost = _lost_orders.load(std::memory_order_relaxed);
+
+    return stats;
+}
+
+Gateway::QueueStats Gateway::GetQueueStats() const
+{
+    QueueStats stats;
+
+    stats.kept = _kept_orders.load(std::memory_order_relaxed);
+    stats.rejoined = _rejoined_orders.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(_orders_mtx);
+    for (const auto& [client_id, order_ptr] : _orders)
+    {
+        if (order_ptr->state != OutstandingOrder::State::RESTING)
+        {
+            continue;
+        }
+
+        stats.orders.push_back(QueuePosition{client_id
+                , order_ptr->side
+                , order_ptr->price
+                , order_ptr->size
+                , order_ptr->queue_ahead
+                , order_ptr->level_size});
+    }
+
+    return stats;
+}
+
+Gateway::DebounceStats Gateway::GetDebounceStats() const
+{
+    DebounceStats stats;
+
+    stats.updates = _bbo_updates.load(std::memory_order_relaxed);
+    stats.deferred = _deferred_updates.load(std::memory_order_relaxed);
+    stats.suppressed = _suppressed_updates.load(std::memory_order_relaxed);
+    stats.immediate = _immediate_updates.load(std::memory_order_relaxed);
+    stats.expired = _expired_updates.load(std::memory_order_relaxed);
+    stats.window_ns = _debounce_window_ns.load(std::memory_order_relaxed);
+    stats.delay = _debounce_delay.GetSnapshot();
+
+    return stats;
+}
+
 void Gateway::SendMarketOrder(const ws::Side side, const double size, const uint64_t client_id, const bool new_order)
 {
     if (!_running)
@@ -82,7 +354,8 @@ void Gateway::SendMarketOrder(const ws::Side side, const double size, const uint
         return;
     }
 
-    const double order_price = side == ws::Side::BUY ? _current_bbo.price.bid + _tick_price : _current_bbo.price.ask - _tick_price;
+    const ws::Bbo bbo = GetBbo();
+    const double order_price = GetQuotePrice(side, bbo);
 
     if (new_order)
     {
@@ -99,80 +372,642 @@ void Gateway::SendMarketOrder(const ws::Side side, const double size, const uint
         order_ptr->filled_size = 0.0;
 
         order_ptr->original_order_price = order_price;
-        order_ptr->original_market_price = side == ws::Side::BUY ? _current_bbo.price.ask : _current_bbo.price.bid;
+        order_ptr->original_market_price = side == ws::Side::BUY ? bbo.price.ask : bbo.price.bid;
 
         order_ptr->side = side;
 
-        using namespace std::chrono;
-        order_ptr->original_time_ns = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+        order_ptr->original_time_ns = clock::MonotonicNs();
+        order_ptr->sent_ns = order_ptr->original_time_ns;
+        order_ptr->cancel_ns = 0;
 
         order_ptr->queued_count = 1;
 
+        order_ptr->aggressive = false;
+        order_ptr->ioc = false;
+        order_ptr->deadline_timer = 0;
+        order_ptr->timeout_timer = 0;
+
+        order_ptr->price = order_price;
+        order_ptr->size = size;
+        order_ptr->queue_ahead = 0.0;
+        order_ptr->level_size = 0.0;
+
         order_ptr->state = OutstandingOrder::State::SENT;
+
+        std::lock_guard<std::mutex> lock(_orders_mtx);
+        ArmTimeout(order_ptr, order_ptr->sent_ns);
+
+        if (_execution_config.time_budget_ns != 0)
+        {
+            order_ptr->deadline_timer = _timers.Schedule(order_ptr->original_time_ns + _execution_config.time_budget_ns
+                    , [this, order_ptr]() { OnExecutionDeadline(order_ptr); });
+        }
     }
     
-    rapidjson::StringBuffer buffer;
-    rapidjson::Writer<rapidjson::StringBuffer> body_writer(buffer);
+    auto request = MakeRequest(RequestScheduler::Priority::NEW_ORDER
+            , [this, side, order_price, size, client_id]() -> const EncodedRequest&
+            {
+                return _encoder.EncodeNewOrder(side, order_price, size, client_id);
+            }
+            , client_id);
 
-    body_writer.StartObject();
-    
-    body_writer.Key("market");
-    body_writer.String(_market.c_str());
+    // An order still waiting in the queue when the BBO moves would join a stale price, so it
+    // is dropped at dispatch and re-sent at the current one under the same client id
+    request.is_current = [this, side, order_price]()
+    {
+        return Equal(GetQuotePrice(side, GetBbo()), order_price);
+    };
+    request.on_dropped = [this, side, size, client_id](const RequestScheduler::DropReason reason)
+    {
+        if (reason == RequestScheduler::DropReason::STALE)
+        {
+            SendMarketOrder(side, size, client_id, false);
+        }
+    };
+
+    _scheduler.Submit(std::move(request));
+}
+
+void Gateway::SendIocOrder(const ws::Side side, const double size, const uint64_t client_id)
+{
+    if (!_running)
+    {
+        return;
+    }
+
+    const ws::Bbo bbo = GetBbo();
+    const double through = _execution_config.ioc_ticks * _tick_price;
+    const double order_price = side == ws::Side::BUY ? bbo.price.ask + through : bbo.price.bid - through;
+
+    ++_ioc_orders;
+
+    // Never stale: it is meant to take whatever the price is by the time it goes out
+    _scheduler.Submit(MakeRequest(RequestScheduler::Priority::NEW_ORDER
+            , [this, side, order_price, size, client_id]() -> const EncodedRequest&
+            {
+                return _encoder.EncodeIocOrder(side, order_price, size, client_id);
+            }
+            , client_id));
+}
+
+void Gateway::OnExecutionDeadline(const std::shared_ptr<OutstandingOrder>& outstanding_order)
+{
+    std::lock_guard<std::mutex> lock(_orders_mtx);
+
+    // Filled in the meantime
+    const auto order_iter = _orders.find(outstanding_order->client_id);
+    if (order_iter == std::end(_orders) || order_iter->second != outstanding_order || outstanding_order->aggressive)
+    {
+        return;
+    }
+
+    ++_time_budget_expired;
+    outstanding_order->aggressive = true;
+    Expedite(outstanding_order);
+}
+
+void Gateway::Expedite(const std::shared_ptr<OutstandingOrder>& outstanding_order)
+{
+    // Orders still on their way in are cancelled once they open, and one already being
+    // cancelled is replaced by an IOC order when it closes
+    if (!outstanding_order->aggressive
+            || outstanding_order->ioc
+            || outstanding_order->state != OutstandingOrder::State::RESTING)
+    {
+        return;
+    }
+
+    outstanding_order->state = OutstandingOrder::State::PENDING_CANCEL;
+    outstanding_order->cancel_ns = clock::MonotonicNs();
+    ArmTimeout(outstanding_order, outstanding_order->cancel_ns);
+    _scheduler.Submit(MakeCancel(outstanding_order->client_id));
+}
+
+void Gateway::ArmTimeout(const std::shared_ptr<OutstandingOrder>& outstanding_order, const uint64_t start_ns)
+{
+    DisarmTimeout(*outstanding_order);
+
+    uint64_t timeout_ns = 0;
+    switch (outstanding_order->state)
+    {
+    case OutstandingOrder::State::SENT:
+        timeout_ns = _timeout_config.ack_timeout_ns;
+        break;
+    case OutstandingOrder::State::PENDING_CANCEL:
+        timeout_ns = _timeout_config.cancel_timeout_ns;
+        break;
+
+    default:
+        break;
+    }
+
+    if (timeout_ns == 0)
+    {
+        return;
+    }
+
+    // The client id changes each time the order is re-sent, which tells a timeout of an
+    // earlier child order apart
+    const uint64_t client_id = outstanding_order->client_id;
+    outstanding_order->timeout_timer = _timers.Schedule(start_ns + timeout_ns
+            , [this, outstanding_order, client_id]() { OnOrderTimeout(outstanding_order, client_id); });
+}
+
+void Gateway::DisarmTimeout(OutstandingOrder& outstanding_order)
+{
+    if (outstanding_order.timeout_timer != 0)
+    {
+        _timers.Cancel(outstanding_order.timeout_timer);
+        outstanding_order.timeout_timer = 0;
+    }
+}
+
+void Gateway::OnOrderTimeout(const std::shared_ptr<OutstandingOrder>& outstanding_order, const uint64_t client_id)
+{
+    std::lock_guard<std::mutex> lock(_orders_mtx);
+
+    if (outstanding_order->client_id != client_id)
+    {
+        return;
+    }
+
+    switch (outstanding_order->state)
+    {
+    case OutstandingOrder::State::SENT:
+        ++_ack_timeouts;
+        break;
+    case OutstandingOrder::State::PENDING_CANCEL:
+        ++_cancel_timeouts;
+        break;
+
+    default:
+        return;
+    }
+
+    std::cerr << "Order " << client_id << " timed out in state " << static_cast<int>(outstanding_order->state)
+        << ", looking up its status" << std::endl;
+
+    // Armed again so a lookup that gets lost too is retried
+    outstanding_order->timeout_timer = 0;
+    ArmTimeout(outstanding_order, clock::MonotonicNs());
+
+    auto request = MakeRequest(RequestScheduler::Priority::QUERY
+            , [this, client_id]() -> const EncodedRequest& { return _encoder.EncodeOrderStatus(client_id); }
+            , client_id);
+
+    // Applied on the timer thread rather than the worker: an update that disables trading
+    // cancels everything through the scheduler and waits for it, which must not tie up a worker
+    request.on_response = [this, outstanding_order, client_id](const FtxAPI::Response_t& response)
+    {
+        auto copy = std::make_shared<FtxAPI::Response_t>();
+        copy->CopyFrom(response, copy->GetAllocator());
+
+        _timers.Schedule(clock::MonotonicNs(), [this, outstanding_order, client_id, copy]()
+        {
+            try
+            {
+                Reconcile(outstanding_order, client_id, *copy);
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << "Failed to apply the status of order " << client_id << ": " << e.what() << std::endl;
+            }
+        });
+    };
+
+    _scheduler.Submit(std::move(request));
+}
+
+void Gateway::Reconcile(const std::shared_ptr<OutstandingOrder>& outstanding_order
+        , const uint64_t client_id
+        , const FtxAPI::Response_t& response)
+{
+    if (!response.IsObject() || !response.HasMember("success") || !response["success"].IsBool())
+    {
+        // The timeout retries
+        return;
+    }
+
+    std::lock_guard<std::mutex> updates_lock(_order_updates_mtx);
+
+    ws::Order order;
+    OutstandingOrder::State state;
+
+    {
+        std::lock_guard<std::mutex> lock(_orders_mtx);
+
+        // The websocket caught up in the meantime
+        if (outstanding_order->client_id != client_id
+                || (outstanding_order->state != OutstandingOrder::State::SENT
+                    && outstanding_order->state != OutstandingOrder::State::PENDING_CANCEL))
+        {
+            return;
+        }
+
+        state = outstanding_order->state;
+
+        order.order_id = 0;
+        order.client_id = std::to_string(client_id);
+        order.market = _market;
+        order.side = outstanding_order->side;
+        order.price = outstanding_order->original_order_price;
+        order.size = outstanding_order->original_size - outstanding_order->filled_size;
+        order.filled_size = 0.0;
+        order.remaining_size = order.size;
+        order.status = ws::Order::Status::CLOSED;
+        order.receive_time_ns = clock::MonotonicNs();
+        order.exchange_time_ns = 0;
+    }
+
+    if (!response["success"].GetBool())
+    {
+        const bool not_found = response.HasMember("error") && response["error"].IsString()
+            && std::string_view(response["error"].GetString()).find("not found") != std::string_view::npos;
+
+        if (!not_found || state != OutstandingOrder::State::SENT)
+        {
+            return;
+        }
+
+        // The new order never made it. It is cancelled as well in case it still turns up,
+        // and closed unfilled so the rest is re-sent under a new client id.
+        std::cerr << "Order " << client_id << " is unknown to the exchange, re-sending it" << std::endl;
+        ++_lost_orders;
+        _scheduler.Submit(MakeCancel(client_id));
+
+        {
+            std::lock_guard<std::mutex> lock(_orders_mtx);
+            _reconciled.insert(client_id);
+        }
+
+        ApplyOrderUpdate(order, true);
+        return;
+    }
 
-    body_writer.Key("side");
-    body_writer.String(ws::SideToString(side).c_str());
+    if (!response.HasMember("result") || !IsOrderResult(response["result"]))
+    {
+        std::cerr << "Malformed status for order " << client_id << std::endl;
+        return;
+    }
 
-    body_writer.Key("price");
-    body_writer.Double(order_price);
+    const auto& result = response["result"];
 
-    body_writer.Key("type");
-    body_writer.String("limit");
+    order.order_id = result["id"].GetInt64();
+    order.price = result["price"].IsNumber() ? result["price"].GetDouble() : order.price;
+    order.size = result["size"].GetDouble();
+    order.filled_size = result["filledSize"].GetDouble();
+    order.remaining_size = result["remainingSize"].GetDouble();
+    order.status = ws::Order::StatusFromString(result["status"].GetString());
 
-    body_writer.Key("size");
-    body_writer.Double(size);
+    // A cancel that has not been worked off yet is sent again
+    if (state == OutstandingOrder::State::PENDING_CANCEL && order.status != ws::Order::Status::CLOSED)
+    {
+        _scheduler.Submit(MakeCancel(client_id));
+        return;
+    }
 
-    body_writer.Key("reduceOnly");
-    body_writer.Bool(false);
+    ++_reconciled_updates;
 
-    body_writer.Key("ioc");
-    body_writer.Bool(false);
+    {
+        std::lock_guard<std::mutex> lock(_orders_mtx);
+        _reconciled.insert(client_id);
+    }
 
-    body_writer.Key("postOnly");
-    body_writer.Bool(true);
+    // The updates the websocket skipped, in order
+    if (order.status == ws::Order::Status::OPEN)
+    {
+        ws::Order acked = order;
+        acked.status = ws::Order::Status::NEW;
+        ApplyOrderUpdate(acked, true);
+    }
 
-    body_writer.Key("clientId");
-    body_writer.String(std::to_string(client_id).c_str());
+    ApplyOrderUpdate(order, true);
+}
 
-    body_writer.EndObject();
+ws::Bbo Gateway::GetBbo()
+{
+    std::lock_guard<std::mutex> lock(_bbo_mtx);
+    return _current_bbo;
+}
 
-    _api.PostRequest("/orders", buffer.GetString());
+double Gateway::GetQuotePrice(const ws::Side side, const ws::Bbo& bbo) const
+{
+    return side == ws::Side::BUY ? bbo.price.bid + _tick_price : bbo.price.ask - _tick_price;
 }
 
 void Gateway::OnBboUpdate(const ws::Bbo& bbo)
 {
-    ws::Bbo old_bbo;
+    {
+        std::lock_guard<std::mutex> lock(_orders_mtx);
+        UpdateQueuePositions(bbo);
+    }
 
     {
         std::lock_guard<std::mutex> lock(_bbo_mtx);
-        old_bbo = _current_bbo;
+        if (!Debounce(bbo))
+        {
+            return;
+        }
+    }
+
+    Requote();
+}
+
+bool Gateway::Debounce(const ws::Bbo& bbo)
+{
+    ++_bbo_updates;
+    _latest_bbo = bbo;
+
+    const uint64_t now_ns = clock::MonotonicNs();
+
+    // Orders only care about prices; a size change alone never needs a requote
+    if (Equal(bbo.price.bid, _current_bbo.price.bid) && Equal(bbo.price.ask, _current_bbo.price.ask))
+    {
+        if (_pending_since_ns != 0)
+        {
+            ++_suppressed_updates;
+            AdaptDebounceWindow(now_ns - _pending_since_ns);
+            _pending_since_ns = 0;
+            _pending_immediate = false;
+        }
+
         _current_bbo = bbo;
+        return false;
+    }
+
+    const double ticks = std::max(std::fabs(bbo.price.bid - _current_bbo.price.bid)
+            , std::fabs(bbo.price.ask - _current_bbo.price.ask)) / _tick_price;
+
+    if (_debounce_config.max_window_ns == 0 || ticks + 1e-9 >= _debounce_config.immediate_ticks)
+    {
+        if (now_ns >= _last_requote_ns + _requote_interval_ns.load(std::memory_order_relaxed))
+        {
+            ++_immediate_updates;
+            ++_requotes;
+            _pending_since_ns = 0;
+            _pending_immediate = false;
+            _last_requote_ns = now_ns;
+            _current_bbo = bbo;
+            return true;
+        }
+
+        // Too soon after the last requote; it goes as soon as the interval allows
+        _pending_immediate = true;
+    }
+
+    // The window runs from the first change, so a ticker that keeps moving within it is
+    // still acted on in bounded time
+    if (_pending_since_ns == 0)
+    {
+        ++_deferred_updates;
+        _pending_since_ns = now_ns;
+    }
+
+    _debounce_cv.notify_one();
+    return false;
+}
+
+void Gateway::AdaptDebounceWindow(const uint64_t flicker_ns)
+{
+    static constexpr const double WEIGHT = 0.1;
+
+    // Every change is acted on at once, there is no window to adapt
+    if (_debounce_config.max_window_ns == 0)
+    {
+        return;
+    }
+
+    _flicker_ns += WEIGHT * (static_cast<double>(flicker_ns) - _flicker_ns);
+
+    const double window_ns = _flicker_ns * _debounce_config.flicker_multiple;
+    _debounce_window_ns = std::clamp(static_cast<uint64_t>(window_ns), _debounce_config.min_window_ns, _debounce_config.max_window_ns);
+}
+
+void Gateway::RunDebounce()
+{
+    std::unique_lock<std::mutex> lock(_bbo_mtx);
+
+    while (_debounce_running)
+    {
+        if (_pending_since_ns == 0)
+        {
+            _debounce_cv.wait(lock);
+            continue;
+        }
+
+        bool paced = false;
+        const uint64_t now_ns = clock::MonotonicNs();
+        const uint64_t deadline_ns = RequoteDeadline(paced);
+
+        if (now_ns < deadline_ns)
+        {
+            _debounce_cv.wait_for(lock, std::chrono::nanoseconds(deadline_ns - now_ns));
+            continue;
+        }
+
+        // The change outlasted the window, or the interval since the last requote passed
+        ++_expired_updates;
+        ++_requotes;
+        if (paced)
+        {
+            ++_paced_requotes;
+        }
+
+        _debounce_delay.Record(now_ns - _pending_since_ns);
+        _pending_since_ns = 0;
+        _pending_immediate = false;
+        _last_requote_ns = now_ns;
+        _current_bbo = _latest_bbo;
+
+        lock.unlock();
+        Requote();
+        lock.lock();
+    }
+}
+
+uint64_t Gateway::RequoteDeadline(bool& paced) const
+{
+    const uint64_t paced_ns = _last_requote_ns + _requote_interval_ns.load(std::memory_order_relaxed);
+
+    // The adaptive window, raised to the pacing floor
+    const uint64_t window_ns = std::min(std::max(_debounce_window_ns.load(std::memory_order_relaxed)
+            , _window_floor_ns.load(std::memory_order_relaxed)), _debounce_config.max_window_ns);
+    const uint64_t debounced_ns = _pending_immediate ? _pending_since_ns : _pending_since_ns + window_ns;
+
+    paced = paced_ns > debounced_ns;
+    return std::max(paced_ns, debounced_ns);
+}
+
+void Gateway::RecordAck(LatencyHistogram& histogram, double& average_ns, const uint64_t latency_ns)
+{
+    histogram.Record(latency_ns);
+
+    average_ns = average_ns == 0
+        ? static_cast<double>(latency_ns)
+        : average_ns + _pacing_config.weight * (static_cast<double>(latency_ns) - average_ns);
+
+    const double round_trip_ns = _cancel_ack_ns + _order_ack_ns;
+    const uint64_t interval_ns = static_cast<uint64_t>(round_trip_ns * _pacing_config.interval_multiple);
+
+    _round_trip_ns = static_cast<uint64_t>(round_trip_ns);
+    _requote_interval_ns = std::clamp(interval_ns, _pacing_config.min_interval_ns, _pacing_config.max_interval_ns);
+    _window_floor_ns = static_cast<uint64_t>(_cancel_ack_ns * _pacing_config.window_multiple);
+}
+
+void Gateway::UpdateQueuePositions(const ws::Bbo& bbo)
+{
+    _queue_bbo = bbo;
+
+    for (auto& [client_id, order_ptr] : _orders)
+    {
+        OutstandingOrder& order = *order_ptr;
+        if (order.state != OutstandingOrder::State::RESTING)
+        {
+            continue;
+        }
+
+        const double touch = order.side == ws::Side::BUY ? bbo.price.bid : bbo.price.ask;
+        const double level_size = order.side == ws::Side::BUY ? bbo.size.bid : bbo.size.ask;
+
+        if (!Equal(order.price, touch))
+        {
+            // Better than the touch the order is alone at its price, or the update predates
+            // it; behind it, it is requoted anyway
+            const bool better = order.side == ws::Side::BUY ? order.price > touch : order.price < touch;
+            if (better)
+            {
+                order.queue_ahead = 0.0;
+                order.level_size = order.size;
+            }
+            continue;
+        }
+
+        // Whatever left the level, filled or cancelled, came out of the size ahead in
+        // proportion to its share of the rest of the level
+        const double others = order.level_size - order.size;
+        if (level_size < order.level_size && others > 0.0)
+        {
+            order.queue_ahead -= (order.level_size - level_size) * std::min(order.queue_ahead / others, 1.0);
+        }
+
+        order.queue_ahead = std::clamp(order.queue_ahead, 0.0, std::max(level_size - order.size, 0.0));
+        order.level_size = level_size;
+    }
+}
+
+void Gateway::InitQueuePosition(OutstandingOrder& outstanding_order) const
+{
+    const double touch = outstanding_order.side == ws::Side::BUY ? _queue_bbo.price.bid : _queue_bbo.price.ask;
+    const double level_size = outstanding_order.side == ws::Side::BUY ? _queue_bbo.size.bid : _queue_bbo.size.ask;
+
+    if (Equal(outstanding_order.price, touch))
+    {
+        // Whether the touch size includes the order yet is unknown; the next update at
+        // this price trims the estimate down to what is there besides the order
+        outstanding_order.queue_ahead = level_size;
+        outstanding_order.level_size = level_size;
+        return;
+    }
+
+    const bool better = outstanding_order.side == ws::Side::BUY ? outstanding_order.price > touch : outstanding_order.price < touch;
+    outstanding_order.queue_ahead = better ? 0.0 : std::numeric_limits<double>::infinity();
+    outstanding_order.level_size = better ? outstanding_order.size : 0.0;
+}
+
+bool Gateway::KeepsQueuePosition(const OutstandingOrder& outstanding_order, const ws::Bbo& bbo)
+{
+    if (_queue_config.max_ahead_ratio < 0.0 || outstanding_order.state != OutstandingOrder::State::RESTING)
+    {
+        return false;
+    }
+
+    // Behind a better price, re-joining at it is the only way to get filled
+    const double touch = outstanding_order.side == ws::Side::BUY ? bbo.price.bid : bbo.price.ask;
+    const bool behind = outstanding_order.side == ws::Side::BUY
+        ? outstanding_order.price < touch && !Equal(outstanding_order.price, touch)
+        : outstanding_order.price > touch && !Equal(outstanding_order.price, touch);
+
+    if (behind)
+    {
+        return false;
+    }
+
+    if (outstanding_order.queue_ahead > _queue_config.max_ahead_ratio * outstanding_order.size)
+    {
+        ++_rejoined_orders;
+        return false;
     }
 
+    ++_kept_orders;
+    return true;
+}
+
+void Gateway::Requote()
+{
+    std::array<std::vector<uint64_t>, static_cast<int>(ws::Side::NUM_SIDES)> working;
+
+    // Whether a side has a live order that must survive this update: kept for its queue
+    // position, an IOC order or one still on its way in
+    std::array<bool, static_cast<int>(ws::Side::NUM_SIDES)> spared{};
+
+    const uint64_t now_ns = clock::MonotonicNs();
+    const ws::Bbo bbo = GetBbo();
+
     std::lock_guard<std::mutex> lock(_orders_mtx);
     for (auto& [client_id, order_ptr] : _orders)
     {
-        if (order_ptr->state != OutstandingOrder::State::RESTING
-                && order_ptr->state != OutstandingOrder::State::QUEUED)
+        // IOC orders are done by the time a cancel would arrive
+        if ((order_ptr->state != OutstandingOrder::State::RESTING
+                    && order_ptr->state != OutstandingOrder::State::QUEUED)
+                || order_ptr->ioc
+                || KeepsQueuePosition(*order_ptr, bbo))
         {
+            if (order_ptr->state != OutstandingOrder::State::PENDING_CANCEL)
+            {
+                spared[static_cast<int>(order_ptr->side)] = true;
+            }
             continue;
         }
 
-        const auto response = _api.DeleteRequest("/orders/by_client_id/" + std::to_string(client_id));
+        working[static_cast<int>(order_ptr->side)].push_back(client_id);
         order_ptr->state = OutstandingOrder::State::PENDING_CANCEL;
+        order_ptr->cancel_ns = now_ns;
+        ArmTimeout(order_ptr, now_ns);
     }
+
+    // Every cancel this update calls for goes out as one batch. A side with enough working
+    // orders, and none to spare, is cleared with a single request; the exchange then closes
+    // each order and the order updates find them by client id as for any other cancel.
+    std::vector<RequestScheduler::Request> cancels;
+
+    for (const ws::Side side : {ws::Side::BUY, ws::Side::SELL})
+    {
+        std::vector<uint64_t>& client_ids = working[static_cast<int>(side)];
+
+        if (_bulk_cancel_threshold != 0
+                && client_ids.size() >= _bulk_cancel_threshold
+                && !spared[static_cast<int>(side)])
+        {
+            cancels.push_back(MakeSideCancel(side, std::move(client_ids)));
+            continue;
+        }
+
+        for (const uint64_t client_id : client_ids)
+        {
+            cancels.push_back(MakeCancel(client_id));
+        }
+    }
+
+    _scheduler.SubmitBatch(std::move(cancels));
 }
 
 void Gateway::OnOrderUpdate(const ws::Order& order)
+{
+    std::lock_guard<std::mutex> lock(_order_updates_mtx);
+    ApplyOrderUpdate(order, false);
+}
+
+void Gateway::ApplyOrderUpdate(const ws::Order& order, const bool looked_up)
 {
     const uint64_t client_id = std::stoull(order.client_id);
 
@@ -181,7 +1016,19 @@ void Gateway::OnOrderUpdate(const ws::Order& order)
     {
         std::lock_guard<std::mutex> lock(_orders_mtx);
         auto order_iter = _orders.find(client_id);
-        if (order_iter == std::end(_orders))
+        const OutstandingOrder* order_ptr = order_iter == std::end(_orders) ? nullptr : order_iter->second.get();
+
+        if (IsReplayed(client_id, order_ptr, order.status))
+        {
+            // Nothing follows the websocket's own close of a client id
+            if (order_ptr == nullptr && order.status == ws::Order::Status::CLOSED)
+            {
+                _reconciled.erase(client_id);
+            }
+            return;
+        }
+
+        if (order_ptr == nullptr)
         {
             Disable("Could not find order");
         }
@@ -192,7 +1039,7 @@ void Gateway::OnOrderUpdate(const ws::Order& order)
     {
     case ws::Order::Status::NEW:
         {
-            HandleNewOrder(outstanding_order, order);
+            HandleNewOrder(outstanding_order, order, looked_up);
         }
         break;
     case ws::Order::Status::OPEN:
@@ -202,7 +1049,7 @@ void Gateway::OnOrderUpdate(const ws::Order& order)
         break;
     case ws::Order::Status::CLOSED:
         {
-            HandleClosedOrder(outstanding_order, order);
+            HandleClosedOrder(outstanding_order, order, looked_up);
         }
         break;
     
@@ -211,7 +1058,32 @@ void Gateway::OnOrderUpdate(const ws::Order& order)
     }
 }
 
-void Gateway::HandleNewOrder(const std::shared_ptr<OutstandingOrder>& outstanding_order, const ws::Order& order)
+bool Gateway::IsReplayed(const uint64_t client_id, const OutstandingOrder* outstanding_order, const ws::Order::Status status) const
+{
+    if (_reconciled.count(client_id) == 0)
+    {
+        return false;
+    }
+
+    // Closed, and either done or re-sent under a new client id
+    if (outstanding_order == nullptr)
+    {
+        return true;
+    }
+
+    switch (status)
+    {
+    case ws::Order::Status::NEW:
+        return outstanding_order->state != OutstandingOrder::State::SENT;
+    case ws::Order::Status::OPEN:
+        return outstanding_order->state != OutstandingOrder::State::QUEUED;
+
+    default:
+        return false;
+    }
+}
+
+void Gateway::HandleNewOrder(const std::shared_ptr<OutstandingOrder>& outstanding_order, const ws::Order& order, const bool looked_up)
 {
     std::lock_guard<std::mutex> lock(_orders_mtx);
     if (outstanding_order->state != OutstandingOrder::State::SENT)
@@ -219,6 +1091,14 @@ void Gateway::HandleNewOrder(const std::shared_ptr<OutstandingOrder>& outstandin
         Disable("Got a 'NEW' order with a status other than 'SENT'");
     }
 
+    DisarmTimeout(*outstanding_order);
+
+    // A looked up ack only came in after the timeout, it says nothing about the exchange's pace
+    if (!looked_up)
+    {
+        RecordAck(_order_ack, _order_ack_ns, clock::MonotonicNs() - outstanding_order->sent_ns);
+    }
+
     outstanding_order->state = OutstandingOrder::State::QUEUED;
 }
 
@@ -232,15 +1112,27 @@ void Gateway::HandleOpenOrder(const std::shared_ptr<OutstandingOrder>& outstandi
     }
 
     outstanding_order->state = OutstandingOrder::State::RESTING;
+    outstanding_order->price = order.price;
+    outstanding_order->size = order.size - order.filled_size;
+    InitQueuePosition(*outstanding_order);
+
+    Expedite(outstanding_order);
 }
 
-void Gateway::HandleClosedOrder(const std::shared_ptr<OutstandingOrder>& outstanding_order, const ws::Order& order)
+void Gateway::HandleClosedOrder(const std::shared_ptr<OutstandingOrder>& outstanding_order, const ws::Order& order, const bool looked_up)
 {
     double size_left = 0.0;
 
     {
         std::lock_guard<std::mutex> lock(_orders_mtx);
 
+        if (outstanding_order->state == OutstandingOrder::State::PENDING_CANCEL && !looked_up)
+        {
+            RecordAck(_cancel_ack, _cancel_ack_ns, clock::MonotonicNs() - outstanding_order->cancel_ns);
+        }
+
+        DisarmTimeout(*outstanding_order);
+
         if (Equal(order.filled_size, order.size))
         {
             std::cout << "--- Fill ---\n"
@@ -249,23 +1141,101 @@ void Gateway::HandleClosedOrder(const std::shared_ptr<OutstandingOrder>& outstan
                 << ", Fill price: " << order.price
                 << ", slippage: " << GetSlippagePercentage(order.side, outstanding_order->original_market_price, order.price)
                 << ", Times queued: " << outstanding_order->queued_count << std::endl;
-            _orders.erase(outstanding_order->client_id);
+            Retire(outstanding_order->client_id);
+            _timers.Cancel(outstanding_order->deadline_timer);
             return;
         }
 
         outstanding_order->filled_size += order.filled_size;
         size_left = outstanding_order->original_size - outstanding_order->filled_size;
         outstanding_order->state = OutstandingOrder::State::SENT;
+        outstanding_order->sent_ns = clock::MonotonicNs();
+        outstanding_order->queued_count++;
+
+        if (!outstanding_order->aggressive
+                && _execution_config.max_requotes != 0
+                && outstanding_order->queued_count > _execution_config.max_requotes)
+        {
+            ++_requote_budget_expired;
+            outstanding_order->aggressive = true;
+        }
+
+        outstanding_order->ioc = outstanding_order->aggressive;
 
-        _orders.erase(outstanding_order->client_id);
+        Retire(outstanding_order->client_id);
         outstanding_order->client_id = _next_order_id.fetch_add(1);
         _orders.emplace(outstanding_order->client_id, outstanding_order);
+
+        ArmTimeout(outstanding_order, outstanding_order->sent_ns);
+    }
+
+    if (outstanding_order->ioc)
+    {
+        SendIocOrder(outstanding_order->side, size_left, outstanding_order->client_id);
+        return;
     }
 
-    outstanding_order->queued_count++;
     SendMarketOrder(outstanding_order->side, size_left, outstanding_order->client_id, false);
 }
 
+void Gateway::Retire(const uint64_t client_id)
+{
+    _orders.erase(client_id);
+
+    if (_reconciled.count(client_id) == 0)
+    {
+        return;
+    }
+
+    // Remembered a while longer for the websocket's late copies of what the lookup applied
+    _retired_reconciled.push_back(client_id);
+    if (_retired_reconciled.size() > MAX_RETIRED_RECONCILED)
+    {
+        _reconciled.erase(_retired_reconciled.front());
+        _retired_reconciled.pop_front();
+    }
+}
+
+RequestScheduler::Request Gateway::MakeCancel(const uint64_t client_id)
+{
+    return MakeRequest(RequestScheduler::Priority::CANCEL
+            , [this, client_id]() -> const EncodedRequest& { return _encoder.EncodeCancelByClientId(client_id); }
+            , client_id);
+}
+
+RequestScheduler::Request Gateway::MakeSideCancel(const ws::Side side, std::vector<uint64_t>&& client_ids)
+{
+    auto request = MakeRequest(RequestScheduler::Priority::CANCEL
+            , [this, side]() -> const EncodedRequest& { return _encoder.EncodeCancelSide(side); });
+
+    request.on_response = [this, client_ids = std::move(client_ids)](const FtxAPI::Response_t& response)
+    {
+        if (response.IsObject() && response.HasMember("success") && response["success"].GetBool())
+        {
+            return;
+        }
+
+        std::cerr << "Bulk cancel failed, cancelling " << client_ids.size() << " orders one by one" << std::endl;
+
+        std::vector<RequestScheduler::Request> cancels;
+
+        std::lock_guard<std::mutex> lock(_orders_mtx);
+        for (const uint64_t client_id : client_ids)
+        {
+            // Orders that closed in the meantime are gone or were re-sent under a new id
+            const auto order_iter = _orders.find(client_id);
+            if (order_iter != std::end(_orders) && order_iter->second->state == OutstandingOrder::State::PENDING_CANCEL)
+            {
+                cancels.push_back(MakeCancel(client_id));
+            }
+        }
+
+        _scheduler.SubmitBatch(std::move(cancels));
+    };
+
+    return request;
+}
+
 void Gateway::Disable(const char* error)
 {
     _running = false;
@@ -278,7 +1248,9 @@ void Gateway::Disable(const char* error)
 
 void Gateway::CancelAll()
 {
-    const auto response = _api.DeleteRequest("/orders");
+    // Sent from the calling thread, past the scheduler's queue and budgets: Disable runs with
+    // _orders_mtx held, and the scheduler's workers may be blocked on it in response handlers
+    const auto response = _api.Send(_encoder.EncodeCancelAll());
 
     if (!response["success"].GetBool())
     {
@@ -0,0 +1,825 @@
+#include "Http2Client.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+
+#if FTX_HTTP2
+#include <nghttp2/nghttp2.h>
+#endif
+
+#include "Clock.h"
+
+namespace ftx
+{
+
+#if FTX_HTTP2
+
+namespace
+{
+
+static constexpr const char* SCHEME = "https://";
+static constexpr const char* DEFAULT_PORT = "443";
+
+// ALPN protocol list, length prefixed
+static constexpr const unsigned char ALPN[] = {2, 'h', '2'};
+
+static constexpr const size_t READ_BUFFER_BYTES = 64 * 1024;
+
+// Connection window every HTTP/2 connection starts with
+static constexpr const int32_t DEFAULT_WINDOW_BYTES = 65535;
+
+static nghttp2_nv Header(const std::string_view name, const std::string_view value, const uint8_t flags = NGHTTP2_NV_FLAG_NONE)
+{
+    // Names and values outlive the stream, so nghttp2 need not copy them
+    return nghttp2_nv
+    {
+        reinterpret_cast<uint8_t*>(const_cast<char*>(name.data())),
+        reinterpret_cast<uint8_t*>(const_cast<char*>(value.data())),
+        name.size(),
+        value.size(),
+        static_cast<uint8_t>(flags | NGHTTP2_NV_FLAG_NO_COPY_NAME | NGHTTP2_NV_FLAG_NO_COPY_VALUE)
+    };
+}
+
+}
+
+struct Http2Client::Callbacks
+{
+    static int OnFrame(nghttp2_session*, const nghttp2_frame* frame, void* user)
+    {
+        if (frame->hd.type == NGHTTP2_PING && (frame->hd.flags & NGHTTP2_FLAG_ACK) != 0)
+        {
+            static_cast<Http2Client*>(user)->_ping_outstanding = false;
+        }
+
+        return 0;
+    }
+
+    static ssize_t ReadBody(nghttp2_session*, int32_t, uint8_t* buffer, size_t length, uint32_t* flags, nghttp2_data_source* source, void*)
+    {
+        Exchange& exchange = *static_cast<Exchange*>(source->ptr);
+        const auto& body = exchange.request.body;
+
+        const size_t size = std::min(length, body.size - exchange.body_sent);
+        std::memcpy(buffer, body.data + exchange.body_sent, size);
+        exchange.body_sent += size;
+
+        if (exchange.body_sent == body.size)
+        {
+            *flags |= NGHTTP2_DATA_FLAG_EOF;
+        }
+
+        return static_cast<ssize_t>(size);
+    }
+
+    static int OnHeader(nghttp2_session* session, const nghttp2_frame* frame, const uint8_t* name, size_t name_length
+            , const uint8_t* value, size_t value_length, uint8_t, void*)
+    {
+        if (frame->hd.type != NGHTTP2_HEADERS)
+        {
+            return 0;
+        }
+
+        auto* exchange = static_cast<Exchange*>(nghttp2_session_get_stream_user_data(session, frame->hd.stream_id));
+        if (exchange == nullptr)
+        {
+            return 0;
+        }
+
+        Response& response = *exchange->response;
+        if (response.first_byte_ns == 0)
+        {
+            response.first_byte_ns = clock::MonotonicNs() - exchange->submit_ns;
+        }
+
+        const std::string_view header(reinterpret_cast<const char*>(name), name_length);
+        const std::string_view text(reinterpret_cast<const char*>(value), value_length);
+
+        if (header == ":status")
+        {
+            response.status = 0;
+            for (const char c : text)
+            {
+                response.status = response.status * 10 + (c - '0');
+            }
+        }
+        else if (header == "date")
+        {
+            response.date.assign(text.data(), text.size());
+        }
+
+        return 0;
+    }
+
+    static int OnData(nghttp2_session* session, uint8_t, int32_t stream_id, const uint8_t* data, size_t length, void*)
+    {
+        auto* exchange = static_cast<Exchange*>(nghttp2_session_get_stream_user_data(session, stream_id));
+        if (exchange != nullptr)
+        {
+            exchange->response->body.append(reinterpret_cast<const char*>(data), length);
+        }
+
+        return 0;
+    }
+
+    static int OnStreamClose(nghttp2_session*, int32_t stream_id, uint32_t error_code, void* user)
+    {
+        Http2Client& client = *static_cast<Http2Client*>(user);
+
+        const auto exchange = client._exchanges.find(stream_id);
+        if (exchange == std::end(client._exchanges))
+        {
+            return 0;
+        }
+
+        const std::shared_ptr<Exchange> closed = exchange->second;
+        client._exchanges.erase(exchange);
+
+        client.Complete(closed, error_code == NGHTTP2_NO_ERROR && closed->response->status != 0);
+        return 0;
+    }
+};
+
+Http2Client::Http2Client(const std::string& endpoint
+        , const std::string& key
+        , const std::shared_ptr<TlsContext>& tls_context)
+    : Http2Client(endpoint, key, tls_context, Config())
+{}
+
+Http2Client::Http2Client(const std::string& endpoint
+        , const std::string& key
+        , const std::shared_ptr<TlsContext>& tls_context
+        , const Config& config)
+    : _tls_context(tls_context)
+    , _config(config)
+    , _key(key)
+    , _io()
+    , _work(boost::asio::make_work_guard(_io))
+    , _resolver(_io)
+    , _state(State::CLOSED)
+    , _session(nullptr)
+    , _read_buffer(READ_BUFFER_BYTES)
+    , _writing(false)
+    , _unflushed_streams(0)
+    , _ping_timer(_io)
+    , _ping_outstanding(false)
+    , _connections(0)
+    , _streams(0)
+    , _failed_streams(0)
+    , _stream_timeouts(0)
+    , _ping_timeouts(0)
+    , _peak_concurrent_streams(0)
+    , _flushes(0)
+    , _flushed_requests(0)
+    , _largest_flush(0)
+{
+    // https://host[:port][/path], HTTP/2 is only negotiated over TLS
+    if (endpoint.compare(0, std::strlen(SCHEME), SCHEME) != 0)
+    {
+        throw std::runtime_error("HTTP/2 needs an https endpoint, got " + endpoint);
+    }
+
+    const std::string authority_and_path = endpoint.substr(std::strlen(SCHEME));
+    const size_t path_start = authority_and_path.find('/');
+
+    _authority = authority_and_path.substr(0, path_start);
+    _path_prefix = path_start == std::string::npos ? "" : authority_and_path.substr(path_start);
+
+    const size_t port_start = _authority.find(':');
+    _host = _authority.substr(0, port_start);
+    _port = port_start == std::string::npos ? DEFAULT_PORT : _authority.substr(port_start + 1);
+
+    _thread = std::thread([this](){ this->Run(); });
+}
+
+Http2Client::~Http2Client()
+{
+    // Fails whatever is still in flight before the loop ends
+    boost::asio::post(_io, [this]()
+    {
+        Close();
+        _io.stop();
+    });
+
+    _thread.join();
+}
+
+bool Http2Client::WarmUp()
+{
+    std::promise<bool> connected;
+    std::future<bool> done = connected.get_future();
+
+    boost::asio::post(_io, [this, &connected]()
+    {
+        if (_state == State::OPEN)
+        {
+            connected.set_value(true);
+            return;
+        }
+
+        _connect_waiters.push_back(std::move(connected));
+
+        if (_state == State::CLOSED)
+        {
+            Connect();
+        }
+    });
+
+    return done.get();
+}
+
+bool Http2Client::Send(const EncodedRequest& request, Response& response)
+{
+    response = Response();
+
+    auto exchange = std::make_shared<Exchange>(_io);
+    exchange->request = request;
+    exchange->response = &response;
+    exchange->submit_ns = clock::MonotonicNs();
+
+    std::future<bool> done = exchange->done.get_future();
+
+    boost::asio::post(_io, [this, exchange]()
+    {
+        Start(exchange);
+        Flush();
+    });
+
+    return done.get();
+}
+
+void Http2Client::SendBatch(const std::vector<const EncodedRequest*>& requests, const BatchHandler_t& on_response)
+{
+    std::vector<Response> responses(requests.size());
+    std::vector<std::shared_ptr<Exchange>> exchanges;
+    std::vector<std::future<bool>> done;
+
+    exchanges.reserve(requests.size());
+    done.reserve(requests.size());
+
+    const uint64_t submit_ns = clock::MonotonicNs();
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        auto exchange = std::make_shared<Exchange>(_io);
+        exchange->request = *requests[i];
+        exchange->response = &responses[i];
+        exchange->submit_ns = submit_ns;
+
+        done.push_back(exchange->done.get_future());
+        exchanges.push_back(std::move(exchange));
+    }
+
+    // Submitted in one go, so the following flush carries every request's frames
+    boost::asio::post(_io, [this, exchanges]()
+    {
+        for (const auto& exchange : exchanges)
+        {
+            Start(exchange);
+        }
+
+        Flush();
+    });
+
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        if (!done[i].get())
+        {
+            responses[i] = Response();
+        }
+
+        on_response(i, responses[i]);
+    }
+}
+
+void Http2Client::Connect()
+{
+    _state = State::CONNECTING;
+
+    _resolver.async_resolve(_host, _port
+            , [this](const boost::system::error_code& ec, const boost::asio::ip::tcp::resolver::results_type& endpoints)
+    {
+        // Given up on by a close, or a later attempt is already under way
+        if (ec == boost::asio::error::operation_aborted || _state != State::CONNECTING || _stream)
+        {
+            return;
+        }
+
+        if (ec)
+        {
+            Close();
+            return;
+        }
+
+        // Held from the start, so a close can abort the connect and handshake
+        _stream = std::make_shared<Stream_t>(_io, *_tls_context->GetContext());
+        const std::shared_ptr<Stream_t> stream = _stream;
+
+        boost::asio::async_connect(stream->next_layer(), endpoints
+                , [this, stream](const boost::system::error_code& ec, const boost::asio::ip::tcp::endpoint&)
+        {
+            OnConnected(stream, ec);
+        });
+    });
+}
+
+void Http2Client::OnConnected(const std::shared_ptr<Stream_t>& stream, const boost::system::error_code& ec)
+{
+    if (stream != _stream)
+    {
+        return;
+    }
+
+    if (ec)
+    {
+        Close();
+        return;
+    }
+
+    _config.socket_options.Apply(stream->next_layer().native_handle());
+
+    _tls_context->PrepareSession(stream->native_handle(), _host);
+    SSL_set_alpn_protos(stream->native_handle(), ALPN, sizeof(ALPN));
+
+    const uint64_t start_ns = clock::MonotonicNs();
+    stream->async_handshake(Stream_t::client, [this, stream, start_ns](const boost::system::error_code& ec)
+    {
+        OnHandshake(stream, ec, start_ns);
+    });
+}
+
+void Http2Client::OnHandshake(const std::shared_ptr<Stream_t>& stream, const boost::system::error_code& ec, const uint64_t start_ns)
+{
+    if (stream != _stream)
+    {
+        return;
+    }
+
+    if (ec)
+    {
+        Close();
+        return;
+    }
+
+    // Only a verified server gets the key, whatever protocol it agreed to
+    if (!_tls_context->IsVerified(stream->native_handle()))
+    {
+        std::cerr << "Server certificate not verified" << std::endl;
+        Close();
+        return;
+    }
+
+    _tls_context->RecordHandshake(stream->native_handle(), clock::MonotonicNs() - start_ns);
+
+    const unsigned char* protocol = nullptr;
+    unsigned int protocol_length = 0;
+    SSL_get0_alpn_selected(stream->native_handle(), &protocol, &protocol_length);
+
+    if (protocol_length != 2 || std::memcmp(protocol, "h2", 2) != 0)
+    {
+        std::cerr << "Server did not negotiate HTTP/2" << std::endl;
+        Close();
+        return;
+    }
+
+    Open();
+}
+
+void Http2Client::Open()
+{
+    nghttp2_session_callbacks* callbacks = nullptr;
+    nghttp2_session_callbacks_new(&callbacks);
+    nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, &Callbacks::OnFrame);
+    nghttp2_session_callbacks_set_on_header_callback(callbacks, &Callbacks::OnHeader);
+    nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, &Callbacks::OnData);
+    nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, &Callbacks::OnStreamClose);
+
+    const int result = nghttp2_session_client_new(&_session, callbacks, this);
+    nghttp2_session_callbacks_del(callbacks);
+
+    if (result != 0)
+    {
+        _session = nullptr;
+        Close();
+        return;
+    }
+
+    const nghttp2_settings_entry settings[] =
+    {
+        {NGHTTP2_SETTINGS_ENABLE_PUSH, 0},
+        {NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, _config.window_bytes}
+    };
+    nghttp2_submit_settings(_session, NGHTTP2_FLAG_NONE, settings, sizeof(settings) / sizeof(settings[0]));
+
+    // The connection window is only raised by an update, not by settings
+    if (_config.window_bytes > static_cast<uint32_t>(DEFAULT_WINDOW_BYTES))
+    {
+        nghttp2_submit_window_update(_session, NGHTTP2_FLAG_NONE, 0
+                , static_cast<int32_t>(_config.window_bytes) - DEFAULT_WINDOW_BYTES);
+    }
+
+    _state = State::OPEN;
+    ++_connections;
+
+    for (std::promise<bool>& waiter : _connect_waiters)
+    {
+        waiter.set_value(true);
+    }
+    _connect_waiters.clear();
+
+    std::deque<std::shared_ptr<Exchange>> waiting;
+    waiting.swap(_waiting);
+    for (const auto& exchange : waiting)
+    {
+        Submit(exchange);
+    }
+
+    _ping_outstanding = false;
+    Ping();
+
+    Read();
+    Flush();
+}
+
+void Http2Client::Start(const std::shared_ptr<Exchange>& exchange)
+{
+    if (_config.stream_timeout_ns > 0)
+    {
+        const uint64_t elapsed_ns = clock::MonotonicNs() - exchange->submit_ns;
+        exchange->deadline.expires_after(std::chrono::nanoseconds(_config.stream_timeout_ns - std::min(elapsed_ns, _config.stream_timeout_ns)));
+
+        // Weak, so a pending wait does not keep a finished exchange around
+        exchange->deadline.async_wait([this, weak = std::weak_ptr<Exchange>(exchange)](const boost::system::error_code& ec)
+        {
+            const std::shared_ptr<Exchange> expired = weak.lock();
+            if (!ec && expired)
+            {
+                Expire(expired);
+            }
+        });
+    }
+
+    Submit(exchange);
+}
+
+void Http2Client::Submit(const std::shared_ptr<Exchange>& exchange)
+{
+    if (_state != State::OPEN)
+    {
+        _waiting.push_back(exchange);
+
+        if (_state == State::CLOSED)
+        {
+            Connect();
+        }
+        return;
+    }
+
+    const EncodedRequest& request = exchange->request;
+    exchange->path = _path_prefix;
+    exchange->path.append(request.path.data, request.path.size);
+
+    // Timestamp and signature differ on every request; indexing them would only evict the
+    // headers that do repeat from the HPACK table
+    const nghttp2_nv headers[] =
+    {
+        Header(":method", RequestEncoder::MethodToString(request.method)),
+        Header(":scheme", "https"),
+        Header(":authority", _authority),
+        Header(":path", exchange->path),
+        Header("ftxus-key", _key),
+        Header("ftxus-ts", request.timestamp.View(), NGHTTP2_NV_FLAG_NO_INDEX),
+        Header("ftxus-sign", request.signature.View(), NGHTTP2_NV_FLAG_NO_INDEX),
+        Header("content-type", "application/json"),
+        Header("accept", "application/json")
+    };
+
+    nghttp2_data_provider body;
+    body.source.ptr = exchange.get();
+    body.read_callback = &Callbacks::ReadBody;
+
+    const int32_t stream_id = nghttp2_submit_request(_session, nullptr, headers, sizeof(headers) / sizeof(headers[0])
+            , request.body.size > 0 ? &body : nullptr, exchange.get());
+
+    if (stream_id < 0)
+    {
+        std::cerr << "HTTP/2 request not submitted: " << nghttp2_strerror(stream_id) << std::endl;
+        Complete(exchange, false);
+        return;
+    }
+
+    _exchanges.emplace(stream_id, exchange);
+    ++_streams;
+    ++_unflushed_streams;
+
+    if (_exchanges.size() > _peak_concurrent_streams.load(std::memory_order_relaxed))
+    {
+        _peak_concurrent_streams.store(_exchanges.size(), std::memory_order_relaxed);
+    }
+}
+
+void Http2Client::Complete(const std::shared_ptr<Exchange>& exchange, const bool received)
+{
+    if (exchange->completed)
+    {
+        return;
+    }
+
+    exchange->completed = true;
+    exchange->deadline.cancel();
+
+    if (!received)
+    {
+        ++_failed_streams;
+    }
+
+    exchange->done.set_value(received);
+}
+
+void Http2Client::Expire(const std::shared_ptr<Exchange>& exchange)
+{
+    if (exchange->completed)
+    {
+        return;
+    }
+
+    std::cerr << "HTTP/2 request timed out, resetting the connection" << std::endl;
+    ++_stream_timeouts;
+
+    Complete(exchange, false);
+    Close();
+}
+
+void Http2Client::Ping()
+{
+    if (_config.ping_interval_ns == 0)
+    {
+        return;
+    }
+
+    const std::shared_ptr<Stream_t> stream = _stream;
+
+    _ping_timer.expires_after(std::chrono::nanoseconds(_config.ping_interval_ns));
+    _ping_timer.async_wait([this, stream](const boost::system::error_code& ec)
+    {
+        if (ec || stream != _stream || _session == nullptr)
+        {
+            return;
+        }
+
+        if (_ping_outstanding)
+        {
+            std::cerr << "HTTP/2 ping not answered, resetting the connection" << std::endl;
+            ++_ping_timeouts;
+            Close();
+            return;
+        }
+
+        _ping_outstanding = true;
+        nghttp2_submit_ping(_session, NGHTTP2_FLAG_NONE, nullptr);
+        Flush();
+
+        Ping();
+    });
+}
+
+void Http2Client::Read()
+{
+    const std::shared_ptr<Stream_t> stream = _stream;
+
+    stream->async_read_some(boost::asio::buffer(_read_buffer)
+            , [this, stream](const boost::system::error_code& ec, const size_t bytes)
+    {
+        // A read still pending on a connection that was closed since
+        if (stream != _stream)
+        {
+            return;
+        }
+
+        if (ec)
+        {
+            Close();
+            return;
+        }
+
+        if (_config.socket_options.quick_ack)
+        {
+            SocketOptions::RearmQuickAck(stream->next_layer().native_handle());
+        }
+
+        const ssize_t consumed = nghttp2_session_mem_recv(_session, reinterpret_cast<const uint8_t*>(_read_buffer.data()), bytes);
+        if (consumed < 0)
+        {
+            std::cerr << "HTTP/2 session error: " << nghttp2_strerror(static_cast<int>(consumed)) << std::endl;
+            Close();
+            return;
+        }
+
+        // Settings acks and window updates the input produced
+        Flush();
+
+        if (stream == _stream)
+        {
+            Read();
+        }
+    });
+}
+
+void Http2Client::Flush()
+{
+    if (_session == nullptr || _writing)
+    {
+        return;
+    }
+
+    // Everything queued since the last write goes out in one, frames of concurrent requests included
+    const uint64_t start_ns = clock::MonotonicNs();
+    _write_buffer.clear();
+
+    const uint8_t* data = nullptr;
+    ssize_t size = 0;
+    while ((size = nghttp2_session_mem_send(_session, &data)) > 0)
+    {
+        _write_buffer.insert(std::end(_write_buffer), data, data + size);
+    }
+
+    if (size < 0)
+    {
+        Close();
+        return;
+    }
+
+    if (_write_buffer.empty())
+    {
+        // Both sides are done with the session, e.g. after a GOAWAY
+        if (!nghttp2_session_want_read(_session) && !nghttp2_session_want_write(_session))
+        {
+            Close();
+        }
+        return;
+    }
+
+    _writing = true;
+
+    // Writes with only control frames or the rest of a body are not request flushes
+    const uint64_t requests = _unflushed_streams;
+    _unflushed_streams = 0;
+
+    const std::shared_ptr<Stream_t> stream = _stream;
+    boost::asio::async_write(*stream, boost::asio::buffer(_write_buffer)
+            , [this, stream, requests, start_ns](const boost::system::error_code& ec, const size_t)
+    {
+        if (stream != _stream)
+        {
+            return;
+        }
+
+        _writing = false;
+
+        if (ec)
+        {
+            Close();
+            return;
+        }
+
+        if (requests > 0)
+        {
+            _flush_latency.Record(clock::MonotonicNs() - start_ns);
+            ++_flushes;
+            _flushed_requests += requests;
+
+            if (requests > _largest_flush.load(std::memory_order_relaxed))
+            {
+                _largest_flush.store(requests, std::memory_order_relaxed);
+            }
+        }
+
+        Flush();
+    });
+}
+
+void Http2Client::Close()
+{
+    if (_session != nullptr)
+    {
+        nghttp2_session_del(_session);
+        _session = nullptr;
+    }
+
+    if (_stream)
+    {
+        boost::system::error_code ec;
+        _stream->next_layer().close(ec);
+        _stream.reset();
+    }
+
+    _resolver.cancel();
+    _ping_timer.cancel();
+
+    _state = State::CLOSED;
+    _writing = false;
+    _unflushed_streams = 0;
+
+    for (auto& [stream_id, exchange] : _exchanges)
+    {
+        Complete(exchange, false);
+    }
+    _exchanges.clear();
+
+    for (const auto& exchange : _waiting)
+    {
+        Complete(exchange, false);
+    }
+    _waiting.clear();
+
+    for (std::promise<bool>& waiter : _connect_waiters)
+    {
+        waiter.set_value(false);
+    }
+    _connect_waiters.clear();
+}
+
+void Http2Client::Run()
+{
+    _config.io_thread.Apply();
+
+    if (!_config.io_thread.busy_poll)
+    {
+        _io.run();
+        return;
+    }
+
+    while (!_io.stopped())
+    {
+        _io.poll();
+    }
+}
+
+#else
+
+Http2Client::Http2Client(const std::string& endpoint
+        , const std::string& key
+        , const std::shared_ptr<TlsContext>& tls_context)
+    : Http2Client(endpoint, key, tls_context, Config())
+{}
+
+Http2Client::Http2Client(const std::string&
+        , const std::string& key
+        , const std::shared_ptr<TlsContext>& tls_context
+        , const Config& config)
+    : _tls_context(tls_context)
+    , _config(config)
+    , _key(key)
+    , _io()
+    , _work(boost::asio::make_work_guard(_io))
+    , _resolver(_io)
+    , _ping_timer(_io)
+{
+    throw std::runtime_error("Built without HTTP/2 support, configure with FTX_HTTP2=ON");
+}
+
+Http2Client::~Http2Client() = default;
+
+bool Http2Client::WarmUp()
+{
+    return false;
+}
+
+bool Http2Client::Send(const EncodedRequest&, Response&)
+{
+    return false;
+}
+
+void Http2Client::SendBatch(const std::vector<const EncodedRequest*>& requests, const BatchHandler_t& on_response)
+{
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        on_response(i, Response());
+    }
+}
+
+#endif
+
+Http2Client::Stats Http2Client::GetStats() const
+{
+    Stats stats;
+
+    stats.connections = _connections.load(std::memory_order_relaxed);
+    stats.streams = _streams.load(std::memory_order_relaxed);
+    stats.failed_streams = _failed_streams.load(std::memory_order_relaxed);
+    stats.stream_timeouts = _stream_timeouts.load(std::memory_order_relaxed);
+    stats.ping_timeouts = _ping_timeouts.load(std::memory_order_relaxed);
+    stats.peak_concurrent_streams = _peak_concurrent_streams.load(std::memory_order_relaxed);
+
+    stats.flushes = _flushes.load(std::memory_order_relaxed);
+    stats.flushed_requests = _flushed_requests.load(std::memory_order_relaxed);
+    stats.largest_flush = _largest_flush.load(std::memory_order_relaxed);
+    stats.flush = _flush_latency.GetSnapshot();
+
+    return stats;
+}
+
+} // namespace ftx
\ No newline at end of file
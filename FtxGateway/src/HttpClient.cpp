@@ -0,0 +1,978 @@
+#include "HttpClient.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include "Clock.h"
+
+namespace ftx
+{
+
+namespace
+{
+
+static constexpr const char* HTTP_SCHEME = "http://";
+static constexpr const char* HTTPS_SCHEME = "https://";
+
+static constexpr std::string_view SIGN_HEADER = "\r\nFTXUS-SIGN: ";
+static constexpr std::string_view LENGTH_HEADER = "\r\nContent-Length: ";
+static constexpr std::string_view HEAD_END = "\r\n\r\n";
+
+static constexpr const size_t INITIAL_REQUEST_BUFFER = 4 * 1024;
+static constexpr const size_t INITIAL_RESPONSE_BUFFER = 16 * 1024;
+static constexpr const size_t MIN_READ_SPACE = 4 * 1024;
+static constexpr const size_t MAX_HEAD_BYTES = 16 * 1024;
+static constexpr const size_t MAX_RESPONSE_BYTES = 64 * 1024 * 1024;
+
+// When an operation started now with `timeout_ns` is due, 0 if it has no deadline
+static uint64_t Deadline(const uint64_t timeout_ns)
+{
+    return timeout_ns == 0 ? 0 : clock::MonotonicNs() + timeout_ns;
+}
+
+// Whichever socket backend the connection was built with
+static void CloseSocket(boost::asio::ip::tcp::socket& socket, boost::system::error_code& ec)
+{
+    socket.close(ec);
+}
+
+#if FTX_IO_URING
+static void CloseSocket(IoUringSocket& socket, boost::system::error_code& ec)
+{
+    socket.Close(ec);
+}
+#endif
+
+enum class ParseResult
+    : int
+{
+    INCOMPLETE,
+    COMPLETE,
+    INVALID
+};
+
+static bool EqualsIgnoreCase(const std::string_view a, const std::string_view b)
+{
+    return a.size() == b.size()
+        && std::equal(std::begin(a), std::end(a), std::begin(b), [](const unsigned char x, const unsigned char y)
+        {
+            return std::tolower(x) == std::tolower(y);
+        });
+}
+
+static bool ContainsIgnoreCase(const std::string_view haystack, const std::string_view needle)
+{
+    return std::search(std::begin(haystack), std::end(haystack), std::begin(needle), std::end(needle)
+            , [](const unsigned char x, const unsigned char y){ return std::tolower(x) == std::tolower(y); })
+        != std::end(haystack);
+}
+
+static std::string_view Trim(std::string_view value)
+{
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+    {
+        value.remove_prefix(1);
+    }
+
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+    {
+        value.remove_suffix(1);
+    }
+
+    return value;
+}
+
+static bool ParseSize(const std::string_view text, const int base, size_t& value)
+{
+    // More digits than this cannot be a size we would accept anyway
+    if (text.empty() || text.size() > 15)
+    {
+        return false;
+    }
+
+    value = 0;
+    for (const char c : text)
+    {
+        const int digit = std::isdigit(static_cast<unsigned char>(c)) ? c - '0'
+            : base == 16 && std::isxdigit(static_cast<unsigned char>(c)) ? std::tolower(static_cast<unsigned char>(c)) - 'a' + 10
+            : -1;
+
+        if (digit < 0)
+        {
+            return false;
+        }
+
+        value = value * base + digit;
+    }
+
+    return true;
+}
+
+// Walks the chunk framing of a body. With `compact`, the chunk data is moved together at the
+// front of `data` as it goes, which only makes sense once the whole body is known to be there.
+// `framed_size` is the size of the body as it came over the wire, framing and trailers included.
+static ParseResult DecodeChunked(char* data, const size_t size, const bool compact, size_t& payload_size, size_t& framed_size)
+{
+    size_t read = 0;
+    size_t write = 0;
+
+    while (true)
+    {
+        const std::string_view rest(data + read, size - read);
+
+        const size_t line_end = rest.find("\r\n");
+        if (line_end == std::string_view::npos)
+        {
+            return ParseResult::INCOMPLETE;
+        }
+
+        // Chunk extensions are ignored
+        size_t chunk = 0;
+        if (!ParseSize(Trim(rest.substr(0, std::min(line_end, rest.find(';')))), 16, chunk))
+        {
+            return ParseResult::INVALID;
+        }
+
+        read += line_end + 2;
+
+        if (chunk == 0)
+        {
+            // Trailers, if any, end with an empty line like the head
+            const std::string_view trailers(data + read, size - read);
+            if (trailers.compare(0, 2, "\r\n") == 0)
+            {
+                framed_size = read + 2;
+            }
+            else
+            {
+                const size_t trailers_end = trailers.find(HEAD_END);
+                if (trailers_end == std::string_view::npos)
+                {
+                    return ParseResult::INCOMPLETE;
+                }
+
+                framed_size = read + trailers_end + HEAD_END.size();
+            }
+
+            payload_size = write;
+            return ParseResult::COMPLETE;
+        }
+
+        if (size - read < chunk + 2)
+        {
+            return ParseResult::INCOMPLETE;
+        }
+
+        if (compact)
+        {
+            std::memmove(data + write, data + read, chunk);
+        }
+
+        write += chunk;
+        read += chunk + 2;
+    }
+}
+
+// Parses the response received so far in place. `closed` means nothing more will arrive,
+// which is how a body without length or chunking ends. `consumed` is where a pipelined
+// response following this one starts.
+static ParseResult ParseResponse(char* data, const size_t size, const bool closed, HttpClient::Response& response, bool& keep_alive, size_t& consumed)
+{
+    const std::string_view text(data, size);
+
+    const size_t head_end = text.find(HEAD_END);
+    if (head_end == std::string_view::npos)
+    {
+        return closed || size > MAX_HEAD_BYTES ? ParseResult::INVALID : ParseResult::INCOMPLETE;
+    }
+
+    // HTTP/1.x NNN
+    size_t status = 0;
+    if (text.compare(0, 7, "HTTP/1.") != 0 || head_end < 12 || !ParseSize(text.substr(9, 3), 10, status))
+    {
+        return ParseResult::INVALID;
+    }
+
+    response.status = static_cast<int>(status);
+    response.date = std::string_view();
+    keep_alive = text[7] != '0';
+
+    bool chunked = false;
+    bool has_length = false;
+    size_t content_length = 0;
+
+    size_t line = text.find("\r\n") + 2;
+    while (line < head_end)
+    {
+        const size_t line_end = text.find("\r\n", line);
+        const std::string_view header = text.substr(line, line_end - line);
+        line = line_end + 2;
+
+        const size_t colon = header.find(':');
+        if (colon == std::string_view::npos)
+        {
+            continue;
+        }
+
+        const std::string_view name = header.substr(0, colon);
+        const std::string_view value = Trim(header.substr(colon + 1));
+
+        if (EqualsIgnoreCase(name, "content-length"))
+        {
+            if (!ParseSize(value, 10, content_length))
+            {
+                return ParseResult::INVALID;
+            }
+            has_length = true;
+        }
+        else if (EqualsIgnoreCase(name, "transfer-encoding"))
+        {
+            chunked = ContainsIgnoreCase(value, "chunked");
+        }
+        else if (EqualsIgnoreCase(name, "connection"))
+        {
+            keep_alive = EqualsIgnoreCase(value, "keep-alive") || (keep_alive && !EqualsIgnoreCase(value, "close"));
+        }
+        else if (EqualsIgnoreCase(name, "date"))
+        {
+            response.date = value;
+        }
+    }
+
+    const size_t body_start = head_end + HEAD_END.size();
+    char* body = data + body_start;
+    const size_t available = size - body_start;
+
+    response.body = body;
+    response.body_size = 0;
+
+    if (status == 204 || status == 304)
+    {
+        consumed = body_start;
+        return ParseResult::COMPLETE;
+    }
+
+    if (chunked)
+    {
+        size_t payload_size = 0;
+        size_t framed_size = 0;
+        const ParseResult result = DecodeChunked(body, available, false, payload_size, framed_size);
+        if (result != ParseResult::COMPLETE)
+        {
+            return closed ? ParseResult::INVALID : result;
+        }
+
+        DecodeChunked(body, available, true, response.body_size, framed_size);
+        consumed = body_start + framed_size;
+        return ParseResult::COMPLETE;
+    }
+
+    if (has_length)
+    {
+        if (available < content_length)
+        {
+            return closed ? ParseResult::INVALID : ParseResult::INCOMPLETE;
+        }
+
+        response.body_size = content_length;
+        consumed = body_start + content_length;
+        return ParseResult::COMPLETE;
+    }
+
+    if (!closed)
+    {
+        return ParseResult::INCOMPLETE;
+    }
+
+    keep_alive = false;
+    response.body_size = available;
+    consumed = size;
+    return ParseResult::COMPLETE;
+}
+
+}
+
+HttpClient::Lease::Lease(HttpClient* client, Connection* connection)
+    : _client(client)
+    , _connection(connection)
+{}
+
+HttpClient::Lease::Lease(Lease&& other) noexcept
+    : _client(other._client)
+    , _connection(other._connection)
+{
+    other._connection = nullptr;
+}
+
+HttpClient::Lease::~Lease()
+{
+    if (_connection)
+    {
+        _client->Release(_connection);
+    }
+}
+
+bool HttpClient::Lease::Send(const EncodedRequest& request, Response& response)
+{
+    return _client->Send(*_connection, request, response);
+}
+
+HttpClient::HttpClient(const std::string& endpoint
+        , const std::string& key
+        , const std::shared_ptr<TlsContext>& tls_context)
+    : HttpClient(endpoint, key, tls_context, Config())
+{}
+
+HttpClient::HttpClient(const std::string& endpoint
+        , const std::string& key
+        , const std::shared_ptr<TlsContext>& tls_context
+        , const Config& config)
+    : _tls_context(tls_context)
+    , _config(config)
+    , _resolved(false)
+    , _new_connections(0)
+    , _reused_connections(0)
+    , _retries(0)
+    , _overflows(0)
+    , _timeouts(0)
+    , _flushes(0)
+    , _flushed_requests(0)
+    , _largest_flush(0)
+{
+    // http[s]://host[:port][/path]
+    _tls = endpoint.compare(0, std::strlen(HTTPS_SCHEME), HTTPS_SCHEME) == 0;
+    if (!_tls && endpoint.compare(0, std::strlen(HTTP_SCHEME), HTTP_SCHEME) != 0)
+    {
+        throw std::runtime_error("Unsupported REST endpoint " + endpoint);
+    }
+
+    const std::string authority_and_path = endpoint.substr(std::strlen(_tls ? HTTPS_SCHEME : HTTP_SCHEME));
+    const size_t path_start = authority_and_path.find('/');
+    const std::string authority = authority_and_path.substr(0, path_start);
+    const std::string path = path_start == std::string::npos ? "" : authority_and_path.substr(path_start);
+
+    const size_t port_start = authority.find(':');
+    _host = authority.substr(0, port_start);
+    _port = port_start == std::string::npos ? (_tls ? "443" : "80") : authority.substr(port_start + 1);
+
+    for (const HttpMethod method : {HttpMethod::GET, HttpMethod::POST, HttpMethod::DELETE})
+    {
+        _request_lines[static_cast<int>(method)] = std::string(RequestEncoder::MethodToString(method)) + " " + path;
+    }
+
+    // Everything from the end of the request target up to the timestamp value
+    _fixed_headers = " HTTP/1.1\r\n"
+        "Host: " + authority + "\r\n"
+        "FTXUS-KEY: " + key + "\r\n"
+        "Content-Type: application/json\r\n"
+        "Accept: application/json\r\n"
+        "FTXUS-TS: ";
+
+    for (int i = 0; i < _config.connection_count; ++i)
+    {
+        _connections.push_back(CreateConnection());
+    }
+}
+
+bool HttpClient::WarmUp()
+{
+    boost::asio::ip::tcp::resolver::results_type endpoints;
+    if (!Resolve(endpoints))
+    {
+        return false;
+    }
+
+    std::vector<Lease> leases;
+    leases.reserve(_config.connection_count);
+    for (int i = 0; i < _config.connection_count; ++i)
+    {
+        leases.push_back(Acquire());
+    }
+
+    // One after the other, so every connection after the first resumes the first one's TLS session
+    bool connected = false;
+    for (Lease& lease : leases)
+    {
+        if (lease._connection->stream || Connect(*lease._connection))
+        {
+            connected = true;
+        }
+    }
+
+    return connected;
+}
+
+HttpClient::Lease HttpClient::Acquire()
+{
+    std::lock_guard<std::mutex> lock(_connections_mtx);
+
+    for (const auto& pooled : _connections)
+    {
+        if (!pooled->in_use)
+        {
+            pooled->in_use = true;
+            return Lease(this, pooled.get());
+        }
+    }
+
+    Connection* connection = CreateConnection().release();
+    connection->pooled = false;
+    connection->in_use = true;
+    ++_overflows;
+
+    return Lease(this, connection);
+}
+
+void HttpClient::SendBatch(const std::vector<const EncodedRequest*>& requests, const BatchHandler_t& on_response)
+{
+    const size_t depth = static_cast<size_t>(std::max(_config.max_pipeline_depth, 1));
+
+    size_t next = 0;
+    while (next < requests.size())
+    {
+        const size_t remaining = requests.size() - next;
+        std::vector<Lease> leases = AcquireIdle(remaining);
+
+        // Spread evenly, so no response waits behind more pipelined ones than it has to
+        const size_t count = std::min(remaining, leases.size() * depth);
+        const size_t per_lease = count / leases.size();
+        const size_t extra = count % leases.size();
+
+        std::vector<Share> shares;
+        shares.reserve(leases.size());
+
+        const uint64_t start_ns = clock::MonotonicNs();
+
+        size_t first = next;
+        for (size_t i = 0; i < leases.size(); ++i)
+        {
+            const size_t share_count = per_lease + (i < extra ? 1 : 0);
+            if (share_count == 0)
+            {
+                break;
+            }
+
+            Connection& connection = *leases[i]._connection;
+            connection.request.clear();
+            for (size_t j = first; j < first + share_count; ++j)
+            {
+                Render(connection, *requests[j]);
+            }
+
+            shares.push_back(Share{std::move(leases[i]), first, share_count, false, false, 0});
+            first += share_count;
+        }
+
+        Flush(shares);
+
+        _flush_latency.Record(clock::MonotonicNs() - start_ns);
+        ++_flushes;
+        _flushed_requests += count;
+
+        uint64_t largest = _largest_flush.load(std::memory_order_relaxed);
+        while (count > largest && !_largest_flush.compare_exchange_weak(largest, count, std::memory_order_relaxed))
+        {}
+
+        for (Share& share : shares)
+        {
+            Receive(share, on_response);
+        }
+
+        next += count;
+    }
+}
+
+HttpClient::Stats HttpClient::GetStats() const
+{
+    Stats stats;
+
+    stats.new_connections = _new_connections.load(std::memory_order_relaxed);
+    stats.reused_connections = _reused_connections.load(std::memory_order_relaxed);
+    stats.retries = _retries.load(std::memory_order_relaxed);
+    stats.overflows = _overflows.load(std::memory_order_relaxed);
+    stats.timeouts = _timeouts.load(std::memory_order_relaxed);
+
+    stats.flushes = _flushes.load(std::memory_order_relaxed);
+    stats.flushed_requests = _flushed_requests.load(std::memory_order_relaxed);
+    stats.largest_flush = _largest_flush.load(std::memory_order_relaxed);
+    stats.flush = _flush_latency.GetSnapshot();
+
+    return stats;
+}
+
+std::unique_ptr<HttpClient::Connection> HttpClient::CreateConnection() const
+{
+    auto connection = std::make_unique<Connection>();
+    connection->request.reserve(INITIAL_REQUEST_BUFFER);
+    connection->response.resize(INITIAL_RESPONSE_BUFFER);
+
+    return connection;
+}
+
+void HttpClient::Release(Connection* connection)
+{
+    if (!connection->pooled)
+    {
+        Close(*connection);
+        delete connection;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_connections_mtx);
+    connection->in_use = false;
+}
+
+std::vector<HttpClient::Lease> HttpClient::AcquireIdle(const size_t count)
+{
+    std::vector<Lease> leases;
+
+    {
+        std::lock_guard<std::mutex> lock(_connections_mtx);
+
+        for (const auto& pooled : _connections)
+        {
+            if (leases.size() == count)
+            {
+                break;
+            }
+
+            if (!pooled->in_use)
+            {
+                pooled->in_use = true;
+                leases.push_back(Lease(this, pooled.get()));
+            }
+        }
+    }
+
+    if (leases.empty())
+    {
+        leases.push_back(Acquire());
+    }
+
+    return leases;
+}
+
+bool HttpClient::Resolve(boost::asio::ip::tcp::resolver::results_type& endpoints)
+{
+    std::lock_guard<std::mutex> lock(_resolve_mtx);
+
+    if (!_resolved)
+    {
+        boost::system::error_code ec;
+        boost::asio::ip::tcp::resolver resolver(_io);
+        _endpoints = resolver.resolve(_host, _port, ec);
+
+        if (ec || _endpoints.empty())
+        {
+            return false;
+        }
+
+        _resolved = true;
+    }
+
+    endpoints = _endpoints;
+    return true;
+}
+
+bool HttpClient::Connect(Connection& connection)
+{
+    boost::asio::ip::tcp::resolver::results_type endpoints;
+    if (!Resolve(endpoints))
+    {
+        return false;
+    }
+
+    connection.stream = std::make_unique<Stream_t>(connection.io, *_tls_context->GetContext());
+    connection.expired = false;
+
+    const uint64_t deadline_ns = Deadline(_config.connect_timeout_ns);
+
+    bool done = false;
+    boost::system::error_code ec;
+    boost::asio::async_connect(connection.stream->lowest_layer(), endpoints
+            , [&done, &ec](const boost::system::error_code& error, const boost::asio::ip::tcp::endpoint&)
+    {
+        ec = error;
+        done = true;
+    });
+
+    if (!Await(connection, deadline_ns, done) || ec)
+    {
+        Close(connection);
+        return false;
+    }
+
+    _config.socket_options.Apply(connection.stream->lowest_layer().native_handle());
+
+    if (_tls)
+    {
+        _tls_context->PrepareSession(connection.stream->native_handle(), _host);
+
+        const uint64_t start_ns = clock::MonotonicNs();
+
+        done = false;
+        connection.stream->async_handshake(Stream_t::client, [&done, &ec](const boost::system::error_code& error)
+        {
+            ec = error;
+            done = true;
+        });
+
+        if (!Await(connection, deadline_ns, done) || ec || !_tls_context->IsVerified(connection.stream->native_handle()))
+        {
+            Close(connection);
+            return false;
+        }
+
+        _tls_context->RecordHandshake(connection.stream->native_handle(), clock::MonotonicNs() - start_ns);
+    }
+
+    ++_new_connections;
+
+    return true;
+}
+
+void HttpClient::Close(Connection& connection)
+{
+    if (!connection.stream)
+    {
+        return;
+    }
+
+    // No TLS close_notify: the peer may already be gone and this must not block
+    boost::system::error_code ec;
+    CloseSocket(connection.stream->next_layer(), ec);
+    connection.stream.reset();
+
+    connection.buffered = 0;
+    connection.consumed = 0;
+}
+
+void HttpClient::Render(Connection& connection, const EncodedRequest& request) const
+{
+    auto& out = connection.request;
+    char number[32];
+
+    out.append(_request_lines[static_cast<int>(request.method)]);
+    out.append(request.path.View());
+    out.append(_fixed_headers);
+    out.append(request.timestamp.View());
+    out.append(SIGN_HEADER);
+    out.append(request.signature.View());
+    out.append(LENGTH_HEADER);
+    out.append(number, RequestEncoder::FormatUInt(number, request.body.size));
+    out.append(HEAD_END);
+    out.append(request.body.View());
+}
+
+bool HttpClient::Send(Connection& connection, const EncodedRequest& request, Response& response)
+{
+    const uint64_t start_ns = clock::MonotonicNs();
+
+    response = Response();
+    connection.request.clear();
+    Render(connection, request);
+    response.render_ns = clock::MonotonicNs() - start_ns;
+
+    const bool reused = connection.stream != nullptr;
+    if (reused)
+    {
+        ++_reused_connections;
+    }
+    else if (!Connect(connection))
+    {
+        return false;
+    }
+
+    bool received = false;
+    uint64_t write_ns = clock::MonotonicNs();
+    if (Write(connection) && ReadResponse(connection, response, received, write_ns))
+    {
+        return true;
+    }
+
+    Close(connection);
+
+    // A kept alive connection the server closed while idle fails before anything comes back.
+    // Like curl, that request is sent once more on a new connection; once any response data
+    // arrived, or a deadline passed, the request may have been acted on, so it is not.
+    if (!reused || received || connection.expired)
+    {
+        return false;
+    }
+
+    ++_retries;
+
+    if (Connect(connection))
+    {
+        write_ns = clock::MonotonicNs();
+        if (Write(connection) && ReadResponse(connection, response, received, write_ns))
+        {
+            return true;
+        }
+    }
+
+    Close(connection);
+    return false;
+}
+
+void HttpClient::Flush(std::vector<Share>& shares)
+{
+    for (Share& share : shares)
+    {
+        Connection& connection = *share.lease._connection;
+
+        share.reused = connection.stream != nullptr;
+        if (share.reused)
+        {
+            ++_reused_connections;
+        }
+        else if (!Connect(connection))
+        {
+            continue;
+        }
+
+        share.write_ns = clock::MonotonicNs();
+        share.written = Write(connection);
+
+        // Same rule as a single request: a reused connection that fails before anything came
+        // back is written once more on a new one
+        if (!share.written && share.reused && !connection.expired)
+        {
+            Close(connection);
+            ++_retries;
+
+            share.reused = false;
+            if (Connect(connection))
+            {
+                share.write_ns = clock::MonotonicNs();
+                share.written = Write(connection);
+            }
+        }
+    }
+}
+
+void HttpClient::Receive(Share& share, const BatchHandler_t& on_response)
+{
+    Connection& connection = *share.lease._connection;
+
+    for (size_t i = 0; i < share.count; ++i)
+    {
+        Response response;
+        bool received = false;
+        bool answered = share.written && ReadResponse(connection, response, received, share.write_ns);
+
+        if (!answered && i == 0 && share.reused && !received && !connection.expired)
+        {
+            Close(connection);
+            ++_retries;
+
+            if (Connect(connection))
+            {
+                share.write_ns = clock::MonotonicNs();
+                answered = Write(connection) && ReadResponse(connection, response, received, share.write_ns);
+            }
+        }
+
+        if (!answered)
+        {
+            // The requests still pipelined behind a failed one are not retried either: the
+            // server may have acted on any of them
+            Close(connection);
+
+            for (; i < share.count; ++i)
+            {
+                on_response(share.first + i, Response());
+            }
+
+            return;
+        }
+
+        on_response(share.first + i, response);
+    }
+}
+
+bool HttpClient::ReadResponse(Connection& connection, Response& response, bool& received, const uint64_t write_ns)
+{
+    std::vector<char>& buffer = connection.response;
+
+    // Whatever follows the previous response belongs to the next pipelined one
+    if (connection.consumed > 0)
+    {
+        connection.buffered -= connection.consumed;
+        std::memmove(buffer.data(), buffer.data() + connection.consumed, connection.buffered);
+        connection.consumed = 0;
+    }
+
+    if (connection.buffered > 0)
+    {
+        received = true;
+        response.first_byte_ns = clock::MonotonicNs() - write_ns;
+    }
+
+    const uint64_t deadline_ns = Deadline(_config.read_timeout_ns);
+
+    bool closed = false;
+    while (true)
+    {
+        if (connection.buffered > 0 || closed)
+        {
+            bool keep_alive = true;
+            size_t consumed = 0;
+            const ParseResult result = ParseResponse(buffer.data(), connection.buffered, closed, response, keep_alive, consumed);
+
+            if (result == ParseResult::INVALID)
+            {
+                return false;
+            }
+
+            if (result == ParseResult::COMPLETE)
+            {
+                connection.consumed = consumed;
+
+                if (!keep_alive)
+                {
+                    Close(connection);
+                }
+
+                return true;
+            }
+        }
+
+        if (closed || !connection.stream)
+        {
+            return false;
+        }
+
+        if (buffer.size() - connection.buffered < MIN_READ_SPACE)
+        {
+            if (buffer.size() >= MAX_RESPONSE_BYTES)
+            {
+                return false;
+            }
+
+            buffer.resize(std::max(buffer.size() * 2, connection.buffered + MIN_READ_SPACE));
+        }
+
+        boost::system::error_code ec;
+        const size_t bytes = ReadSome(connection, buffer.data() + connection.buffered, buffer.size() - connection.buffered, deadline_ns, ec);
+
+        // Not the end of a body that runs until the connection closes
+        if (connection.expired)
+        {
+            return false;
+        }
+
+        if (bytes > 0 && !received)
+        {
+            received = true;
+            response.first_byte_ns = clock::MonotonicNs() - write_ns;
+        }
+
+        connection.buffered += bytes;
+        closed = static_cast<bool>(ec);
+    }
+}
+
+bool HttpClient::Write(Connection& connection)
+{
+    const auto buffer = boost::asio::buffer(connection.request.data(), connection.request.size());
+    const uint64_t deadline_ns = Deadline(_config.write_timeout_ns);
+
+    bool done = false;
+    boost::system::error_code ec;
+    const auto on_written = [&done, &ec](const boost::system::error_code& error, const size_t)
+    {
+        ec = error;
+        done = true;
+    };
+
+    if (_tls)
+    {
+        boost::asio::async_write(*connection.stream, buffer, on_written);
+    }
+    else
+    {
+        boost::asio::async_write(connection.stream->next_layer(), buffer, on_written);
+    }
+
+    return Await(connection, deadline_ns, done) && !ec;
+}
+
+size_t HttpClient::ReadSome(Connection& connection, char* data, const size_t size, const uint64_t deadline_ns, boost::system::error_code& ec)
+{
+    bool done = false;
+    size_t bytes = 0;
+    const auto on_read = [&done, &ec, &bytes](const boost::system::error_code& error, const size_t read)
+    {
+        ec = error;
+        bytes = read;
+        done = true;
+    };
+
+    if (_tls)
+    {
+        connection.stream->async_read_some(boost::asio::buffer(data, size), on_read);
+    }
+    else
+    {
+        connection.stream->next_layer().async_read_some(boost::asio::buffer(data, size), on_read);
+    }
+
+    if (!Await(connection, deadline_ns, done))
+    {
+        ec = boost::asio::error::timed_out;
+        return 0;
+    }
+
+    if (_config.socket_options.quick_ack)
+    {
+        SocketOptions::RearmQuickAck(connection.stream->lowest_layer().native_handle());
+    }
+
+    return bytes;
+}
+
+bool HttpClient::Await(Connection& connection, const uint64_t deadline_ns, const bool& done)
+{
+    boost::asio::io_context& io = connection.io;
+    io.restart();
+
+    while (!done)
+    {
+        if (deadline_ns == 0)
+        {
+            io.run_one();
+            continue;
+        }
+
+        const uint64_t now_ns = clock::MonotonicNs();
+        if (now_ns < deadline_ns)
+        {
+            io.run_one_for(std::chrono::nanoseconds(deadline_ns - now_ns));
+            continue;
+        }
+
+        // The aborted operation's handler still refers to the caller's state, so it has to
+        // run before returning. Only until then: with io_uring the context always has the
+        // ring's wait pending and would never run out of work.
+        boost::system::error_code ec;
+        CloseSocket(connection.stream->next_layer(), ec);
+
+        io.restart();
+        while (!done)
+        {
+            io.run_one();
+        }
+
+        connection.expired = true;
+        ++_timeouts;
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace ftx
\ No newline at end of file
@@ -0,0 +1,386 @@
+#include "IoUring.h"
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <boost/asio/post.hpp>
+
+namespace ftx
+{
+
+namespace
+{
+
+static constexpr const unsigned RING_ENTRIES = 256;
+
+// Registered receive buffers; the count must be a power of two
+static constexpr const unsigned BUFFER_COUNT = 64;
+static constexpr const size_t BUFFER_SIZE = 16 * 1024;
+static constexpr const uint16_t BUFFER_GROUP = 0;
+
+static void* Map(const int fd, const size_t size, const off_t offset)
+{
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return memory == MAP_FAILED ? nullptr : memory;
+}
+
+}
+
+boost::asio::execution_context::id IoUring::id;
+
+IoUring::IoUring(boost::asio::execution_context& context)
+    : boost::asio::execution_context::service(context)
+    , _ring_fd(-1)
+    , _event_fd(-1)
+    , _sq_ring(nullptr)
+    , _sq_ring_size(0)
+    , _cq_ring(nullptr)
+    , _cq_ring_size(0)
+    , _sqes(nullptr)
+    , _sqes_size(0)
+    , _sq_pending(0)
+    , _poll_posted(false)
+    , _buffer_ring(nullptr)
+    , _buffer_ring_size(0)
+    , _buffers(nullptr)
+    , _next_user_data(1)
+    , _event(static_cast<boost::asio::io_context&>(context))
+    , _submits(0)
+    , _completions(0)
+    , _wakeups(0)
+    , _buffer_exhaustions(0)
+{
+    io_uring_params params{};
+    _ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+    if (_ring_fd < 0)
+    {
+        Fail("io_uring_setup");
+    }
+
+    _sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap)
+    {
+        _sq_ring_size = std::max(_sq_ring_size, _cq_ring_size);
+        _cq_ring_size = _sq_ring_size;
+    }
+
+    _sq_ring = Map(_ring_fd, _sq_ring_size, IORING_OFF_SQ_RING);
+    _cq_ring = single_mmap ? _sq_ring : Map(_ring_fd, _cq_ring_size, IORING_OFF_CQ_RING);
+    _sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    _sqes = static_cast<io_uring_sqe*>(Map(_ring_fd, _sqes_size, IORING_OFF_SQES));
+
+    if (!_sq_ring || !_cq_ring || !_sqes)
+    {
+        Fail("io_uring mmap");
+    }
+
+    char* sq = static_cast<char*>(_sq_ring);
+    _sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    _sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    _sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    _sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char* cq = static_cast<char*>(_cq_ring);
+    _cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    _cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    _cq_flags = reinterpret_cast<unsigned*>(cq + params.cq_off.flags);
+    _cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    _cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // Provided buffer ring: the kernel picks a free buffer for each receive completion
+    _buffer_ring_size = BUFFER_COUNT * sizeof(io_uring_buf);
+    void* buffer_ring = mmap(nullptr, _buffer_ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (buffer_ring == MAP_FAILED)
+    {
+        Fail("io_uring buffer ring mmap");
+    }
+
+    _buffer_ring = static_cast<io_uring_buf*>(buffer_ring);
+    _buffers = new char[BUFFER_COUNT * BUFFER_SIZE];
+
+    io_uring_buf_reg registration{};
+    registration.ring_addr = reinterpret_cast<uint64_t>(_buffer_ring);
+    registration.ring_entries = BUFFER_COUNT;
+    registration.bgid = BUFFER_GROUP;
+
+    if (syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0)
+    {
+        Fail("io_uring buffer ring registration");
+    }
+
+    for (uint16_t buffer_id = 0; buffer_id < BUFFER_COUNT; ++buffer_id)
+    {
+        ReleaseBuffer(buffer_id);
+    }
+
+    _event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_event_fd < 0 || syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_EVENTFD, &_event_fd, 1) < 0)
+    {
+        Fail("io_uring eventfd registration");
+    }
+
+    _event.assign(_event_fd);
+
+    WaitForCompletions();
+}
+
+IoUring::~IoUring()
+{
+    Release();
+}
+
+void IoUring::Release()
+{
+    // Once assigned, the eventfd belongs to _event
+    if (_event_fd >= 0 && !_event.is_open())
+    {
+        close(_event_fd);
+    }
+
+    if (_sqes)
+    {
+        munmap(_sqes, _sqes_size);
+    }
+
+    if (_cq_ring && _cq_ring != _sq_ring)
+    {
+        munmap(_cq_ring, _cq_ring_size);
+    }
+
+    if (_sq_ring)
+    {
+        munmap(_sq_ring, _sq_ring_size);
+    }
+
+    if (_ring_fd >= 0)
+    {
+        close(_ring_fd);
+    }
+
+    if (_buffer_ring)
+    {
+        munmap(_buffer_ring, _buffer_ring_size);
+    }
+
+    delete[] _buffers;
+}
+
+void IoUring::Fail(const std::string& what)
+{
+    const int error = errno;
+    Release();
+
+    throw std::runtime_error(what + ": " + std::strerror(error));
+}
+
+void IoUring::Receive(const int fd, const std::shared_ptr<Operation>& operation)
+{
+    io_uring_sqe* sqe = NextSqe();
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = _next_user_data;
+
+    _operations.emplace(_next_user_data++, operation);
+
+    Submit();
+}
+
+void IoUring::Send(const int fd, const void* data, const size_t size, const std::shared_ptr<Operation>& operation)
+{
+    io_uring_sqe* sqe = NextSqe();
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(size);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = _next_user_data;
+
+    _operations.emplace(_next_user_data++, operation);
+
+    Submit();
+}
+
+size_t IoUring::Poll()
+{
+    unsigned head = *_cq_head;
+    const unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+
+    size_t count = 0;
+    while (head != tail)
+    {
+        const io_uring_cqe cqe = _cqes[head & _cq_mask];
+
+        // Hand the slot back first, the operation may submit more
+        ++head;
+        __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+        ++count;
+
+        auto entry = _operations.find(cqe.user_data);
+        if (entry == std::end(_operations))
+        {
+            continue;
+        }
+
+        const bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+        const std::shared_ptr<Operation> operation = entry->second;
+        if (!more)
+        {
+            _operations.erase(entry);
+        }
+
+        if (cqe.res == -ENOBUFS)
+        {
+            ++_buffer_exhaustions;
+        }
+
+        const bool has_buffer = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+        const uint16_t buffer_id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+
+        operation->OnComplete(cqe.res, has_buffer ? _buffers + buffer_id * BUFFER_SIZE : nullptr, more);
+
+        if (has_buffer)
+        {
+            ReleaseBuffer(buffer_id);
+        }
+    }
+
+    _completions.fetch_add(count, std::memory_order_relaxed);
+    return count;
+}
+
+IoUring::Stats IoUring::GetStats() const
+{
+    Stats stats;
+
+    stats.submits = _submits.load(std::memory_order_relaxed);
+    stats.completions = _completions.load(std::memory_order_relaxed);
+    stats.wakeups = _wakeups.load(std::memory_order_relaxed);
+    stats.buffer_exhaustions = _buffer_exhaustions.load(std::memory_order_relaxed);
+
+    return stats;
+}
+
+void IoUring::shutdown()
+{
+    // Operations hold handlers which may own the sockets that own operations
+    std::unordered_map<uint64_t, std::shared_ptr<Operation>> operations;
+    operations.swap(_operations);
+}
+
+io_uring_sqe* IoUring::NextSqe()
+{
+    if (*_sq_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) > _sq_mask)
+    {
+        Submit();
+    }
+
+    // Without SQPOLL the kernel only reads entries inside io_uring_enter, so the entry can
+    // be published before the caller fills it in
+    const unsigned tail = *_sq_tail;
+    const unsigned index = tail & _sq_mask;
+
+    io_uring_sqe* sqe = &_sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    _sq_array[index] = index;
+
+    __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++_sq_pending;
+
+    return sqe;
+}
+
+void IoUring::Submit()
+{
+    if (_sq_pending == 0)
+    {
+        return;
+    }
+
+    __atomic_or_fetch(_cq_flags, IORING_CQ_EVENTFD_DISABLED, __ATOMIC_RELEASE);
+
+    while (_sq_pending > 0)
+    {
+        const long submitted = syscall(__NR_io_uring_enter, _ring_fd, _sq_pending, 0, 0, nullptr, 0);
+        ++_submits;
+
+        if (submitted < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            // Left queued, the next submission retries them
+            break;
+        }
+
+        _sq_pending -= static_cast<unsigned>(submitted);
+    }
+
+    __atomic_and_fetch(_cq_flags, ~IORING_CQ_EVENTFD_DISABLED, __ATOMIC_RELEASE);
+
+    // Whatever completed meanwhile signalled nothing. Completion handlers may not run inside
+    // the initiating call, so they are drained from the io context's queue.
+    if (!_poll_posted && *_cq_head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE))
+    {
+        _poll_posted = true;
+        boost::asio::post(_event.get_executor(), [this]()
+        {
+            _poll_posted = false;
+            Poll();
+        });
+    }
+}
+
+void IoUring::WaitForCompletions()
+{
+    _event.async_wait(boost::asio::posix::stream_descriptor::wait_read
+            , [this](const boost::system::error_code& ec)
+    {
+        if (ec)
+        {
+            return;
+        }
+
+        uint64_t signalled;
+        if (read(_event_fd, &signalled, sizeof(signalled)) > 0)
+        {
+            ++_wakeups;
+        }
+
+        Poll();
+        WaitForCompletions();
+    });
+}
+
+void IoUring::ReleaseBuffer(const uint16_t buffer_id)
+{
+    uint16_t* tail_ptr = &_buffer_ring[0].resv;
+    const uint16_t tail = *tail_ptr;
+
+    io_uring_buf& buffer = _buffer_ring[tail & (BUFFER_COUNT - 1)];
+    buffer.addr = reinterpret_cast<uint64_t>(_buffers + buffer_id * BUFFER_SIZE);
+    buffer.len = BUFFER_SIZE;
+    buffer.bid = buffer_id;
+
+    __atomic_store_n(tail_ptr, static_cast<uint16_t>(tail + 1), __ATOMIC_RELEASE);
+}
+
+} // namespace ftx
\ No newline at end of file
@@ -0,0 +1,234 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+
+namespace ftx
+{
+
+namespace
+{
+
+static inline void AtomicMin(std::atomic<uint64_t>& target, const uint64_t value)
+{
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (value < current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {}
+}
+
+static inline void AtomicMax(std::atomic<uint64_t>& target, const uint64_t value)
+{
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {}
+}
+
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    Reset();
+}
+
+void LatencyHistogram::Record(const uint64_t value_ns)
+{
+    _buckets[BucketIndex(value_ns)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value_ns, std::memory_order_relaxed);
+    AtomicMin(_min, value_ns);
+    AtomicMax(_max, value_ns);
+}
+
+void LatencyHistogram::Reset()
+{
+    for (auto& bucket : _buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+
+    _count.store(0, std::memory_order_relaxed);
+    _sum.store(0, std::memory_order_relaxed);
+    _min.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::GetSnapshot() const
+{
+    Snapshot snapshot;
+
+    uint64_t total = 0;
+    for (const auto& bucket : _buckets)
+    {
+        total += bucket.load(std::memory_order_relaxed);
+    }
+
+    if (total == 0)
+    {
+        return snapshot;
+    }
+
+    snapshot.count = total;
+    snapshot.min_ns = _min.load(std::memory_order_relaxed);
+    snapshot.max_ns = _max.load(std::memory_order_relaxed);
+    snapshot.mean_ns = static_cast<double>(_sum.load(std::memory_order_relaxed)) / total;
+
+    const auto rank = [total](const double quantile)
+    {
+        const uint64_t r = static_cast<uint64_t>(quantile * total + 0.5);
+        return r == 0 ? 1 : r;
+    };
+
+    struct Target
+    {
+        uint64_t rank;
+        uint64_t* value;
+    };
+
+    std::array<Target, 4> targets
+    {{
+        {rank(0.5), &snapshot.p50_ns},
+        {rank(0.9), &snapshot.p90_ns},
+        {rank(0.99), &snapshot.p99_ns},
+        {rank(0.999), &snapshot.p999_ns}
+    }};
+
+    uint64_t seen = 0;
+    std::size_t next_target = 0;
+    for (int i = 0; i < NUM_BUCKETS && next_target < targets.size(); ++i)
+    {
+        seen += _buckets[i].load(std::memory_order_relaxed);
+        while (next_target < targets.size() && seen >= targets[next_target].rank)
+        {
+            const uint64_t upper = BucketUpperBound(i);
+            *targets[next_target].value = upper > snapshot.max_ns ? snapshot.max_ns : upper;
+            ++next_target;
+        }
+    }
+
+    return snapshot;
+}
+
+uint64_t LatencyHistogram::GetPercentile(const double quantile) const
+{
+    uint64_t total = 0;
+    for (const auto& bucket : _buckets)
+    {
+        total += bucket.load(std::memory_order_relaxed);
+    }
+
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(quantile * total + 0.5));
+    const uint64_t max = _max.load(std::memory_order_relaxed);
+
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; ++i)
+    {
+        seen += _buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+        {
+            const uint64_t upper = BucketUpperBound(i);
+            return upper > max ? max : upper;
+        }
+    }
+
+    return max;
+}
+
+void LatencyHistogram::AddTo(LatencyHistogram& target) const
+{
+    for (int i = 0; i < NUM_BUCKETS; ++i)
+    {
+        const uint64_t count = _buckets[i].load(std::memory_order_relaxed);
+        if (count != 0)
+        {
+            target._buckets[i].fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+
+    target._count.fetch_add(_count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    target._sum.fetch_add(_sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    AtomicMin(target._min, _min.load(std::memory_order_relaxed));
+    AtomicMax(target._max, _max.load(std::memory_order_relaxed));
+}
+
+int LatencyHistogram::BucketIndex(const uint64_t value)
+{
+    if (value < 2 * SUB_BUCKETS)
+    {
+        return static_cast<int>(value);
+    }
+
+    const int msb = 63 - __builtin_clzll(value);
+    const int shift = msb - SUB_BUCKET_BITS;
+
+    return 2 * SUB_BUCKETS + (shift - 1) * SUB_BUCKETS + static_cast<int>((value >> shift) - SUB_BUCKETS);
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(const int index)
+{
+    if (index < 2 * SUB_BUCKETS)
+    {
+        return index;
+    }
+
+    const int shift = (index - 2 * SUB_BUCKETS) / SUB_BUCKETS + 1;
+    const uint64_t mantissa = (index - 2 * SUB_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+
+    return (mantissa << shift) + ((uint64_t{1} << shift) - 1);
+}
+
+RollingLatencyHistogram::RollingLatencyHistogram(const uint64_t slot_ns)
+    : _slot_ns(slot_ns)
+{}
+
+void RollingLatencyHistogram::Record(const uint64_t now_ns, const uint64_t value_ns)
+{
+    // Epochs are stored off by one so a zero epoch always means "never used"
+    const uint64_t epoch = now_ns / _slot_ns + 1;
+    Slot& slot = _slots[epoch % NUM_SLOTS];
+
+    if (slot.epoch.load(std::memory_order_acquire) != epoch)
+    {
+        slot.histogram.Reset();
+        slot.epoch.store(epoch, std::memory_order_release);
+    }
+
+    slot.histogram.Record(value_ns);
+}
+
+LatencyHistogram::Snapshot RollingLatencyHistogram::GetSnapshot(const uint64_t now_ns) const
+{
+    LatencyHistogram merged;
+    MergeInto(now_ns, merged);
+
+    return merged.GetSnapshot();
+}
+
+uint64_t RollingLatencyHistogram::GetPercentile(const uint64_t now_ns, const double quantile) const
+{
+    LatencyHistogram merged;
+    MergeInto(now_ns, merged);
+
+    return merged.GetPercentile(quantile);
+}
+
+void RollingLatencyHistogram::MergeInto(const uint64_t now_ns, LatencyHistogram& merged) const
+{
+    const uint64_t epoch = now_ns / _slot_ns + 1;
+
+    for (const Slot& slot : _slots)
+    {
+        const uint64_t slot_epoch = slot.epoch.load(std::memory_order_acquire);
+        if (slot_epoch != 0 && slot_epoch + NUM_SLOTS > epoch)
+        {
+            slot.histogram.AddTo(merged);
+        }
+    }
+}
+
+} // namespace ftx
\ No newline at end of file
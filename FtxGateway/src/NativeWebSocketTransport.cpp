@@ -0,0 +1,554 @@
+#include "NativeWebSocketTransport.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include "Clock.h"
+
+namespace ftx
+{
+namespace ws
+{
+
+namespace
+{
+
+static constexpr const char* SCHEME = "wss://";
+static constexpr const char* DEFAULT_PORT = "443";
+
+static constexpr const char* ACCEPT_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+static constexpr const char* ACCEPT_HEADER = "sec-websocket-accept:";
+
+// Room for at least one full TLS record per read
+static constexpr const size_t MIN_READ_SPACE = 16 * 1024;
+static constexpr const size_t INITIAL_READ_BUFFER = 64 * 1024;
+
+static constexpr const size_t MAX_UPGRADE_RESPONSE = 16 * 1024;
+static constexpr const uint64_t MAX_MESSAGE_BYTES = 64 * 1024 * 1024;
+
+static std::string Base64(const unsigned char* data, const size_t size)
+{
+    std::string encoded(4 * ((size + 2) / 3), '\0');
+    const int length = EVP_EncodeBlock(reinterpret_cast<unsigned char*>(&encoded[0]), data, static_cast<int>(size));
+    encoded.resize(length);
+
+    return encoded;
+}
+
+static std::string AcceptKey(const std::string& key)
+{
+    const std::string accept = key + ACCEPT_GUID;
+
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1(reinterpret_cast<const unsigned char*>(accept.data()), accept.size(), digest);
+
+    return Base64(digest, sizeof(digest));
+}
+
+}
+
+NativeWebSocketTransport::NativeWebSocketTransport(const std::string& endpoint
+        , const std::shared_ptr<TlsContext>& tls_context
+        , const SocketOptions& socket_options
+        , const Handlers& handlers)
+    : _tls_context(tls_context)
+    , _socket_options(socket_options)
+    , _handlers(handlers)
+    , _io()
+    , _work(boost::asio::make_work_guard(_io))
+    , _resolver(_io)
+    , _mask_rng(std::random_device()())
+{
+    // wss://host[:port][/path]
+    if (endpoint.compare(0, std::strlen(SCHEME), SCHEME) != 0)
+    {
+        throw std::runtime_error("Unsupported websocket endpoint " + endpoint);
+    }
+
+    const std::string authority_and_path = endpoint.substr(std::strlen(SCHEME));
+    const size_t path_start = authority_and_path.find('/');
+    const std::string authority = authority_and_path.substr(0, path_start);
+
+    _path = path_start == std::string::npos ? "/" : authority_and_path.substr(path_start);
+
+    const size_t port_start = authority.find(':');
+    _host = authority.substr(0, port_start);
+    _port = port_start == std::string::npos ? DEFAULT_PORT : authority.substr(port_start + 1);
+}
+
+NativeWebSocketTransport::~NativeWebSocketTransport()
+{
+    Stop();
+}
+
+boost::asio::io_context& NativeWebSocketTransport::GetIoContext()
+{
+    return _io;
+}
+
+void NativeWebSocketTransport::Connect()
+{
+    boost::asio::dispatch(_io, [this]()
+    {
+        auto connection = std::make_shared<Connection>(_io, *_tls_context->GetContext());
+        connection->read_buffer.resize(INITIAL_READ_BUFFER);
+
+        _connection = connection;
+
+        _resolver.async_resolve(_host, _port
+                , [this, connection](const boost::system::error_code& ec, const boost::asio::ip::tcp::resolver::results_type& endpoints)
+        {
+            OnResolve(connection, ec, endpoints);
+        });
+    });
+}
+
+void NativeWebSocketTransport::Send(const std::string& text)
+{
+    boost::asio::dispatch(_io, [this, text]()
+    {
+        if (_connection && _connection->open)
+        {
+            QueueFrame(_connection, frame::Opcode::TEXT, text.data(), text.size());
+        }
+    });
+}
+
+void NativeWebSocketTransport::Ping(const std::string& payload)
+{
+    boost::asio::dispatch(_io, [this, payload]()
+    {
+        if (_connection && _connection->open)
+        {
+            QueueFrame(_connection, frame::Opcode::PING, payload.data(), payload.size());
+        }
+    });
+}
+
+void NativeWebSocketTransport::Stop()
+{
+    _work.reset();
+    _io.stop();
+}
+
+void NativeWebSocketTransport::OnResolve(const ConnectionPtr_t& connection
+        , const boost::system::error_code& ec
+        , const boost::asio::ip::tcp::resolver::results_type& endpoints)
+{
+    if (ec)
+    {
+        Disconnect(connection, true);
+        return;
+    }
+
+    boost::asio::async_connect(connection->stream.lowest_layer(), endpoints
+            , [this, connection](const boost::system::error_code& ec, const boost::asio::ip::tcp::endpoint&)
+    {
+        OnConnect(connection, ec);
+    });
+}
+
+void NativeWebSocketTransport::OnConnect(const ConnectionPtr_t& connection, const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        Disconnect(connection, true);
+        return;
+    }
+
+    // Reads go straight to recvmsg, which must never block the io thread
+    auto& socket = connection->stream.lowest_layer();
+    boost::system::error_code option_ec;
+    socket.non_blocking(true, option_ec);
+    _socket_options.Apply(socket.native_handle());
+
+    _tls_context->PrepareSession(connection->stream.native_handle(), _host);
+    connection->handshake_start_ns = clock::MonotonicNs();
+
+    connection->stream.async_handshake(boost::asio::ssl::stream_base::client
+            , [this, connection](const boost::system::error_code& ec)
+    {
+        OnTlsHandshake(connection, ec);
+    });
+}
+
+void NativeWebSocketTransport::OnTlsHandshake(const ConnectionPtr_t& connection, const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        Disconnect(connection, true);
+        return;
+    }
+
+    unsigned char key[16];
+    for (size_t i = 0; i < sizeof(key); i += 4)
+    {
+        const frame::MaskKey_t random = NextMask();
+        std::memcpy(key + i, random.data(), random.size());
+    }
+
+    connection->upgrade_key = Base64(key, sizeof(key));
+
+    QueueWrite(connection, "GET " + _path + " HTTP/1.1\r\n"
+            "Host: " + _host + "\r\n"
+            "Upgrade: websocket\r\n"
+            "Connection: Upgrade\r\n"
+            "Sec-WebSocket-Key: " + connection->upgrade_key + "\r\n"
+            "Sec-WebSocket-Version: 13\r\n"
+            "\r\n");
+
+    ReadUpgradeResponse(connection);
+}
+
+void NativeWebSocketTransport::ReadUpgradeResponse(const ConnectionPtr_t& connection)
+{
+    EnsureReadSpace(*connection, MIN_READ_SPACE);
+
+    connection->stream.async_read_some(boost::asio::buffer(connection->read_buffer.data() + connection->read_end
+                , connection->read_buffer.size() - connection->read_end)
+            , [this, connection](const boost::system::error_code& ec, const size_t bytes)
+    {
+        OnUpgradeResponse(connection, ec, bytes);
+    });
+}
+
+void NativeWebSocketTransport::OnUpgradeResponse(const ConnectionPtr_t& connection, const boost::system::error_code& ec, const size_t bytes)
+{
+    if (ec)
+    {
+        Disconnect(connection, true);
+        return;
+    }
+
+    connection->read_end += bytes;
+
+    const char* begin = connection->read_buffer.data();
+    const char* end = begin + connection->read_end;
+
+    static constexpr const char HEADER_END[] = "\r\n\r\n";
+    const char* header_end = std::search(begin, end, HEADER_END, HEADER_END + 4);
+
+    if (header_end == end)
+    {
+        if (connection->read_end > MAX_UPGRADE_RESPONSE)
+        {
+            Disconnect(connection, true);
+            return;
+        }
+
+        ReadUpgradeResponse(connection);
+        return;
+    }
+
+    if (!IsUpgradeAccepted(connection, std::string(begin, header_end)))
+    {
+        std::cerr << "Websocket upgrade rejected" << std::endl;
+        Disconnect(connection, true);
+        return;
+    }
+
+    // Frames may already have arrived behind the response
+    connection->read_begin = static_cast<size_t>(header_end - begin) + 4;
+
+    // Covers the TLS handshake and the websocket upgrade, resumption saves a round trip of it
+    _tls_context->RecordHandshake(connection->stream.native_handle(), clock::MonotonicNs() - connection->handshake_start_ns);
+
+    connection->open = true;
+    _handlers.on_open();
+
+    if (ConsumeFrames(connection))
+    {
+        Read(connection);
+    }
+}
+
+bool NativeWebSocketTransport::IsUpgradeAccepted(const ConnectionPtr_t& connection, const std::string& response) const
+{
+    static constexpr const char* SWITCHING_PROTOCOLS = "HTTP/1.1 101";
+
+    if (response.compare(0, std::strlen(SWITCHING_PROTOCOLS), SWITCHING_PROTOCOLS) != 0)
+    {
+        return false;
+    }
+
+    // Header names are case insensitive, the accept value is not
+    std::string lower = response;
+    std::transform(std::begin(lower), std::end(lower), std::begin(lower)
+            , [](const unsigned char c){ return static_cast<char>(std::tolower(c)); });
+
+    const size_t name = lower.find(ACCEPT_HEADER);
+    if (name == std::string::npos)
+    {
+        return false;
+    }
+
+    const size_t value_start = response.find_first_not_of(' ', name + std::strlen(ACCEPT_HEADER));
+    const size_t value_end = response.find_first_of(" \r", value_start);
+
+    return value_start != std::string::npos
+        && response.compare(value_start, value_end - value_start, AcceptKey(connection->upgrade_key)) == 0;
+}
+
+void NativeWebSocketTransport::Read(const ConnectionPtr_t& connection)
+{
+    EnsureReadSpace(*connection, MIN_READ_SPACE);
+
+    connection->stream.async_read_some(boost::asio::buffer(connection->read_buffer.data() + connection->read_end
+                , connection->read_buffer.size() - connection->read_end)
+            , [this, connection](const boost::system::error_code& ec, const size_t bytes)
+    {
+        OnRead(connection, ec, bytes);
+    });
+}
+
+void NativeWebSocketTransport::OnRead(const ConnectionPtr_t& connection, const boost::system::error_code& ec, const size_t bytes)
+{
+    if (ec)
+    {
+        Disconnect(connection, true);
+        return;
+    }
+
+    if (_socket_options.quick_ack)
+    {
+        SocketOptions::RearmQuickAck(connection->stream.lowest_layer().native_handle());
+    }
+
+    connection->read_end += bytes;
+
+    if (ConsumeFrames(connection))
+    {
+        Read(connection);
+    }
+}
+
+bool NativeWebSocketTransport::ConsumeFrames(const ConnectionPtr_t& connection)
+{
+    while (connection == _connection)
+    {
+        char* data = connection->read_buffer.data() + connection->read_begin;
+        const size_t available = connection->read_end - connection->read_begin;
+
+        frame::Header header;
+        if (!frame::ParseHeader(data, available, header))
+        {
+            return true;
+        }
+
+        if (header.payload_size > MAX_MESSAGE_BYTES)
+        {
+            std::cerr << "Websocket frame of " << header.payload_size << " bytes is too large" << std::endl;
+            Disconnect(connection, true);
+            return false;
+        }
+
+        const size_t frame_size = header.header_size + header.payload_size;
+        if (available < frame_size)
+        {
+            // The rest of the frame is read in one piece behind what is already here
+            EnsureReadSpace(*connection, frame_size - available);
+            return true;
+        }
+
+        char* payload = data + header.header_size;
+        if (header.masked)
+        {
+            frame::Mask(payload, header.payload_size, header.mask);
+        }
+
+        connection->read_begin += frame_size;
+
+        if (!OnFrame(connection, header, payload))
+        {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+bool NativeWebSocketTransport::OnFrame(const ConnectionPtr_t& connection, const frame::Header& header, const char* payload)
+{
+    const size_t size = header.payload_size;
+    const uint64_t kernel_wall_ns = connection->stream.next_layer().GetKernelWallNs();
+
+    switch (header.opcode)
+    {
+        case frame::Opcode::TEXT:
+        case frame::Opcode::BINARY:
+            if (!header.fin)
+            {
+                connection->fragments.assign(payload, size);
+                connection->fragmented = true;
+                return true;
+            }
+
+            _handlers.on_message(payload, size, kernel_wall_ns);
+            return true;
+
+        case frame::Opcode::CONTINUATION:
+            if (!connection->fragmented)
+            {
+                return true;
+            }
+
+            connection->fragments.append(payload, size);
+            if (header.fin)
+            {
+                connection->fragmented = false;
+                _handlers.on_message(connection->fragments.data(), connection->fragments.size(), kernel_wall_ns);
+                connection->fragments.clear();
+            }
+            return true;
+
+        case frame::Opcode::PING:
+            QueueFrame(connection, frame::Opcode::PONG, payload, size);
+            return true;
+
+        case frame::Opcode::PONG:
+            _handlers.on_pong(std::string(payload, size));
+            return true;
+
+        case frame::Opcode::CLOSE:
+            // Echo the status code and close the socket once it is written
+            QueueFrame(connection, frame::Opcode::CLOSE, payload, std::min<size_t>(size, 2));
+            connection->close_after_write = true;
+            Disconnect(connection, false);
+            return false;
+
+        default:
+            return true;
+    }
+}
+
+void NativeWebSocketTransport::QueueFrame(const ConnectionPtr_t& connection, const frame::Opcode opcode, const char* payload, const size_t size)
+{
+    const frame::MaskKey_t mask = NextMask();
+
+    std::string data(frame::MAX_HEADER_SIZE + size, '\0');
+    const size_t header_size = frame::WriteHeader(&data[0], opcode, size, mask);
+
+    std::memcpy(&data[header_size], payload, size);
+    frame::Mask(&data[header_size], size, mask);
+    data.resize(header_size + size);
+
+    QueueWrite(connection, std::move(data));
+}
+
+void NativeWebSocketTransport::QueueWrite(const ConnectionPtr_t& connection, std::string data)
+{
+    connection->write_queue.push_back(std::move(data));
+
+    // Otherwise the write in flight picks it up
+    if (connection->write_queue.size() == 1)
+    {
+        WriteNext(connection);
+    }
+}
+
+void NativeWebSocketTransport::WriteNext(const ConnectionPtr_t& connection)
+{
+    boost::asio::async_write(connection->stream, boost::asio::buffer(connection->write_queue.front())
+            , [this, connection](const boost::system::error_code& ec, const size_t)
+    {
+        OnWrite(connection, ec);
+    });
+}
+
+void NativeWebSocketTransport::OnWrite(const ConnectionPtr_t& connection, const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        Disconnect(connection, true);
+        return;
+    }
+
+    connection->write_queue.pop_front();
+
+    if (!connection->write_queue.empty())
+    {
+        WriteNext(connection);
+    }
+    else if (connection->close_after_write)
+    {
+        boost::system::error_code close_ec;
+        connection->stream.next_layer().Close(close_ec);
+    }
+}
+
+void NativeWebSocketTransport::EnsureReadSpace(Connection& connection, const size_t bytes)
+{
+    if (connection.read_begin == connection.read_end)
+    {
+        connection.read_begin = 0;
+        connection.read_end = 0;
+    }
+
+    if (connection.read_buffer.size() - connection.read_end >= bytes)
+    {
+        return;
+    }
+
+    // Only moved when out of room, so most reads land behind the last without copying
+    if (connection.read_begin > 0)
+    {
+        std::memmove(connection.read_buffer.data()
+                , connection.read_buffer.data() + connection.read_begin
+                , connection.read_end - connection.read_begin);
+
+        connection.read_end -= connection.read_begin;
+        connection.read_begin = 0;
+    }
+
+    if (connection.read_buffer.size() - connection.read_end < bytes)
+    {
+        connection.read_buffer.resize(connection.read_end + bytes);
+    }
+}
+
+frame::MaskKey_t NativeWebSocketTransport::NextMask()
+{
+    const uint32_t bits = static_cast<uint32_t>(_mask_rng());
+
+    frame::MaskKey_t mask;
+    std::memcpy(mask.data(), &bits, mask.size());
+
+    return mask;
+}
+
+void NativeWebSocketTransport::Disconnect(const ConnectionPtr_t& connection, const bool close_socket)
+{
+    if (close_socket)
+    {
+        boost::system::error_code ec;
+        connection->stream.next_layer().Close(ec);
+    }
+
+    if (connection != _connection)
+    {
+        return;
+    }
+
+    _connection.reset();
+
+    const bool opened = connection->open;
+    connection->open = false;
+
+    if (opened)
+    {
+        _handlers.on_close();
+    }
+    else
+    {
+        _handlers.on_fail();
+    }
+}
+
+} // namespace ws
+} // namespace ftx
\ No newline at end of file
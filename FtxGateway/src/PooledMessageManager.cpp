@@ -0,0 +1,22 @@
+#include "PooledMessageManager.h"
+
+namespace ftx
+{
+namespace ws
+{
+
+std::atomic<uint64_t> MessagePool::_hits(0);
+std::atomic<uint64_t> MessagePool::_misses(0);
+
+MessagePool::Stats MessagePool::GetStats()
+{
+    Stats stats;
+
+    stats.hits = _hits.load(std::memory_order_relaxed);
+    stats.misses = _misses.load(std::memory_order_relaxed);
+
+    return stats;
+}
+
+} // namespace ws
+} // namespace ftx
\ No newline at end of file
@@ -0,0 +1,222 @@
+#include "RedundantFeed.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ftx
+{
+namespace ws
+{
+
+namespace
+{
+
+static inline bool Equal(const double a, const double b, const double epsilon = 1e-9)
+{
+    return std::fabs(a - b) < epsilon;
+}
+
+static inline bool SameQuote(const Bbo& a, const Bbo& b)
+{
+    return Equal(a.price.bid, b.price.bid)
+        && Equal(a.price.ask, b.price.ask)
+        && Equal(a.size.bid, b.size.bid)
+        && Equal(a.size.ask, b.size.ask);
+}
+
+}
+
+RedundantFeed::RedundantFeed(const std::string& market
+        , const std::string& key
+        , const std::string& secret
+        , const std::shared_ptr<const ClockSync>& clock_sync
+        , const std::shared_ptr<TlsContext>& tls_context
+        , const std::vector<ThreadConfig>& thread_configs
+        , const SocketOptions& socket_options)
+    : _bbo_callback([](const Bbo&){})
+    , _order_callback([](const Order&){})
+    , _fill_callback([](const Fill&){})
+    , _has_bbo(false)
+{
+    for (size_t i = 0; i < std::max<size_t>(1, thread_configs.size()); ++i)
+    {
+        _counters.push_back(std::make_unique<ConnectionCounters>());
+    }
+
+    for (size_t i = 0; i < _counters.size(); ++i)
+    {
+        auto connection = std::make_unique<FtxWebSocket>(market, key, secret, clock_sync, tls_context
+                , ThreadConfig::ForIndex(thread_configs, i, "ftx-feed-" + std::to_string(i))
+                , socket_options);
+
+        connection->SetBboCallback([this, i](const Bbo& bbo){ this->OnBbo(i, bbo); });
+        connection->SetOrderCallback([this, i](const Order& order){ this->OnOrder(i, order); });
+        connection->SetFillCallback([this, i](const Fill& fill){ this->OnFill(i, fill); });
+
+        _connections.push_back(std::move(connection));
+    }
+}
+
+void RedundantFeed::SetBboCallback(const FtxWebSocket::BboCallback_t& callback)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    _bbo_callback = callback;
+}
+
+void RedundantFeed::SetOrderCallback(const FtxWebSocket::OrderCallback_t& callback)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    _order_callback = callback;
+}
+
+void RedundantFeed::SetFillCallback(const FtxWebSocket::FillCallback_t& callback)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    _fill_callback = callback;
+}
+
+void RedundantFeed::Stop()
+{
+    for (auto& connection : _connections)
+    {
+        connection->Stop();
+    }
+}
+
+size_t RedundantFeed::GetConnectionCount() const
+{
+    return _connections.size();
+}
+
+const FtxWebSocket& RedundantFeed::GetConnection(const size_t index) const
+{
+    return *_connections.at(index);
+}
+
+std::vector<RedundantFeed::ConnectionStats> RedundantFeed::GetStats() const
+{
+    std::vector<ConnectionStats> stats(_counters.size());
+
+    for (size_t i = 0; i < _counters.size(); ++i)
+    {
+        stats[i].wins = _counters[i]->wins.load(std::memory_order_relaxed);
+        stats[i].duplicates = _counters[i]->duplicates.load(std::memory_order_relaxed);
+        stats[i].lag = _counters[i]->lag.GetSnapshot();
+    }
+
+    return stats;
+}
+
+void RedundantFeed::OnBbo(const size_t connection, const Bbo& bbo)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+
+    // Ticker updates are ordered by exchange time; anything older than the last one
+    // forwarded is a late copy or a stale update and would move the quote backwards
+    if (_has_bbo && bbo.exchange_time_ns != 0)
+    {
+        if (bbo.exchange_time_ns < _last_bbo.exchange_time_ns)
+        {
+            RecordDuplicate(connection, 0, 0);
+            return;
+        }
+
+        if (bbo.exchange_time_ns == _last_bbo.exchange_time_ns && SameQuote(bbo, _last_bbo))
+        {
+            RecordDuplicate(connection, bbo.receive_time_ns, _last_bbo.receive_time_ns);
+            return;
+        }
+    }
+
+    _has_bbo = true;
+    _last_bbo = bbo;
+    RecordWin(connection);
+
+    _bbo_callback(bbo);
+}
+
+void RedundantFeed::OnOrder(const size_t connection, const Order& order)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+
+    // An order only ever moves forward: new -> open -> closed, with filled size growing
+    auto state = _orders.find(order.order_id);
+    if (state != std::end(_orders))
+    {
+        OrderState& last = state->second;
+
+        const bool same = order.status == last.status && Equal(order.filled_size, last.filled_size);
+        const bool newer = order.status > last.status || order.filled_size > last.filled_size + 1e-9;
+
+        if (!newer)
+        {
+            RecordDuplicate(connection
+                    , same ? order.receive_time_ns : 0
+                    , same ? last.receive_time_ns : 0);
+            return;
+        }
+    }
+
+    const bool first_close = order.status == Order::Status::CLOSED
+        && (state == std::end(_orders) || state->second.status != Order::Status::CLOSED);
+
+    _orders[order.order_id] = OrderState{order.status, order.filled_size, order.receive_time_ns};
+
+    if (first_close)
+    {
+        _closed_orders.push_back(order.order_id);
+        if (_closed_orders.size() > MAX_REMEMBERED)
+        {
+            _orders.erase(_closed_orders.front());
+            _closed_orders.pop_front();
+        }
+    }
+
+    RecordWin(connection);
+
+    _order_callback(order);
+}
+
+void RedundantFeed::OnFill(const size_t connection, const Fill& fill)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+
+    const auto seen = _fills.find(fill.trade_id);
+    if (seen != std::end(_fills))
+    {
+        RecordDuplicate(connection, fill.receive_time_ns, seen->second);
+        return;
+    }
+
+    _fills.emplace(fill.trade_id, fill.receive_time_ns);
+    _fill_order.push_back(fill.trade_id);
+    if (_fill_order.size() > MAX_REMEMBERED)
+    {
+        _fills.erase(_fill_order.front());
+        _fill_order.pop_front();
+    }
+
+    RecordWin(connection);
+
+    _fill_callback(fill);
+}
+
+void RedundantFeed::RecordWin(const size_t connection)
+{
+    ++_counters[connection]->wins;
+}
+
+void RedundantFeed::RecordDuplicate(const size_t connection, const uint64_t receive_time_ns, const uint64_t winner_receive_time_ns)
+{
+    ConnectionCounters& counters = *_counters[connection];
+    ++counters.duplicates;
+
+    // Lag is only known when the copy can be matched to the exact update that won
+    if (receive_time_ns != 0 && winner_receive_time_ns != 0 && receive_time_ns >= winner_receive_time_ns)
+    {
+        counters.lag.Record(receive_time_ns - winner_receive_time_ns);
+    }
+}
+
+} // namespace ws
+} // namespace ftx
\ No newline at end of file
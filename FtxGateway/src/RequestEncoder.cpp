@@ -0,0 +1,314 @@
+#include "RequestEncoder.h"
+
+#include <cmath>
+
+#include "Clock.h"
+
+namespace ftx
+{
+
+namespace
+{
+
+static constexpr const int MAX_DECIMALS = 9;
+static constexpr const char* API_PATH_PREFIX = "/api";
+
+static constexpr const uint64_t POWERS_OF_TEN[] =
+{
+    1, 10, 100, 1'000, 10'000, 100'000, 1'000'000, 10'000'000, 100'000'000, 1'000'000'000
+};
+
+static std::string EscapeJson(const std::string& str)
+{
+    std::string escaped;
+    for (const char c : str)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped.push_back('\\');
+        }
+        escaped.push_back(c);
+    }
+    return escaped;
+}
+
+}
+
+RequestEncoder::RequestEncoder(const std::string& endpoint
+        , const std::string& market
+        , const std::string& secret
+        , const std::shared_ptr<const ClockSync>& clock_sync)
+    : _endpoint(endpoint)
+    , _signer(secret)
+    , _clock_sync(clock_sync)
+    , _order_prefix("{\"market\":\"" + EscapeJson(market) + "\",\"side\":\"")
+    , _price_decimals(MAX_DECIMALS)
+    , _size_decimals(MAX_DECIMALS)
+{}
+
+void RequestEncoder::SetPriceIncrement(const double increment)
+{
+    _price_decimals = DecimalsFor(increment);
+}
+
+void RequestEncoder::SetSizeIncrement(const double increment)
+{
+    _size_decimals = DecimalsFor(increment);
+}
+
+const EncodedRequest& RequestEncoder::EncodeNewOrder(const ws::Side side
+        , const double price
+        , const double size
+        , const uint64_t client_id) const
+{
+    static constexpr std::string_view FLAGS = ",\"reduceOnly\":false,\"ioc\":false,\"postOnly\":true,\"clientId\":\"";
+
+    return EncodeOrder(side, price, size, client_id, FLAGS);
+}
+
+const EncodedRequest& RequestEncoder::EncodeIocOrder(const ws::Side side
+        , const double price
+        , const double size
+        , const uint64_t client_id) const
+{
+    static constexpr std::string_view FLAGS = ",\"reduceOnly\":false,\"ioc\":true,\"postOnly\":false,\"clientId\":\"";
+
+    return EncodeOrder(side, price, size, client_id, FLAGS);
+}
+
+const EncodedRequest& RequestEncoder::EncodeOrder(const ws::Side side
+        , const double price
+        , const double size
+        , const uint64_t client_id
+        , const std::string_view flags) const
+{
+    static constexpr std::string_view PRICE = "\",\"price\":";
+    static constexpr std::string_view SIZE = ",\"type\":\"limit\",\"size\":";
+    static constexpr std::string_view END = "\"}";
+
+    const uint64_t start_ns = clock::MonotonicNs();
+
+    EncodedRequest& request = Begin(HttpMethod::POST, RequestKind::NEW_ORDER);
+    SetPath(request, "/orders");
+
+    char number[32];
+    auto& body = request.body;
+
+    body.Append(_order_prefix);
+    body.Append(side == ws::Side::BUY ? std::string_view("buy") : std::string_view("sell"));
+    body.Append(PRICE);
+    body.Append(number, FormatDecimal(number, price, _price_decimals));
+    body.Append(SIZE);
+    body.Append(number, FormatDecimal(number, size, _size_decimals));
+    body.Append(flags);
+    body.Append(number, FormatUInt(number, client_id));
+    body.Append(END);
+
+    Sign(request, start_ns);
+    return request;
+}
+
+const EncodedRequest& RequestEncoder::EncodeCancelByClientId(const uint64_t client_id) const
+{
+    return EncodeByClientId(HttpMethod::DELETE, RequestKind::CANCEL_BY_CLIENT_ID, client_id);
+}
+
+const EncodedRequest& RequestEncoder::EncodeOrderStatus(const uint64_t client_id) const
+{
+    return EncodeByClientId(HttpMethod::GET, RequestKind::ORDER_STATUS, client_id);
+}
+
+const EncodedRequest& RequestEncoder::EncodeByClientId(const HttpMethod method
+        , const RequestKind kind
+        , const uint64_t client_id) const
+{
+    static constexpr std::string_view PREFIX = "/orders/by_client_id/";
+
+    const uint64_t start_ns = clock::MonotonicNs();
+
+    EncodedRequest& request = Begin(method, kind);
+
+    char path[PREFIX.size() + 20];
+    std::memcpy(path, PREFIX.data(), PREFIX.size());
+    const size_t length = PREFIX.size() + FormatUInt(path + PREFIX.size(), client_id);
+    SetPath(request, std::string_view(path, length));
+
+    Sign(request, start_ns);
+    return request;
+}
+
+const EncodedRequest& RequestEncoder::EncodeCancelAll() const
+{
+    const uint64_t start_ns = clock::MonotonicNs();
+
+    EncodedRequest& request = Begin(HttpMethod::DELETE, RequestKind::CANCEL_ALL);
+    SetPath(request, "/orders");
+
+    Sign(request, start_ns);
+    return request;
+}
+
+const EncodedRequest& RequestEncoder::EncodeCancelSide(const ws::Side side) const
+{
+    static constexpr std::string_view END = "\"}";
+
+    const uint64_t start_ns = clock::MonotonicNs();
+
+    EncodedRequest& request = Begin(HttpMethod::DELETE, RequestKind::CANCEL_SIDE);
+    SetPath(request, "/orders");
+
+    // {"market":"<market>","side":"<side>"}
+    auto& body = request.body;
+    body.Append(_order_prefix);
+    body.Append(side == ws::Side::BUY ? std::string_view("buy") : std::string_view("sell"));
+    body.Append(END);
+
+    Sign(request, start_ns);
+    return request;
+}
+
+const EncodedRequest& RequestEncoder::Encode(const HttpMethod method, const std::string_view path, const std::string_view body) const
+{
+    const uint64_t start_ns = clock::MonotonicNs();
+
+    EncodedRequest& request = Begin(method, RequestKind::OTHER);
+    SetPath(request, path);
+    request.body.Append(body);
+
+    Sign(request, start_ns);
+    return request;
+}
+
+const char* RequestEncoder::MethodToString(const HttpMethod method)
+{
+    switch (method)
+    {
+    case HttpMethod::GET:
+        return "GET";
+    case HttpMethod::POST:
+        return "POST";
+    case HttpMethod::DELETE:
+        return "DELETE";
+    default:
+        throw std::runtime_error("Invalid method");
+    }
+}
+
+size_t RequestEncoder::FormatUInt(char* out, uint64_t value)
+{
+    char reversed[20];
+    size_t length = 0;
+
+    do
+    {
+        reversed[length++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    for (size_t i = 0; i < length; ++i)
+    {
+        out[i] = reversed[length - 1 - i];
+    }
+
+    return length;
+}
+
+size_t RequestEncoder::FormatDecimal(char* out, const double value, const int decimals)
+{
+    if (!std::isfinite(value))
+    {
+        throw std::invalid_argument("Cannot encode a non-finite number");
+    }
+
+    size_t length = 0;
+    if (value < 0)
+    {
+        out[length++] = '-';
+    }
+
+    const uint64_t scale = POWERS_OF_TEN[decimals];
+    const uint64_t scaled = static_cast<uint64_t>(std::llround(std::fabs(value) * scale));
+
+    length += FormatUInt(out + length, scaled / scale);
+
+    uint64_t fraction = scaled % scale;
+    if (fraction == 0)
+    {
+        return length;
+    }
+
+    int digits = decimals;
+    while (fraction % 10 == 0)
+    {
+        fraction /= 10;
+        --digits;
+    }
+
+    out[length++] = '.';
+    for (int i = digits - 1; i >= 0; --i)
+    {
+        out[length + i] = static_cast<char>('0' + fraction % 10);
+        fraction /= 10;
+    }
+
+    return length + digits;
+}
+
+int RequestEncoder::DecimalsFor(const double increment)
+{
+    for (int decimals = 0; decimals < MAX_DECIMALS; ++decimals)
+    {
+        const double scaled = increment * POWERS_OF_TEN[decimals];
+        if (std::fabs(scaled - std::round(scaled)) < 1e-6)
+        {
+            return decimals;
+        }
+    }
+
+    return MAX_DECIMALS;
+}
+
+EncodedRequest& RequestEncoder::Begin(const HttpMethod method, const RequestKind kind) const
+{
+    thread_local EncodedRequest request;
+
+    request.method = method;
+    request.kind = kind;
+    request.url.Clear();
+    request.path.Clear();
+    request.body.Clear();
+    request.timestamp.Clear();
+    request.signature.Clear();
+
+    return request;
+}
+
+void RequestEncoder::SetPath(EncodedRequest& request, const std::string_view path) const
+{
+    request.path.Append(path);
+    request.url.Append(_endpoint);
+    request.url.Append(path);
+}
+
+void RequestEncoder::Sign(EncodedRequest& request, const uint64_t start_ns) const
+{
+    const uint64_t serialized_ns = clock::MonotonicNs();
+
+    request.timestamp.size = FormatUInt(request.timestamp.data, static_cast<uint64_t>(_clock_sync->NowMs()));
+
+    const char* method = MethodToString(request.method);
+
+    EVP_MD_CTX* ctx = _signer.Begin();
+    crypto::HmacSha256Signer::Update(ctx, request.timestamp.data, request.timestamp.size);
+    crypto::HmacSha256Signer::Update(ctx, method, std::strlen(method));
+    crypto::HmacSha256Signer::Update(ctx, API_PATH_PREFIX, std::strlen(API_PATH_PREFIX));
+    crypto::HmacSha256Signer::Update(ctx, request.path.data, request.path.size);
+    crypto::HmacSha256Signer::Update(ctx, request.body.data, request.body.size);
+    _signer.FinishHex(ctx, request.signature.data);
+    request.signature.size = crypto::HmacSha256Signer::HEX_LENGTH;
+
+    request.serialize_ns = serialized_ns - start_ns;
+    request.sign_ns = clock::MonotonicNs() - serialized_ns;
+}
+
+} // namespace ftx
\ No newline at end of file
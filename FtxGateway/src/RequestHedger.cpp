@@ -0,0 +1,226 @@
+#include "RequestHedger.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <string>
+
+#include "Clock.h"
+
+namespace ftx
+{
+
+namespace
+{
+
+static constexpr const uint64_t RTT_WINDOW_SLOT_NS = 10'000'000'000;
+
+// Recomputing the delay merges the whole window, so it is only done this often
+static constexpr const uint64_t DELAY_REFRESH_NS = 100'000'000;
+
+static bool ContainsIgnoreCase(std::string haystack, const std::string& needle)
+{
+    std::transform(std::begin(haystack), std::end(haystack), std::begin(haystack)
+            , [](const unsigned char c){ return static_cast<char>(std::tolower(c)); });
+
+    return haystack.find(needle) != std::string::npos;
+}
+
+}
+
+RequestHedger::RequestHedger(const Send_t& send)
+    : RequestHedger(send, Config())
+{}
+
+RequestHedger::RequestHedger(const Send_t& send, const Config& config)
+    : _send(send)
+    , _config(config)
+    , _rtt(RTT_WINDOW_SLOT_NS)
+    , _delay_ns(config.initial_delay_ns)
+    , _delay_updated_ns(0)
+    , _requests(0)
+    , _hedges_issued(0)
+    , _hedges_won(0)
+    , _duplicate_rejects(0)
+    , _running(true)
+{
+    if (!_config.enabled)
+    {
+        return;
+    }
+
+    for (int i = 0; i < _config.worker_count; ++i)
+    {
+        _workers.emplace_back([this, i]()
+        {
+            ThreadConfig::ForIndex(_config.worker_threads, i, "ftx-hedge-" + std::to_string(i)).Apply();
+            this->Run();
+        });
+    }
+}
+
+RequestHedger::~RequestHedger()
+{
+    {
+        std::lock_guard<std::mutex> lock(_tasks_mtx);
+        _running = false;
+    }
+
+    _tasks_cv.notify_all();
+
+    for (auto& worker : _workers)
+    {
+        worker.join();
+    }
+}
+
+bool RequestHedger::IsEnabled() const
+{
+    return _config.enabled;
+}
+
+RequestHedger::Response_t RequestHedger::Send(const EncodedRequest& request)
+{
+    ++_requests;
+
+    // Both sends carry the same timestamp and signature, the request buffer itself belongs
+    // to the calling thread so it is copied
+    auto attempt = std::make_shared<Attempt>();
+    attempt->request = request;
+    attempt->in_flight = 1;
+
+    Launch(attempt, false);
+
+    std::unique_lock<std::mutex> lock(attempt->mtx);
+    if (!attempt->cv.wait_for(lock, std::chrono::nanoseconds(GetDelayNs()), [&attempt](){ return attempt->done; }))
+    {
+        ++_hedges_issued;
+        ++attempt->in_flight;
+        Launch(attempt, true);
+
+        attempt->cv.wait(lock, [&attempt](){ return attempt->done; });
+    }
+
+    return std::move(attempt->response);
+}
+
+RequestHedger::Stats RequestHedger::GetStats() const
+{
+    Stats stats;
+
+    stats.requests = _requests.load(std::memory_order_relaxed);
+    stats.hedges_issued = _hedges_issued.load(std::memory_order_relaxed);
+    stats.hedges_won = _hedges_won.load(std::memory_order_relaxed);
+    stats.duplicate_rejects = _duplicate_rejects.load(std::memory_order_relaxed);
+    stats.delay_ns = _delay_ns.load(std::memory_order_relaxed);
+    stats.round_trip = _rtt.GetSnapshot(clock::MonotonicNs());
+
+    return stats;
+}
+
+bool RequestHedger::IsDuplicateReject(const Response_t& response)
+{
+    if (!response.IsObject()
+            || !response.HasMember("error")
+            || !response["error"].IsString())
+    {
+        return false;
+    }
+
+    const std::string error = response["error"].GetString();
+
+    return ContainsIgnoreCase(error, "duplicate")
+        || ContainsIgnoreCase(error, "already closed")
+        || ContainsIgnoreCase(error, "already queued");
+}
+
+void RequestHedger::Launch(const std::shared_ptr<Attempt>& attempt, const bool hedge)
+{
+    {
+        std::lock_guard<std::mutex> lock(_tasks_mtx);
+        _tasks.emplace_back([this, attempt, hedge]()
+        {
+            const uint64_t start_ns = clock::MonotonicNs();
+            Response_t response = _send(attempt->request);
+            const uint64_t end_ns = clock::MonotonicNs();
+
+            {
+                std::lock_guard<std::mutex> lock(_rtt_mtx);
+                _rtt.Record(end_ns, end_ns - start_ns);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(attempt->mtx);
+                --attempt->in_flight;
+
+                // Rejected because the other send reached the exchange first, whose answer
+                // is the one that says what became of the request
+                const bool duplicate = IsDuplicateReject(response);
+                if (attempt->done || (duplicate && attempt->in_flight > 0))
+                {
+                    if (duplicate)
+                    {
+                        ++_duplicate_rejects;
+                    }
+                    return;
+                }
+
+                attempt->done = true;
+                attempt->response = std::move(response);
+            }
+
+            if (hedge)
+            {
+                ++_hedges_won;
+            }
+
+            attempt->cv.notify_all();
+        });
+    }
+
+    _tasks_cv.notify_one();
+}
+
+uint64_t RequestHedger::GetDelayNs()
+{
+    const uint64_t now_ns = clock::MonotonicNs();
+
+    if (now_ns - _delay_updated_ns.load(std::memory_order_relaxed) < DELAY_REFRESH_NS)
+    {
+        return _delay_ns.load(std::memory_order_relaxed);
+    }
+
+    _delay_updated_ns.store(now_ns, std::memory_order_relaxed);
+
+    const uint64_t percentile_ns = _rtt.GetPercentile(now_ns, _config.quantile);
+    const uint64_t delay_ns = percentile_ns == 0
+        ? _config.initial_delay_ns
+        : std::max(_config.min_delay_ns, percentile_ns);
+
+    _delay_ns.store(delay_ns, std::memory_order_relaxed);
+    return delay_ns;
+}
+
+void RequestHedger::Run()
+{
+    std::unique_lock<std::mutex> lock(_tasks_mtx);
+
+    while (true)
+    {
+        _tasks_cv.wait(lock, [this](){ return !_running || !_tasks.empty(); });
+
+        if (!_running)
+        {
+            return;
+        }
+
+        std::function<void()> task = std::move(_tasks.front());
+        _tasks.pop_front();
+
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+
+} // namespace ftx
\ No newline at end of file
@@ -0,0 +1,532 @@
+#include "RequestScheduler.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+
+#include "Clock.h"
+
+namespace ftx
+{
+
+namespace
+{
+
+static bool ContainsIgnoreCase(std::string haystack, const std::string& needle)
+{
+    std::transform(std::begin(haystack), std::end(haystack), std::begin(haystack)
+            , [](const unsigned char c){ return static_cast<char>(std::tolower(c)); });
+
+    return haystack.find(needle) != std::string::npos;
+}
+
+// A bucket that never refills would wait forever, and the wait is computed by dividing by the rate
+static const RequestScheduler::Config& CheckConfig(const RequestScheduler::Config& config)
+{
+    if (config.request_rate_per_s <= 0 || config.order_rate_per_s <= 0)
+    {
+        throw std::invalid_argument("Request scheduler rates must be positive");
+    }
+
+    if (config.request_burst < 1 || config.order_burst < 1)
+    {
+        throw std::invalid_argument("Request scheduler bursts must be at least 1");
+    }
+
+    return config;
+}
+
+}
+
+RequestScheduler::TokenBucket::TokenBucket(const int rate_per_s, const int burst)
+    : _tokens_per_ns(rate_per_s / 1e9)
+    , _burst(burst)
+    , _tokens(burst)
+    , _last_refill_ns(clock::MonotonicNs())
+{}
+
+uint64_t RequestScheduler::TokenBucket::TimeUntilAvailable(const uint64_t now_ns)
+{
+    Refill(now_ns);
+
+    if (_tokens >= 1.0)
+    {
+        return 0;
+    }
+
+    return static_cast<uint64_t>((1.0 - _tokens) / _tokens_per_ns) + 1;
+}
+
+void RequestScheduler::TokenBucket::Take()
+{
+    _tokens -= 1.0;
+}
+
+void RequestScheduler::TokenBucket::Refund()
+{
+    _tokens = std::min(_burst, _tokens + 1.0);
+}
+
+void RequestScheduler::TokenBucket::Drain(const uint64_t now_ns, const uint64_t penalty_ns)
+{
+    Refill(now_ns);
+    _tokens = -(penalty_ns * _tokens_per_ns);
+}
+
+void RequestScheduler::TokenBucket::Refill(const uint64_t now_ns)
+{
+    if (now_ns <= _last_refill_ns)
+    {
+        return;
+    }
+
+    _tokens = std::min(_burst, _tokens + (now_ns - _last_refill_ns) * _tokens_per_ns);
+    _last_refill_ns = now_ns;
+}
+
+RequestScheduler::RequestScheduler(const FtxAPI& api)
+    : RequestScheduler(api, Config())
+{}
+
+RequestScheduler::RequestScheduler(const FtxAPI& api, const Config& config)
+    : _api(api)
+    , _config(CheckConfig(config))
+    , _next_batch(0)
+    , _request_bucket(config.request_rate_per_s, config.request_burst)
+    , _order_bucket(config.order_rate_per_s, config.order_burst)
+    , _running(true)
+    , _throttled(0)
+    , _rate_limited(0)
+    , _superseded(0)
+    , _stale(0)
+    , _batches(0)
+    , _batched_requests(0)
+{
+    for (auto& dispatched : _dispatched)
+    {
+        dispatched = 0;
+    }
+
+    for (int i = 0; i < _config.worker_count; ++i)
+    {
+        _workers.emplace_back([this, i]()
+        {
+            ThreadConfig::ForIndex(_config.worker_threads, i, "ftx-rest-" + std::to_string(i)).Apply();
+            this->Run();
+        });
+    }
+}
+
+RequestScheduler::~RequestScheduler()
+{
+    Stop();
+}
+
+void RequestScheduler::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_queue_mtx);
+        _running = false;
+    }
+
+    _queue_cv.notify_all();
+
+    for (auto& worker : _workers)
+    {
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+    }
+
+    std::vector<Dropped> dropped;
+
+    {
+        std::lock_guard<std::mutex> lock(_queue_mtx);
+        for (auto& queue : _queues)
+        {
+            for (QueuedRequest& queued : queue)
+            {
+                dropped.push_back(Dropped{std::move(queued.request.on_dropped), DropReason::STOPPED});
+            }
+            queue.clear();
+        }
+    }
+
+    NotifyDropped(dropped);
+}
+
+void RequestScheduler::Submit(Request&& request)
+{
+    std::vector<Dropped> dropped;
+
+    {
+        std::lock_guard<std::mutex> lock(_queue_mtx);
+        Enqueue(std::move(request), 0, dropped);
+    }
+
+    NotifyDropped(dropped);
+    _queue_cv.notify_one();
+}
+
+void RequestScheduler::SubmitBatch(std::vector<Request>&& requests)
+{
+    if (requests.empty())
+    {
+        return;
+    }
+
+    std::vector<Dropped> dropped;
+
+    {
+        std::lock_guard<std::mutex> lock(_queue_mtx);
+
+        const uint64_t batch = ++_next_batch;
+        for (Request& request : requests)
+        {
+            // Requests rendered from method and path go through the plain calls one by one
+            const uint64_t request_batch = request.encode ? batch : 0;
+            Enqueue(std::move(request), request_batch, dropped);
+        }
+    }
+
+    NotifyDropped(dropped);
+
+    // One worker takes the whole batch
+    _queue_cv.notify_one();
+}
+
+void RequestScheduler::Enqueue(Request&& request, const uint64_t batch, std::vector<Dropped>& dropped)
+{
+    if (!_running)
+    {
+        dropped.push_back(Dropped{std::move(request.on_dropped), DropReason::STOPPED});
+        return;
+    }
+
+    auto& queue = _queues[static_cast<int>(request.priority)];
+
+    if (request.supersede_key != 0)
+    {
+        const uint64_t key = request.supersede_key;
+        auto queued = std::find_if(std::begin(queue), std::end(queue)
+                , [key](const QueuedRequest& q){ return q.request.supersede_key == key; });
+
+        if (queued != std::end(queue))
+        {
+            // Keeps its place, batch and original enqueue time so queue wait stays honest
+            dropped.push_back(Dropped{std::move(queued->request.on_dropped), DropReason::SUPERSEDED});
+            queued->request = std::move(request);
+            ++_superseded;
+            return;
+        }
+    }
+
+    queue.push_back(QueuedRequest{std::move(request), clock::MonotonicNs(), false, batch});
+}
+
+void RequestScheduler::NotifyDropped(std::vector<Dropped>& dropped)
+{
+    for (Dropped& request : dropped)
+    {
+        if (request.on_dropped)
+        {
+            request.on_dropped(request.reason);
+        }
+    }
+
+    dropped.clear();
+}
+
+FtxAPI::Response_t RequestScheduler::Execute(Request&& request)
+{
+    auto promise = std::make_shared<std::promise<FtxAPI::Response_t>>();
+    std::future<FtxAPI::Response_t> result = promise->get_future();
+
+    request.on_response = [promise](const FtxAPI::Response_t& response)
+    {
+        FtxAPI::Response_t copy;
+        copy.CopyFrom(response, copy.GetAllocator());
+        promise->set_value(std::move(copy));
+    };
+
+    request.on_dropped = [promise](const DropReason /*reason*/)
+    {
+        FtxAPI::Response_t failure;
+        failure.Parse("{\"success\":false,\"error\":\"Request dropped\"}");
+        promise->set_value(std::move(failure));
+    };
+
+    request.is_current = nullptr;
+
+    Submit(std::move(request));
+
+    return result.get();
+}
+
+RequestScheduler::Stats RequestScheduler::GetStats() const
+{
+    Stats stats;
+
+    for (size_t i = 0; i < _queue_wait.size(); ++i)
+    {
+        stats.queue_wait[i] = _queue_wait[i].GetSnapshot();
+        stats.dispatched[i] = _dispatched[i].load(std::memory_order_relaxed);
+    }
+
+    stats.throttled = _throttled.load(std::memory_order_relaxed);
+    stats.rate_limited = _rate_limited.load(std::memory_order_relaxed);
+    stats.superseded = _superseded.load(std::memory_order_relaxed);
+    stats.stale = _stale.load(std::memory_order_relaxed);
+    stats.batches = _batches.load(std::memory_order_relaxed);
+    stats.batched_requests = _batched_requests.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(_queue_mtx);
+    stats.queued = 0;
+    for (const auto& queue : _queues)
+    {
+        stats.queued += queue.size();
+    }
+
+    return stats;
+}
+
+bool RequestScheduler::IsOrderEntry(const Priority priority)
+{
+    return priority != Priority::QUERY;
+}
+
+bool RequestScheduler::IsRateLimitResponse(const FtxAPI::Response_t& response)
+{
+    if (!response.IsObject()
+            || !response.HasMember("error")
+            || !response["error"].IsString())
+    {
+        return false;
+    }
+
+    const std::string error = response["error"].GetString();
+
+    return ContainsIgnoreCase(error, "rate limit") || ContainsIgnoreCase(error, "do not send more than");
+}
+
+void RequestScheduler::Run()
+{
+    std::unique_lock<std::mutex> lock(_queue_mtx);
+
+    std::vector<QueuedRequest> next;
+
+    while (_running)
+    {
+        next.clear();
+        if (!PopNext(next, lock))
+        {
+            continue;
+        }
+
+        lock.unlock();
+        Dispatch(next);
+        lock.lock();
+    }
+}
+
+bool RequestScheduler::PopNext(std::vector<QueuedRequest>& next, std::unique_lock<std::mutex>& lock)
+{
+    auto queue = std::find_if(std::begin(_queues), std::end(_queues)
+            , [](const std::deque<QueuedRequest>& q){ return !q.empty(); });
+
+    if (queue == std::end(_queues))
+    {
+        _queue_cv.wait(lock);
+        return false;
+    }
+
+    QueuedRequest& front = queue->front();
+    const bool order_entry = IsOrderEntry(front.request.priority);
+
+    const uint64_t now_ns = clock::MonotonicNs();
+    const uint64_t wait_ns = std::max(_request_bucket.TimeUntilAvailable(now_ns)
+            , order_entry ? _order_bucket.TimeUntilAvailable(now_ns) : 0);
+
+    if (wait_ns != 0)
+    {
+        if (!front.throttled)
+        {
+            front.throttled = true;
+            ++_throttled;
+        }
+
+        _queue_cv.wait_for(lock, std::chrono::nanoseconds(wait_ns));
+        return false;
+    }
+
+    _request_bucket.Take();
+    if (order_entry)
+    {
+        _order_bucket.Take();
+    }
+
+    const uint64_t batch = front.batch;
+    next.push_back(std::move(front));
+    queue->pop_front();
+
+    // The rest of its batch comes along as far as the budgets allow; what is left over is
+    // dispatched as a batch of its own once tokens are back
+    while (batch != 0
+            && !queue->empty()
+            && queue->front().batch == batch
+            && _request_bucket.TimeUntilAvailable(now_ns) == 0
+            && (!order_entry || _order_bucket.TimeUntilAvailable(now_ns) == 0))
+    {
+        _request_bucket.Take();
+        if (order_entry)
+        {
+            _order_bucket.Take();
+        }
+
+        next.push_back(std::move(queue->front()));
+        queue->pop_front();
+    }
+
+    return true;
+}
+
+void RequestScheduler::Dispatch(std::vector<QueuedRequest>& next)
+{
+    if (next.size() == 1)
+    {
+        Dispatch(next.front());
+        return;
+    }
+
+    // Each encode call reuses the worker's buffer, so every request is copied out of it
+    std::vector<EncodedRequest> encoded;
+    std::vector<QueuedRequest*> current;
+    encoded.reserve(next.size());
+    current.reserve(next.size());
+
+    for (QueuedRequest& queued : next)
+    {
+        if (DropIfStale(queued))
+        {
+            continue;
+        }
+
+        encoded.push_back(queued.request.encode());
+        current.push_back(&queued);
+    }
+
+    if (current.empty())
+    {
+        return;
+    }
+
+    std::vector<const EncodedRequest*> requests;
+    requests.reserve(encoded.size());
+
+    const uint64_t now_ns = clock::MonotonicNs();
+    for (size_t i = 0; i < current.size(); ++i)
+    {
+        const int priority = static_cast<int>(current[i]->request.priority);
+        _queue_wait[priority].Record(now_ns - current[i]->enqueue_ns);
+        ++_dispatched[priority];
+
+        requests.push_back(&encoded[i]);
+    }
+
+    ++_batches;
+    _batched_requests += current.size();
+
+    const std::vector<FtxAPI::Response_t> responses = _api.SendBatch(requests);
+
+    for (size_t i = 0; i < current.size(); ++i)
+    {
+        OnResponse(current[i]->request, responses[i]);
+    }
+}
+
+void RequestScheduler::Dispatch(QueuedRequest& next)
+{
+    Request& request = next.request;
+    const int priority = static_cast<int>(request.priority);
+
+    if (DropIfStale(next))
+    {
+        return;
+    }
+
+    _queue_wait[priority].Record(clock::MonotonicNs() - next.enqueue_ns);
+    ++_dispatched[priority];
+
+    OnResponse(request, Send(request));
+}
+
+bool RequestScheduler::DropIfStale(QueuedRequest& next)
+{
+    Request& request = next.request;
+
+    if (!request.is_current || request.is_current())
+    {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_queue_mtx);
+        _request_bucket.Refund();
+        if (IsOrderEntry(request.priority))
+        {
+            _order_bucket.Refund();
+        }
+    }
+
+    ++_stale;
+
+    if (request.on_dropped)
+    {
+        request.on_dropped(DropReason::STALE);
+    }
+
+    return true;
+}
+
+void RequestScheduler::OnResponse(Request& request, const FtxAPI::Response_t& response)
+{
+    if (IsRateLimitResponse(response))
+    {
+        ++_rate_limited;
+
+        std::lock_guard<std::mutex> lock(_queue_mtx);
+        const uint64_t now_ns = clock::MonotonicNs();
+        _request_bucket.Drain(now_ns, _config.rate_limit_penalty_ns);
+        _order_bucket.Drain(now_ns, _config.rate_limit_penalty_ns);
+    }
+
+    if (request.on_response)
+    {
+        request.on_response(response);
+    }
+}
+
+FtxAPI::Response_t RequestScheduler::Send(const Request& request) const
+{
+    if (request.encode)
+    {
+        return _api.Send(request.encode(), request.hedge);
+    }
+
+    switch (request.method)
+    {
+    case FtxAPI::Method::GET:
+        return _api.GetRequest(request.path);
+    case FtxAPI::Method::POST:
+        return _api.PostRequest(request.path, request.body);
+    case FtxAPI::Method::DELETE:
+        return _api.DeleteRequest(request.path);
+    default:
+        throw std::runtime_error("Invalid method");
+    }
+}
+
+} // namespace ftx
\ No newline at end of file
@@ -0,0 +1,185 @@
+#include "RestLatencyStats.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+
+#include "ThreadConfig.h"
+
+namespace ftx
+{
+
+RestLatencyStats::~RestLatencyStats()
+{
+    StopPeriodicDump();
+}
+
+RestLatencyStats::Stages_t& RestLatencyStats::GetEndpoint(const std::string& method, const std::string& path)
+{
+    Key_t key(method, PathTemplate(path));
+
+    {
+        std::shared_lock<std::shared_mutex> lock(_endpoints_mtx);
+        const auto endpoint = _endpoints.find(key);
+        if (endpoint != std::end(_endpoints))
+        {
+            return *endpoint->second;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(_endpoints_mtx);
+    auto& endpoint = _endpoints[std::move(key)];
+    if (!endpoint)
+    {
+        endpoint = std::make_unique<Stages_t>();
+    }
+
+    return *endpoint;
+}
+
+std::vector<RestLatencyStats::EndpointSnapshot> RestLatencyStats::GetSnapshot() const
+{
+    std::vector<EndpointSnapshot> snapshot;
+
+    std::shared_lock<std::shared_mutex> lock(_endpoints_mtx);
+    snapshot.reserve(_endpoints.size());
+
+    for (const auto& [key, stages] : _endpoints)
+    {
+        EndpointSnapshot endpoint;
+        endpoint.method = key.first;
+        endpoint.path_template = key.second;
+
+        for (size_t i = 0; i < stages->size(); ++i)
+        {
+            endpoint.stages[i] = (*stages)[i].GetSnapshot();
+        }
+
+        snapshot.push_back(std::move(endpoint));
+    }
+
+    return snapshot;
+}
+
+void RestLatencyStats::Dump(std::ostream& out) const
+{
+    for (const EndpointSnapshot& endpoint : GetSnapshot())
+    {
+        out << "--- " << endpoint.method << " " << endpoint.path_template << " ---\n";
+
+        for (int i = 0; i < static_cast<int>(Stage::NUM_STAGES); ++i)
+        {
+            const LatencyHistogram::Snapshot& stage = endpoint.stages[i];
+            if (stage.count == 0)
+            {
+                continue;
+            }
+
+            out << StageToString(static_cast<Stage>(i))
+                << ": count " << stage.count
+                << ", mean " << stage.mean_ns / 1000 << "us"
+                << ", p50 " << stage.p50_ns / 1000 << "us"
+                << ", p99 " << stage.p99_ns / 1000 << "us"
+                << ", p99.9 " << stage.p999_ns / 1000 << "us"
+                << ", max " << stage.max_ns / 1000 << "us\n";
+        }
+    }
+
+    out.flush();
+}
+
+void RestLatencyStats::StartPeriodicDump(std::ostream& out, const int period_s)
+{
+    StopPeriodicDump();
+
+    {
+        std::lock_guard<std::mutex> lock(_dump_mtx);
+        _dumping = true;
+    }
+
+    _dump_thread = std::make_unique<std::thread>([this, &out, period_s]()
+    {
+        ThreadConfig{"ftx-stats"}.Apply();
+
+        std::unique_lock<std::mutex> lock(_dump_mtx);
+        while (!_dump_cv.wait_for(lock, std::chrono::seconds(period_s), [this](){ return !_dumping; }))
+        {
+            Dump(out);
+        }
+    });
+}
+
+void RestLatencyStats::StopPeriodicDump()
+{
+    {
+        std::lock_guard<std::mutex> lock(_dump_mtx);
+        _dumping = false;
+    }
+
+    _dump_cv.notify_all();
+
+    if (_dump_thread)
+    {
+        _dump_thread->join();
+        _dump_thread.reset();
+    }
+}
+
+std::string RestLatencyStats::PathTemplate(const std::string& path)
+{
+    std::string result;
+    result.reserve(path.size());
+
+    size_t start = 0;
+    while (start < path.size())
+    {
+        size_t end = path.find('/', start + 1);
+        if (end == std::string::npos)
+        {
+            end = path.size();
+        }
+
+        // Segment including its leading '/'
+        const auto first = std::begin(path) + start + (path[start] == '/' ? 1 : 0);
+        const auto last = std::begin(path) + end;
+
+        if (first != last && std::all_of(first, last, [](const unsigned char c){ return std::isdigit(c); }))
+        {
+            result.append(std::begin(path) + start, first);
+            result.append("{id}");
+        }
+        else
+        {
+            result.append(std::begin(path) + start, last);
+        }
+
+        start = end;
+    }
+
+    return result;
+}
+
+const char* RestLatencyStats::StageToString(const Stage stage)
+{
+    switch (stage)
+    {
+    case Stage::SERIALIZE:
+        return "serialize";
+    case Stage::SIGN:
+        return "sign";
+    case Stage::HEADER:
+        return "header";
+    case Stage::FIRST_BYTE:
+        return "first_byte";
+    case Stage::TRANSFER:
+        return "transfer";
+    case Stage::PARSE:
+        return "parse";
+    case Stage::TOTAL:
+        return "total";
+    default:
+        return "";
+    }
+}
+
+} // namespace ftx
\ No newline at end of file
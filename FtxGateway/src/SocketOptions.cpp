@@ -0,0 +1,123 @@
+#include "SocketOptions.h"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace ftx
+{
+
+namespace
+{
+
+static bool SetOption(const int fd, const int level, const int option, const int value, const char* name)
+{
+    if (setsockopt(fd, level, option, &value, sizeof(value)) == 0)
+    {
+        return true;
+    }
+
+    std::cerr << "Failed to set " << name << " on socket " << fd << ": " << std::strerror(errno) << std::endl;
+    return false;
+}
+
+}
+
+bool SocketOptions::Apply(const int fd) const
+{
+    bool applied = true;
+
+    if (no_delay)
+    {
+        applied &= SetOption(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+    }
+
+    if (send_buffer_bytes > 0)
+    {
+        applied &= SetOption(fd, SOL_SOCKET, SO_SNDBUF, send_buffer_bytes, "SO_SNDBUF");
+    }
+
+    if (receive_buffer_bytes > 0)
+    {
+        applied &= SetOption(fd, SOL_SOCKET, SO_RCVBUF, receive_buffer_bytes, "SO_RCVBUF");
+    }
+
+#if defined(__linux__)
+    if (quick_ack)
+    {
+        applied &= SetOption(fd, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+    }
+
+    if (busy_poll_us > 0)
+    {
+        applied &= SetOption(fd, SOL_SOCKET, SO_BUSY_POLL, busy_poll_us, "SO_BUSY_POLL");
+    }
+
+    if (kernel_timestamps)
+    {
+        applied &= SetOption(fd, SOL_SOCKET, SO_TIMESTAMPING
+                , SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE, "SO_TIMESTAMPING");
+    }
+#endif
+
+    return applied;
+}
+
+void SocketOptions::RearmQuickAck(const int fd)
+{
+#if defined(__linux__)
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one));
+#endif
+}
+
+ssize_t SocketOptions::ReceiveWithTimestamp(const int fd, void* buffer, const size_t length, uint64_t& kernel_ns)
+{
+    kernel_ns = 0;
+
+#if defined(__linux__)
+    iovec io{buffer, length};
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(scm_timestamping))];
+
+    msghdr message{};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    const ssize_t received = recvmsg(fd, &message, 0);
+    if (received <= 0)
+    {
+        return received;
+    }
+
+    for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header))
+    {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_TIMESTAMPING)
+        {
+            scm_timestamping timestamps;
+            std::memcpy(&timestamps, CMSG_DATA(header), sizeof(timestamps));
+
+            // Index 0 holds the software timestamp
+            kernel_ns = static_cast<uint64_t>(timestamps.ts[0].tv_sec) * 1'000'000'000 + timestamps.ts[0].tv_nsec;
+        }
+    }
+
+    return received;
+#else
+    return recv(fd, buffer, length, 0);
+#endif
+}
+
+} // namespace ftx
\ No newline at end of file
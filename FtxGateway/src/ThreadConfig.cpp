@@ -0,0 +1,71 @@
+#include "ThreadConfig.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace ftx
+{
+
+namespace
+{
+
+static constexpr const size_t MAX_NAME_LENGTH = 15;
+
+}
+
+bool ThreadConfig::Apply() const
+{
+    bool applied = true;
+
+    if (!name.empty())
+    {
+        pthread_setname_np(pthread_self(), name.substr(0, MAX_NAME_LENGTH).c_str());
+    }
+
+    if (cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+
+        const int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (error != 0)
+        {
+            std::cerr << "Failed to pin thread " << name << " to cpu " << cpu << ": " << std::strerror(error) << std::endl;
+            applied = false;
+        }
+    }
+
+    if (fifo_priority > 0)
+    {
+        sched_param param{};
+        param.sched_priority = std::clamp(fifo_priority, sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+
+        const int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (error != 0)
+        {
+            std::cerr << "Failed to set SCHED_FIFO priority " << param.sched_priority << " for thread " << name << ": " << std::strerror(error) << std::endl;
+            applied = false;
+        }
+    }
+
+    return applied;
+}
+
+ThreadConfig ThreadConfig::ForIndex(const std::vector<ThreadConfig>& configs, const size_t index, const std::string& default_name)
+{
+    if (index < configs.size())
+    {
+        return configs[index];
+    }
+
+    ThreadConfig config;
+    config.name = default_name;
+    return config;
+}
+
+} // namespace ftx
\ No newline at end of file
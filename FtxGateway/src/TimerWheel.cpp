@@ -0,0 +1,293 @@
+#include "TimerWheel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include "Clock.h"
+
+namespace ftx
+{
+
+TimerWheel::TimerWheel()
+    : TimerWheel(Config())
+{}
+
+TimerWheel::TimerWheel(const Config& config)
+    : _config(config)
+    , _slot_mask((uint64_t{1} << config.slot_bits) - 1)
+    , _running(true)
+    , _levels(config.level_count, std::vector<Slot_t>(_slot_mask + 1))
+    , _current_tick(clock::MonotonicNs() / config.tick_ns)
+    , _wake_tick(0)
+    , _next_id(0)
+    , _scheduled(0)
+    , _cancelled(0)
+    , _fired(0)
+    , _cascaded(0)
+    , _pending(0)
+{
+    _thread = std::thread([this]()
+    {
+        _config.thread.Apply();
+        this->Run();
+    });
+}
+
+TimerWheel::~TimerWheel()
+{
+    Stop();
+}
+
+void TimerWheel::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _running = false;
+    }
+
+    _cv.notify_all();
+
+    if (_thread.joinable())
+    {
+        _thread.join();
+    }
+}
+
+TimerWheel::TimerId_t TimerWheel::Schedule(const uint64_t deadline_ns, Callback_t&& callback)
+{
+    // Built outside the lock, only spliced in under it
+    Slot_t pending;
+    pending.push_back(Timer{0, deadline_ns, 0, std::move(callback), 0, 0});
+
+    TimerId_t id = 0;
+    bool wake = false;
+
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+
+        id = ++_next_id;
+
+        Timer& timer = pending.back();
+        timer.id = id;
+
+        // Rounded up, so no timer fires before its deadline
+        timer.tick = std::max((deadline_ns + _config.tick_ns - 1) / _config.tick_ns, _current_tick);
+
+        // Only a timer due before whatever the thread is sleeping until needs to wake it
+        wake = timer.tick < _wake_tick;
+
+        _timers.emplace(id, std::begin(pending));
+        Insert(pending, std::begin(pending));
+    }
+
+    ++_scheduled;
+    ++_pending;
+
+    if (wake)
+    {
+        _cv.notify_one();
+    }
+
+    return id;
+}
+
+bool TimerWheel::Cancel(const TimerId_t id)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+
+    const auto timer = _timers.find(id);
+    if (timer == std::end(_timers))
+    {
+        return false;
+    }
+
+    const Slot_t::iterator position = timer->second;
+    _levels[position->level][position->slot].erase(position);
+    _timers.erase(timer);
+
+    ++_cancelled;
+    --_pending;
+    return true;
+}
+
+TimerWheel::Stats TimerWheel::GetStats() const
+{
+    Stats stats;
+
+    stats.scheduled = _scheduled.load(std::memory_order_relaxed);
+    stats.cancelled = _cancelled.load(std::memory_order_relaxed);
+    stats.fired = _fired.load(std::memory_order_relaxed);
+    stats.cascaded = _cascaded.load(std::memory_order_relaxed);
+    stats.pending = _pending.load(std::memory_order_relaxed);
+    stats.lateness = _lateness.GetSnapshot();
+
+    return stats;
+}
+
+void TimerWheel::Run()
+{
+    std::vector<Timer> due;
+    std::unique_lock<std::mutex> lock(_mtx);
+
+    while (_running)
+    {
+        const uint64_t now_ns = clock::MonotonicNs();
+        Expire(now_ns / _config.tick_ns, due);
+
+        if (!due.empty())
+        {
+            lock.unlock();
+
+            // Timers of one slot were filed in whatever order they were moved down
+            std::sort(std::begin(due), std::end(due), [](const Timer& a, const Timer& b)
+            {
+                return a.deadline_ns < b.deadline_ns;
+            });
+
+            for (Timer& timer : due)
+            {
+                const uint64_t start_ns = clock::MonotonicNs();
+                _lateness.Record(start_ns > timer.deadline_ns ? start_ns - timer.deadline_ns : 0);
+                ++_fired;
+                --_pending;
+                timer.callback();
+            }
+            due.clear();
+
+            lock.lock();
+            continue;
+        }
+
+        const uint64_t next_tick = NextTick();
+        if (next_tick == 0)
+        {
+            _wake_tick = std::numeric_limits<uint64_t>::max();
+            _cv.wait(lock);
+            _wake_tick = 0;
+            continue;
+        }
+
+        const uint64_t wake_ns = next_tick * _config.tick_ns;
+        if (wake_ns > now_ns)
+        {
+            _wake_tick = next_tick;
+            _cv.wait_for(lock, std::chrono::nanoseconds(wake_ns - now_ns));
+            _wake_tick = 0;
+        }
+    }
+}
+
+void TimerWheel::Insert(Slot_t& from, const Slot_t::iterator position)
+{
+    const uint64_t delta = position->tick - _current_tick;
+
+    // Lowest level whose span reaches the deadline; the last one takes everything further out
+    size_t level = 0;
+    while (level + 1 < _levels.size() && (delta >> (_config.slot_bits * (level + 1))) != 0)
+    {
+        ++level;
+    }
+
+    uint64_t tick = position->tick;
+    const uint64_t span = _config.slot_bits * (level + 1);
+    if (span < 64 && (delta >> span) != 0)
+    {
+        tick = _current_tick + (uint64_t{1} << span) - 1;
+    }
+
+    position->level = level;
+    position->slot = (tick >> (_config.slot_bits * level)) & _slot_mask;
+
+    Slot_t& slot = _levels[level][position->slot];
+    slot.splice(std::end(slot), from, position);
+}
+
+void TimerWheel::Expire(const uint64_t now_tick, std::vector<Timer>& due)
+{
+    if (_timers.empty())
+    {
+        _current_tick = std::max(_current_tick, now_tick + 1);
+        return;
+    }
+
+    for (; _current_tick <= now_tick; ++_current_tick)
+    {
+        // Each time a level turns over, the next slot of the level above comes due and is
+        // spread over the levels below
+        for (size_t level = 1; level < _levels.size(); ++level)
+        {
+            if ((_current_tick & ((uint64_t{1} << (_config.slot_bits * level)) - 1)) != 0)
+            {
+                break;
+            }
+
+            Cascade(level, _current_tick);
+        }
+
+        Slot_t& slot = _levels[0][_current_tick & _slot_mask];
+
+        for (auto timer = std::begin(slot); timer != std::end(slot);)
+        {
+            // Clamped timers sit in a slot before their time
+            if (timer->tick > now_tick)
+            {
+                ++timer;
+                continue;
+            }
+
+            _timers.erase(timer->id);
+            due.push_back(std::move(*timer));
+            timer = slot.erase(timer);
+        }
+    }
+}
+
+void TimerWheel::Cascade(const size_t level, const uint64_t tick)
+{
+    Slot_t& slot = _levels[level][(tick >> (_config.slot_bits * level)) & _slot_mask];
+
+    // Taken out first, a timer still too far out may be filed right back into this slot
+    Slot_t moving;
+    moving.splice(std::end(moving), slot);
+
+    while (!moving.empty())
+    {
+        Insert(moving, std::begin(moving));
+        ++_cascaded;
+    }
+}
+
+uint64_t TimerWheel::NextTick() const
+{
+    if (_timers.empty())
+    {
+        return 0;
+    }
+
+    // The first occupied slot of each level, in the order the wheel comes up to them. For the
+    // first level that is when its timers are due, above it when they are moved down.
+    uint64_t next = std::numeric_limits<uint64_t>::max();
+
+    for (size_t level = 0; level < _levels.size(); ++level)
+    {
+        const size_t shift = _config.slot_bits * level;
+        const uint64_t span = uint64_t{1} << shift;
+
+        // Slots above the first level come up on the turns of the level below
+        uint64_t tick = ((_current_tick + span - 1) >> shift) << shift;
+
+        for (uint64_t slot = 0; slot <= _slot_mask && tick < next; ++slot, tick += span)
+        {
+            if (!_levels[level][(tick >> shift) & _slot_mask].empty())
+            {
+                next = tick;
+                break;
+            }
+        }
+    }
+
+    return next;
+}
+
+} // namespace ftx
\ No newline at end of file
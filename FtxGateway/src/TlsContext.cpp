@@ -0,0 +1,160 @@
+#include "TlsContext.h"
+
+#include <iostream>
+
+#include <boost/asio/ip/address.hpp>
+#include <openssl/x509v3.h>
+
+namespace ftx
+{
+
+namespace
+{
+
+// asio keeps its own callbacks in the context's app data, so this needs an index of its own
+static int ExDataIndex()
+{
+    static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+}
+
+TlsContext::TlsContext()
+    : _context(std::make_shared<Context_t>(Context_t::sslv23))
+{
+    try
+    {
+        _context->set_options(
+            Context_t::default_workarounds
+            | Context_t::no_sslv2
+            | Context_t::no_sslv3
+            | Context_t::single_dh_use
+        );
+
+        // Every request carries the API key, so the server has to prove it is the exchange
+        _context->set_default_verify_paths();
+        _context->set_verify_mode(Context_t::verify_peer);
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "Error in context pointer: " << e.what() << std::endl;
+    }
+
+    // OpenSSL never looks sessions up on the client side, it only hands new ones over.
+    // Storing them and offering them back is up to us.
+    SSL_CTX* ctx = _context->native_handle();
+    SSL_CTX_set_ex_data(ctx, ExDataIndex(), this);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, &TlsContext::OnNewSession);
+}
+
+TlsContext::~TlsContext()
+{
+    SSL_CTX_sess_set_new_cb(_context->native_handle(), nullptr);
+    SSL_CTX_set_ex_data(_context->native_handle(), ExDataIndex(), nullptr);
+
+    for (auto& [host, session] : _sessions)
+    {
+        SSL_SESSION_free(session);
+    }
+}
+
+std::shared_ptr<TlsContext::Context_t> TlsContext::GetContext() const
+{
+    return _context;
+}
+
+void TlsContext::PrepareSession(SSL* ssl, const std::string& host)
+{
+    SSL_set_tlsext_host_name(ssl, host.c_str());
+
+    // The certificate has to be for the host, not just for someone the trust store knows. An
+    // address is checked against the certificate's IP entries instead of its names.
+    boost::system::error_code ec;
+    boost::asio::ip::make_address(host, ec);
+    if (!ec)
+    {
+        X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), host.c_str());
+    }
+    else
+    {
+        SSL_set_hostflags(ssl, X509_CHECK_FLAG_NO_PARTIAL_WILDCARDS);
+        SSL_set1_host(ssl, host.c_str());
+    }
+
+    std::lock_guard<std::mutex> lock(_sessions_mtx);
+
+    const auto session = _sessions.find(host);
+    if (session != std::end(_sessions))
+    {
+        SSL_set_session(ssl, session->second);
+    }
+}
+
+bool TlsContext::IsVerified(SSL* ssl) const
+{
+    // Turned off on purpose, e.g. against a local server; the result is still recorded then
+    if (SSL_get_verify_mode(ssl) == SSL_VERIFY_NONE)
+    {
+        return true;
+    }
+
+    SSL_SESSION* session = SSL_get_session(ssl);
+    return session != nullptr
+        && SSL_SESSION_get0_peer(session) != nullptr
+        && SSL_get_verify_result(ssl) == X509_V_OK;
+}
+
+void TlsContext::RecordHandshake(SSL* ssl, const uint64_t duration_ns)
+{
+    if (SSL_session_reused(ssl))
+    {
+        _resumed_handshakes.Record(duration_ns);
+    }
+    else
+    {
+        _full_handshakes.Record(duration_ns);
+    }
+}
+
+TlsContext::Stats TlsContext::GetStats() const
+{
+    Stats stats;
+    stats.full_handshake = _full_handshakes.GetSnapshot();
+    stats.resumed_handshake = _resumed_handshakes.GetSnapshot();
+    return stats;
+}
+
+int TlsContext::OnNewSession(SSL* ssl, SSL_SESSION* session)
+{
+    auto* self = static_cast<TlsContext*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ExDataIndex()));
+    const char* host = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+
+    if (self == nullptr || host == nullptr || !SSL_SESSION_is_resumable(session))
+    {
+        return 0;
+    }
+
+    // A copy is kept because OpenSSL marks the original as not resumable when its connection
+    // ends without a clean shutdown, which is exactly the reconnect case this is for
+    SSL_SESSION* copy = SSL_SESSION_dup(session);
+    if (copy == nullptr)
+    {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(self->_sessions_mtx);
+
+    // TLS 1.3 servers may send several tickets; the latest one is as good as any
+    SSL_SESSION*& stored = self->_sessions[host];
+    if (stored != nullptr)
+    {
+        SSL_SESSION_free(stored);
+    }
+    stored = copy;
+
+    return 0;
+}
+
+} // namespace ftx
\ No newline at end of file
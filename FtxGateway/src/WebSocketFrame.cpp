@@ -0,0 +1,148 @@
+#include "WebSocketFrame.h"
+
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace ftx
+{
+namespace ws
+{
+namespace frame
+{
+
+namespace
+{
+
+static constexpr const uint8_t FIN_BIT = 0x80;
+static constexpr const uint8_t MASK_BIT = 0x80;
+static constexpr const uint8_t OPCODE_BITS = 0x0F;
+static constexpr const uint8_t LENGTH_BITS = 0x7F;
+
+static constexpr const uint8_t LENGTH_16 = 126;
+static constexpr const uint8_t LENGTH_64 = 127;
+
+}
+
+bool ParseHeader(const char* data, const size_t size, Header& header)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+
+    if (size < 2)
+    {
+        return false;
+    }
+
+    header.fin = (bytes[0] & FIN_BIT) != 0;
+    header.opcode = static_cast<Opcode>(bytes[0] & OPCODE_BITS);
+    header.masked = (bytes[1] & MASK_BIT) != 0;
+
+    const uint8_t length = bytes[1] & LENGTH_BITS;
+    const size_t length_size = length == LENGTH_64 ? 8 : (length == LENGTH_16 ? 2 : 0);
+
+    header.header_size = 2 + length_size + (header.masked ? 4 : 0);
+    if (size < header.header_size)
+    {
+        return false;
+    }
+
+    if (length_size == 0)
+    {
+        header.payload_size = length;
+    }
+    else
+    {
+        // Network byte order
+        header.payload_size = 0;
+        for (size_t i = 0; i < length_size; ++i)
+        {
+            header.payload_size = (header.payload_size << 8) | bytes[2 + i];
+        }
+    }
+
+    if (header.masked)
+    {
+        std::memcpy(header.mask.data(), bytes + 2 + length_size, header.mask.size());
+    }
+
+    return true;
+}
+
+size_t WriteHeader(char* out, const Opcode opcode, const uint64_t payload_size, const MaskKey_t& mask)
+{
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(out);
+
+    bytes[0] = FIN_BIT | static_cast<uint8_t>(opcode);
+
+    size_t length_size = 0;
+    if (payload_size < LENGTH_16)
+    {
+        bytes[1] = MASK_BIT | static_cast<uint8_t>(payload_size);
+    }
+    else if (payload_size <= 0xFFFF)
+    {
+        bytes[1] = MASK_BIT | LENGTH_16;
+        length_size = 2;
+    }
+    else
+    {
+        bytes[1] = MASK_BIT | LENGTH_64;
+        length_size = 8;
+    }
+
+    for (size_t i = 0; i < length_size; ++i)
+    {
+        bytes[2 + i] = static_cast<uint8_t>(payload_size >> (8 * (length_size - 1 - i)));
+    }
+
+    std::memcpy(bytes + 2 + length_size, mask.data(), mask.size());
+
+    return 2 + length_size + mask.size();
+}
+
+void Mask(char* data, const size_t size, const MaskKey_t& mask)
+{
+    // Every step below is a multiple of four bytes, so the key stays in phase
+    uint32_t key32;
+    std::memcpy(&key32, mask.data(), sizeof(key32));
+
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i key256 = _mm256_set1_epi32(static_cast<int>(key32));
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i* block = reinterpret_cast<__m256i*>(data + i);
+        _mm256_storeu_si256(block, _mm256_xor_si256(_mm256_loadu_si256(block), key256));
+    }
+#endif
+
+#if defined(__SSE2__)
+    const __m128i key128 = _mm_set1_epi32(static_cast<int>(key32));
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i* block = reinterpret_cast<__m128i*>(data + i);
+        _mm_storeu_si128(block, _mm_xor_si128(_mm_loadu_si128(block), key128));
+    }
+#endif
+
+    const uint64_t key64 = (static_cast<uint64_t>(key32) << 32) | key32;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t block;
+        std::memcpy(&block, data + i, sizeof(block));
+        block ^= key64;
+        std::memcpy(data + i, &block, sizeof(block));
+    }
+
+    for (; i < size; ++i)
+    {
+        data[i] = static_cast<char>(data[i] ^ mask[i & 3]);
+    }
+}
+
+} // namespace frame
+} // namespace ws
+} // namespace ftx
\ No newline at end of file
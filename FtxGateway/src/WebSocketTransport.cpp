@@ -0,0 +1,27 @@
+#include "WebSocketTransport.h"
+
+#if FTX_NATIVE_WEBSOCKET
+#include "NativeWebSocketTransport.h"
+#else
+#include "WebsocketppTransport.h"
+#endif
+
+namespace ftx
+{
+namespace ws
+{
+
+std::unique_ptr<WebSocketTransport> MakeWebSocketTransport(const std::string& endpoint
+        , const std::shared_ptr<TlsContext>& tls_context
+        , const SocketOptions& socket_options
+        , const WebSocketTransport::Handlers& handlers)
+{
+#if FTX_NATIVE_WEBSOCKET
+    return std::make_unique<NativeWebSocketTransport>(endpoint, tls_context, socket_options, handlers);
+#else
+    return std::make_unique<WebsocketppTransport>(endpoint, tls_context, socket_options, handlers);
+#endif
+}
+
+} // namespace ws
+} // namespace ftx
\ No newline at end of file
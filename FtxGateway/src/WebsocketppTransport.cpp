@@ -0,0 +1,132 @@
+#include "WebsocketppTransport.h"
+
+#include <boost/bind.hpp>
+#include <websocketpp/endpoint.hpp>
+
+#include "Clock.h"
+
+namespace ftx
+{
+namespace ws
+{
+
+WebsocketppTransport::WebsocketppTransport(const std::string& endpoint
+        , const std::shared_ptr<TlsContext>& tls_context
+        , const SocketOptions& socket_options
+        , const Handlers& handlers)
+    : _endpoint(endpoint)
+    , _tls_context(tls_context)
+    , _socket_options(socket_options)
+    , _handlers(handlers)
+    , _client()
+    , _handshake_start_ns(0)
+    , _socket_fd(-1)
+{
+    _client.clear_access_channels(websocketpp::log::alevel::all);
+    _client.clear_error_channels(websocketpp::log::elevel::all);
+    _client.init_asio();
+
+    _client.set_open_handler(boost::bind(&WebsocketppTransport::OnOpen, this, boost::placeholders::_1));
+    _client.set_fail_handler(boost::bind(&WebsocketppTransport::OnFail, this, boost::placeholders::_1));
+    _client.set_message_handler(boost::bind(&WebsocketppTransport::OnMessage, this, boost::placeholders::_1, boost::placeholders::_2));
+    _client.set_close_handler(boost::bind(&WebsocketppTransport::OnClose, this, boost::placeholders::_1));
+    _client.set_tls_init_handler(boost::bind(&WebsocketppTransport::OnTlsInit, this, boost::placeholders::_1));
+    _client.set_socket_init_handler(boost::bind(&WebsocketppTransport::OnSocketInit, this, boost::placeholders::_1, boost::placeholders::_2));
+    _client.set_tcp_post_init_handler(boost::bind(&WebsocketppTransport::OnTcpPostInit, this, boost::placeholders::_1));
+    _client.set_pong_handler(boost::bind(&WebsocketppTransport::OnPong, this, boost::placeholders::_1, boost::placeholders::_2));
+
+    _client.start_perpetual();
+}
+
+boost::asio::io_context& WebsocketppTransport::GetIoContext()
+{
+    return _client.get_io_service();
+}
+
+void WebsocketppTransport::Connect()
+{
+    websocketpp::lib::error_code ec;
+    _connection_ptr = _client.get_connection(_endpoint, ec);
+    if (ec)
+    {
+        _handlers.on_fail();
+        return;
+    }
+
+    _client.connect(_connection_ptr);
+}
+
+void WebsocketppTransport::Send(const std::string& text)
+{
+    websocketpp::lib::error_code ec;
+    _client.send(_connection_ptr->get_handle(), text, websocketpp::frame::opcode::text, ec);
+}
+
+void WebsocketppTransport::Ping(const std::string& payload)
+{
+    websocketpp::lib::error_code ec;
+    _client.ping(_connection_ptr->get_handle(), payload, ec);
+}
+
+void WebsocketppTransport::Stop()
+{
+    _client.stop_perpetual();
+    _client.stop();
+}
+
+WebsocketppTransport::ContextPtr WebsocketppTransport::OnTlsInit(websocketpp::connection_hdl /*hdl*/)
+{
+    return _tls_context->GetContext();
+}
+
+void WebsocketppTransport::OnSocketInit(websocketpp::connection_hdl hdl, TlsStream& stream)
+{
+    _tls_context->PrepareSession(stream.native_handle(), _client.get_con_from_hdl(hdl)->get_host());
+    _handshake_start_ns = clock::MonotonicNs();
+}
+
+void WebsocketppTransport::OnTcpPostInit(websocketpp::connection_hdl hdl)
+{
+    // Connected and past the TLS handshake, so the socket exists and is the one we will read
+    _socket_fd = _client.get_con_from_hdl(hdl)->get_socket().lowest_layer().native_handle();
+    _socket_options.Apply(_socket_fd);
+}
+
+void WebsocketppTransport::OnOpen(websocketpp::connection_hdl hdl)
+{
+    // Covers the TLS handshake and the websocket upgrade, resumption saves a round trip of it
+    _tls_context->RecordHandshake(_client.get_con_from_hdl(hdl)->get_socket().native_handle()
+            , clock::MonotonicNs() - _handshake_start_ns);
+
+    _handlers.on_open();
+}
+
+void WebsocketppTransport::OnFail(websocketpp::connection_hdl /*hdl*/)
+{
+    _handlers.on_fail();
+}
+
+void WebsocketppTransport::OnMessage(websocketpp::connection_hdl /*hdl*/, MessagePtr msg)
+{
+    if (_socket_options.quick_ack && _socket_fd >= 0)
+    {
+        SocketOptions::RearmQuickAck(_socket_fd);
+    }
+
+    // websocketpp does its own reads, so the kernel receive time is not known
+    const std::string& payload = msg->get_payload();
+    _handlers.on_message(payload.data(), payload.size(), 0);
+}
+
+void WebsocketppTransport::OnClose(websocketpp::connection_hdl /*hdl*/)
+{
+    _handlers.on_close();
+}
+
+void WebsocketppTransport::OnPong(websocketpp::connection_hdl /*hdl*/, std::string payload)
+{
+    _handlers.on_pong(payload);
+}
+
+} // namespace ws
+} // namespace ftx
\ No newline at end of file